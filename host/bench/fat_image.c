@@ -0,0 +1,148 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fat_image.h"
+
+#define SECTOR_SIZE 512
+#define SECTORS_PER_CLUSTER 4
+#define CLUSTER_SIZE (SECTOR_SIZE * SECTORS_PER_CLUSTER)
+#define TOTAL_SECTORS 65536UL
+#define RESERVED_SECTORS 1
+#define FAT_COUNT 2
+#define ROOT_ENTRIES 512
+#define DIRECTORY_ENTRY_SIZE 32
+
+#define CLUSTER_COUNT (TOTAL_SECTORS / SECTORS_PER_CLUSTER)
+// Two reserved entries of two bytes each come first
+#define FAT_SECTORS (((CLUSTER_COUNT + 2) * 2 + SECTOR_SIZE - 1) / SECTOR_SIZE)
+#define ROOT_SECTORS (ROOT_ENTRIES * DIRECTORY_ENTRY_SIZE / SECTOR_SIZE)
+#define ROOT_START (RESERVED_SECTORS + FAT_COUNT * FAT_SECTORS)
+#define DATA_START (ROOT_START + ROOT_SECTORS)
+#define FIRST_CLUSTER 2
+
+#define MEDIA_FIXED 0xF8
+#define END_OF_CHAIN 0xFFFF
+#define ATTRIBUTE_ARCHIVE 0x20
+// 2020-01-01 00:00
+#define FAT_DATE 0x5021
+#define FAT_TIME 0x0000
+
+#define NAME_SIZE 8
+#define EXTENSION_SIZE 3
+
+static void put16(uint8_t *buffer, uint16_t value) {
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+}
+
+static void put32(uint8_t *buffer, uint32_t value) {
+    put16(buffer, value);
+    put16(buffer + 2, value >> 16);
+}
+
+static void fill_boot_sector(uint8_t *sector) {
+    memset(sector, 0, SECTOR_SIZE);
+    memcpy(sector, "\xEB\x3C\x90" "MSDOS5.0", 11);
+    put16(sector + 11, SECTOR_SIZE);
+    sector[13] = SECTORS_PER_CLUSTER;
+    put16(sector + 14, RESERVED_SECTORS);
+    sector[16] = FAT_COUNT;
+    put16(sector + 17, ROOT_ENTRIES);
+    // The 16-bit sector count is 0 as the total needs 32 bits
+    sector[21] = MEDIA_FIXED;
+    put16(sector + 22, FAT_SECTORS);
+    put32(sector + 32, TOTAL_SECTORS);
+    sector[36] = 0x80;
+    sector[38] = 0x29;
+    memcpy(sector + 43, "NO NAME    FAT16   ", 19);
+    sector[510] = 0x55;
+    sector[511] = 0xAA;
+}
+
+static void fill_name(uint8_t *entry, const char *name) {
+    memset(entry, ' ', NAME_SIZE + EXTENSION_SIZE);
+
+    const char *dot = strchr(name, '.');
+    size_t base_length = dot != NULL ? (size_t)(dot - name) : strlen(name);
+    for (size_t i = 0; i < base_length && i < NAME_SIZE; i++) {
+        entry[i] = toupper((unsigned char)name[i]);
+    }
+    for (size_t i = 0; dot != NULL && dot[i + 1] != '\0' && i < EXTENSION_SIZE; i++) {
+        entry[NAME_SIZE + i] = toupper((unsigned char)dot[i + 1]);
+    }
+}
+
+static void fill_directory_entry(uint8_t *entry, const fat_image_file_t *file, uint16_t cluster) {
+    memset(entry, 0, DIRECTORY_ENTRY_SIZE);
+    fill_name(entry, file->name);
+    entry[11] = ATTRIBUTE_ARCHIVE;
+    put16(entry + 14, FAT_TIME);
+    put16(entry + 16, FAT_DATE);
+    put16(entry + 18, FAT_DATE);
+    put16(entry + 22, FAT_TIME);
+    put16(entry + 24, FAT_DATE);
+    put16(entry + 26, cluster);
+    put32(entry + 28, file->size);
+}
+
+static bool write_at(int fd, const void *data, size_t size, uint32_t sector) {
+    return pwrite(fd, data, size, (off_t)sector * SECTOR_SIZE) == (ssize_t)size;
+}
+
+bool fat_image_write(const char *path, const fat_image_file_t *files, uint16_t file_count) {
+    if (file_count > ROOT_ENTRIES) {
+        return false;
+    }
+
+    uint8_t *fat = calloc(FAT_SECTORS, SECTOR_SIZE);
+    uint8_t *root = calloc(ROOT_SECTORS, SECTOR_SIZE);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fat != NULL && root != NULL && fd >= 0 && ftruncate(fd, (off_t)TOTAL_SECTORS * SECTOR_SIZE) == 0;
+
+    uint8_t sector[SECTOR_SIZE];
+    fill_boot_sector(sector);
+    ok = ok && write_at(fd, sector, SECTOR_SIZE, 0);
+
+    if (ok) {
+        put16(fat, 0xFF00 | MEDIA_FIXED);
+        put16(fat + 2, END_OF_CHAIN);
+    }
+
+    uint32_t next_cluster = FIRST_CLUSTER;
+    for (uint16_t i = 0; ok && i < file_count; i++) {
+        uint32_t clusters = (files[i].size + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+        if (next_cluster + clusters > CLUSTER_COUNT + FIRST_CLUSTER) {
+            ok = false;
+            break;
+        }
+
+        // Empty files have no cluster
+        uint16_t first = clusters != 0 ? next_cluster : 0;
+        fill_directory_entry(root + i * DIRECTORY_ENTRY_SIZE, &files[i], first);
+
+        for (uint32_t j = 0; j < clusters; j++) {
+            uint32_t cluster = next_cluster + j;
+            put16(fat + cluster * 2, j + 1 < clusters ? cluster + 1 : END_OF_CHAIN);
+        }
+
+        uint32_t start = DATA_START + (next_cluster - FIRST_CLUSTER) * SECTORS_PER_CLUSTER;
+        ok = write_at(fd, files[i].data, files[i].size, start);
+        next_cluster += clusters;
+    }
+
+    for (uint8_t i = 0; ok && i < FAT_COUNT; i++) {
+        ok = write_at(fd, fat, FAT_SECTORS * SECTOR_SIZE, RESERVED_SECTORS + i * FAT_SECTORS);
+    }
+    ok = ok && write_at(fd, root, ROOT_SECTORS * SECTOR_SIZE, ROOT_START);
+
+    if (fd >= 0 && close(fd) != 0) {
+        ok = false;
+    }
+    free(fat);
+    free(root);
+    return ok;
+}
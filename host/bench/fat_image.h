@@ -0,0 +1,20 @@
+#ifndef FAT_IMAGE_H
+#define FAT_IMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Writes a 32 MB FAT16 disk image without a partition table, for benchmarks
+// which need the same card contents on every run
+
+typedef struct {
+    // 8.3 name, stored in upper case
+    const char *name;
+    const uint8_t *data;
+    uint32_t size;
+} fat_image_file_t;
+
+// All files go into the root directory, one after the other
+bool fat_image_write(const char *path, const fat_image_file_t *files, uint16_t file_count);
+
+#endif // FAT_IMAGE_H
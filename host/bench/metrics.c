@@ -0,0 +1,80 @@
+#include "metrics.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LINE_SIZE 128
+#define METRIC_NAME_SIZE 48
+
+typedef struct {
+    const char *name;
+    double value;
+} metric_t;
+
+static struct {
+    metric_t metrics[METRICS_MAX];
+    uint8_t count;
+} metrics;
+
+void metrics_add(const char *name, double value) {
+    if (metrics.count < METRICS_MAX) {
+        metrics.metrics[metrics.count++] = (metric_t){name, value};
+    }
+}
+
+static const metric_t *find_metric(const char *name) {
+    for (uint8_t i = 0; i < metrics.count; i++) {
+        if (strcmp(metrics.metrics[i].name, name) == 0) {
+            return &metrics.metrics[i];
+        }
+    }
+    return NULL;
+}
+
+void metrics_print() {
+    for (uint8_t i = 0; i < metrics.count; i++) {
+        printf("%-32s %12.1f\n", metrics.metrics[i].name, metrics.metrics[i].value);
+    }
+}
+
+bool metrics_check_budgets(const char *path) {
+    FILE *budgets = fopen(path, "r");
+    if (budgets == NULL) {
+        perror(path);
+        return false;
+    }
+
+    bool passed = true;
+    char line[LINE_SIZE];
+    printf("\n%-32s %12s %14s\n", "Metric", "Value", "Budget");
+
+    while (fgets(line, sizeof(line), budgets) != NULL) {
+        char name[METRIC_NAME_SIZE];
+        char operator[3];
+        double limit;
+
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        if (sscanf(line, "%47s %2s %lf", name, operator, &limit) != 3) {
+            continue;
+        }
+
+        const metric_t *metric = find_metric(name);
+        bool at_most = strcmp(operator, "<=") == 0;
+        if (metric == NULL || (!at_most && strcmp(operator, ">=") != 0)) {
+            printf("%-32s %12s %11s %.1f  UNKNOWN\n", name, "-", operator, limit);
+            passed = false;
+            continue;
+        }
+
+        bool ok = at_most ? metric->value <= limit : metric->value >= limit;
+        printf("%-32s %12.1f %11s %.1f%s\n", name, metric->value, operator, limit, ok ? "" : "  OVER BUDGET");
+        passed = passed && ok;
+    }
+
+    fclose(budgets);
+    return passed;
+}
@@ -0,0 +1,17 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+
+// Named results of a benchmark run, checked against a budget file. Budget
+// lines are "metric <= limit" or "metric >= limit", # starts a comment.
+
+#define METRICS_MAX 32
+
+// name has to stay valid, it is not copied
+void metrics_add(const char *name, double value);
+void metrics_print(void);
+// Prints every budgeted metric, false if one is over budget or unknown
+bool metrics_check_budgets(const char *path);
+
+#endif // METRICS_H
@@ -0,0 +1,287 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <millis.h>
+#include "fatfs/ff.h"
+#include "hal.h"
+#include "hal_lcd.h"
+#include "hal_sd_card.h"
+#include "fat_image.h"
+#include "metrics.h"
+#include "firmware.h"
+#include "buttons.h"
+#include "usart.h"
+
+// Runs the firmware on the virtual clock through a fixed script of button
+// presses, with a generated SD card and a serial feed, and checks the
+// results against the budgets given on the command line. Board time only
+// moves through delays and bus transfers, so every number repeats exactly
+// from run to run and on any host. The CPU work of the firmware takes no
+// board time here, so the times are what the firmware waits for the LCD, the
+// SD card and the USART. Cycle counts of the real firmware come from
+// host/sim/avr_cycles.c.
+
+#define CYCLES_PER_US (F_CPU / 1000000UL)
+
+// Long enough for the press and the release to be seen
+#define PRESS_TICKS 4
+#define IDLE_TICKS 30
+#define MENU_MOVES 5
+#define PICKER_MOVES 10
+// Main menu entry of the serial monitor
+#define SERIAL_MONITOR_ENTRY 3
+
+#define PICKER_FILE_COUNT 20
+#define BIG_FILE_SIZE (256UL * 1024)
+// More than the monitor takes in at its default baud rate meanwhile
+#define FEED_SIZE 16384
+#define FEED_TICKS 60
+#define SD_CHUNK_SIZE 512
+
+#define LINE_SIZE 128
+
+static struct {
+    // Firmware work of the current measurement, without the idle time
+    uint64_t cycles;
+    uint32_t ticks;
+    uint32_t lcd_transfers;
+    uint32_t sectors;
+} suite;
+
+static uint32_t get_lcd_transfers() {
+    const hal_lcd_stats_t *stats = hal_lcd_get_stats();
+    return stats->commands + stats->data_writes;
+}
+
+static void start_measurement() {
+    suite.cycles = 0;
+    suite.ticks = 0;
+    suite.lcd_transfers = 0;
+    suite.sectors = 0;
+}
+
+static double get_measured_us() {
+    return (double)suite.cycles / CYCLES_PER_US;
+}
+
+// One pass of the main loop, followed by the wait for the next one
+static void run_tick() {
+    uint64_t start = hal_get_cycles();
+    uint32_t lcd_transfers = get_lcd_transfers();
+    uint32_t sectors = hal_sd_card_get_stats()->sectors_read;
+
+    firmware_tick(millis());
+    firmware_poll(millis());
+
+    uint64_t spent = hal_get_cycles() - start;
+    suite.cycles += spent;
+    suite.ticks++;
+    suite.lcd_transfers += get_lcd_transfers() - lcd_transfers;
+    suite.sectors += hal_sd_card_get_stats()->sectors_read - sectors;
+
+    uint64_t interval = (uint64_t)FIRMWARE_LOOP_INTERVAL * 1000 * CYCLES_PER_US;
+    if (spent < interval) {
+        hal_delay_cycles(interval - spent);
+    }
+}
+
+static void run_ticks(uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+        run_tick();
+    }
+}
+
+static void press(button_name_t button) {
+    hal_buttons_press(button);
+    run_ticks(PRESS_TICKS);
+}
+
+static void press_repeatedly(button_name_t button, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        press(button);
+    }
+}
+
+static void boot() {
+    uint64_t start = hal_get_cycles();
+    firmware_setup();
+    metrics_add("boot_wait_ms", (double)(hal_get_cycles() - start) / (CYCLES_PER_US * 1000));
+}
+
+static void measure_main_menu() {
+    start_measurement();
+    run_ticks(IDLE_TICKS);
+    metrics_add("idle_tick_lcd_transfers", (double)suite.lcd_transfers / suite.ticks);
+
+    start_measurement();
+    press_repeatedly(BUTTON_DOWN, MENU_MOVES);
+    press_repeatedly(BUTTON_UP, MENU_MOVES);
+    metrics_add("menu_move_wait_us", get_measured_us() / (2 * MENU_MOVES));
+    metrics_add("menu_move_lcd_transfers", (double)suite.lcd_transfers / (2 * MENU_MOVES));
+}
+
+// Starts on "Flash Program" and ends back on the main menu
+static void measure_file_picker() {
+    start_measurement();
+    press(BUTTON_SELECT);
+    metrics_add("picker_open_wait_us", get_measured_us());
+    metrics_add("picker_open_sectors", suite.sectors);
+
+    start_measurement();
+    press_repeatedly(BUTTON_DOWN, PICKER_MOVES);
+    metrics_add("picker_move_wait_us", get_measured_us() / PICKER_MOVES);
+    metrics_add("picker_move_sectors", (double)suite.sectors / PICKER_MOVES);
+    metrics_add("picker_move_lcd_transfers", (double)suite.lcd_transfers / PICKER_MOVES);
+
+    press(BUTTON_BACK);
+}
+
+static int open_feed(int *feed) {
+    int fds[2];
+    if (pipe(fds) != 0 || fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0) {
+        return -1;
+    }
+
+    hal_usart_attach(USART_PORT_1, fds[0]);
+    *feed = fds[1];
+    return fds[0];
+}
+
+static int get_unread_feed(int fd) {
+    int unread = 0;
+    ioctl(fd, FIONREAD, &unread);
+    return unread;
+}
+
+static bool measure_serial_monitor() {
+    int feed;
+    int fd = open_feed(&feed);
+    if (fd < 0) {
+        perror("Serial feed");
+        return false;
+    }
+
+    press_repeatedly(BUTTON_DOWN, SERIAL_MONITOR_ENTRY);
+    press(BUTTON_SELECT);
+
+    char line[LINE_SIZE];
+    uint16_t written = 0;
+    for (uint16_t i = 0; written + LINE_SIZE <= FEED_SIZE; i++) {
+        int length = snprintf(line, sizeof(line), "%05u the quick brown fox jumps over the lazy dog\r\n", i);
+        if (write(feed, line, length) != length) {
+            perror("Serial feed");
+            return false;
+        }
+        written += length;
+    }
+
+    start_measurement();
+    run_ticks(FEED_TICKS);
+    uint16_t received = written - get_unread_feed(fd);
+
+    metrics_add("monitor_tick_wait_us", get_measured_us() / suite.ticks);
+    metrics_add("monitor_wait_us_per_byte", get_measured_us() / received);
+    metrics_add("monitor_lcd_transfers_per_tick", (double)suite.lcd_transfers / suite.ticks);
+
+    press(BUTTON_BACK);
+    press_repeatedly(BUTTON_UP, SERIAL_MONITOR_ENTRY);
+
+    hal_usart_attach(USART_PORT_1, -1);
+    close(feed);
+    close(fd);
+    return true;
+}
+
+// Streams the big file the way the decoders read images
+static bool measure_sd_card() {
+    static FATFS file_system;
+    static uint8_t chunk[SD_CHUNK_SIZE];
+    FIL file;
+    UINT read;
+
+    FRESULT f_err = f_mount(&file_system, "", 1);
+    if (f_err == FR_OK) {
+        f_err = f_open(&file, "BIG.BIN", FA_READ);
+    }
+
+    uint32_t sectors = hal_sd_card_get_stats()->sectors_read;
+    uint64_t start = hal_get_cycles();
+    while (f_err == FR_OK && (f_err = f_read(&file, chunk, sizeof(chunk), &read)) == FR_OK && read != 0) {
+        // Keep reading
+    }
+
+    if (f_err != FR_OK) {
+        fprintf(stderr, "Reading BIG.BIN failed: %d\n", f_err);
+        return false;
+    }
+
+    double seconds = (double)(hal_get_cycles() - start) / F_CPU;
+    metrics_add("sd_sectors_per_s", (hal_sd_card_get_stats()->sectors_read - sectors) / seconds);
+    f_close(&file);
+    return true;
+}
+
+static bool create_card(const char *path) {
+    static const uint8_t hex_file[] = ":00000001FF\r\n";
+    static char names[PICKER_FILE_COUNT][13];
+    static uint8_t big_file[BIG_FILE_SIZE];
+    fat_image_file_t files[PICKER_FILE_COUNT + 1];
+
+    for (uint16_t i = 0; i < PICKER_FILE_COUNT; i++) {
+        snprintf(names[i], sizeof(names[i]), "PROG%02u.HEX", i);
+        files[i] = (fat_image_file_t){names[i], hex_file, sizeof(hex_file) - 1};
+    }
+
+    for (uint32_t i = 0; i < BIG_FILE_SIZE; i++) {
+        big_file[i] = i * 7 + (i >> 8);
+    }
+    files[PICKER_FILE_COUNT] = (fat_image_file_t){"BIG.BIN", big_file, BIG_FILE_SIZE};
+
+    hal_sd_card_config_t config;
+    hal_sd_card_get_default_config(&config);
+    return fat_image_write(path, files, PICKER_FILE_COUNT + 1) && hal_sd_card_insert(path, &config);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [budgets]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    hal_set_virtual_time(true);
+
+    char card_path[] = "/tmp/perf_suite_XXXXXX";
+    int card_fd = mkstemp(card_path);
+    if (card_fd < 0) {
+        perror("SD image");
+        return EXIT_FAILURE;
+    }
+    close(card_fd);
+
+    bool created = create_card(card_path);
+    unlink(card_path);
+    if (!created) {
+        fprintf(stderr, "Creating the SD image failed\n");
+        return EXIT_FAILURE;
+    }
+
+    boot();
+    measure_main_menu();
+    measure_file_picker();
+    if (!measure_serial_monitor() || !measure_sd_card()) {
+        return EXIT_FAILURE;
+    }
+
+    metrics_print();
+
+    if (argc == 2 && !metrics_check_budgets(argv[1])) {
+        printf("\nPerformance budget exceeded\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
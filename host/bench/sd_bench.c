@@ -0,0 +1,197 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "fatfs/ff.h"
+#include "hal.h"
+#include "hal_sd_card.h"
+
+// Mounts a disk image through the real sd.c, SPI and FatFs code and reads
+// every file on it, the way the file picker and the uploader do. Times are
+// board times on the virtual clock, so they repeat from run to run.
+
+// The Intel HEX decoder reads this much at a time
+#define DEFAULT_CHUNK_SIZE 64
+#define MAX_CHUNK_SIZE 4096
+#define PATH_SIZE 256
+
+static struct {
+    uint16_t chunk_size;
+    uint32_t directories;
+    uint32_t files;
+    uint64_t bytes;
+    uint32_t read_calls;
+} bench;
+
+static uint8_t chunk[MAX_CHUNK_SIZE];
+
+static double cycles_to_seconds(uint64_t cycles) {
+    return (double)cycles / F_CPU;
+}
+
+static double get_wall_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static FRESULT read_file(const char *path) {
+    FIL file;
+    UINT read;
+
+    FRESULT f_err = f_open(&file, path, FA_READ);
+    if (f_err != FR_OK) {
+        return f_err;
+    }
+
+    do {
+        f_err = f_read(&file, chunk, bench.chunk_size, &read);
+        bench.read_calls++;
+        bench.bytes += read;
+    } while (f_err == FR_OK && read == bench.chunk_size);
+
+    f_close(&file);
+    bench.files++;
+    return f_err;
+}
+
+static FRESULT read_directory(char *path) {
+    DIR directory;
+    FILINFO info;
+
+    FRESULT f_err = f_opendir(&directory, path);
+    if (f_err != FR_OK) {
+        return f_err;
+    }
+    bench.directories++;
+
+    size_t path_length = strlen(path);
+    while ((f_err = f_readdir(&directory, &info)) == FR_OK && info.fname[0] != '\0') {
+        if (path_length + 1 + strlen(info.fname) >= PATH_SIZE) {
+            continue;
+        }
+        sprintf(path + path_length, "/%s", info.fname);
+
+        if (info.fattrib & AM_DIR) {
+            f_err = read_directory(path);
+        } else {
+            f_err = read_file(path);
+        }
+
+        path[path_length] = '\0';
+        if (f_err != FR_OK) {
+            break;
+        }
+    }
+
+    f_closedir(&directory);
+    return f_err;
+}
+
+static void print_commands(const char *prefix, const uint32_t *counts) {
+    for (uint8_t i = 0; i < HAL_SD_CARD_COMMAND_COUNT; i++) {
+        if (counts[i] != 0) {
+            printf("  %s%-2u %10u\n", prefix, i, counts[i]);
+        }
+    }
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-t v1|sc|hc] [-i init_ms] [-n ncr_bytes] [-l latency_us] [-c chunk_size] image\n", name);
+}
+
+int main(int argc, char **argv) {
+    hal_sd_card_config_t config;
+    hal_sd_card_get_default_config(&config);
+    bench.chunk_size = DEFAULT_CHUNK_SIZE;
+
+    int option;
+    while ((option = getopt(argc, argv, "t:i:n:l:c:")) != -1) {
+        switch (option) {
+            case 't':
+                config.type = strcmp(optarg, "v1") == 0 ? HAL_SD_CARD_V1 : strcmp(optarg, "sc") == 0 ? HAL_SD_CARD_V2_SC : HAL_SD_CARD_V2_HC;
+                break;
+            case 'i':
+                config.init_ms = atoi(optarg);
+                break;
+            case 'n':
+                config.response_delay_bytes = atoi(optarg);
+                break;
+            case 'l':
+                config.read_latency_us = atoi(optarg);
+                break;
+            case 'c':
+                bench.chunk_size = atoi(optarg);
+                break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1 || bench.chunk_size == 0 || bench.chunk_size > MAX_CHUNK_SIZE) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!hal_sd_card_insert(argv[optind], &config)) {
+        fprintf(stderr, "Can't use %s as a disk image\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    // sd.c times out through the Timer1 interrupt
+    hal_set_virtual_time(true);
+    hal_sei();
+
+    FATFS file_system;
+    double wall_start = get_wall_seconds();
+    uint64_t mount_start = hal_get_cycles();
+
+    FRESULT f_err = f_mount(&file_system, "", 1);
+    if (f_err != FR_OK) {
+        fprintf(stderr, "Mount failed: %d\n", f_err);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t mount_cycles = hal_get_cycles() - mount_start;
+    hal_sd_card_stats_t mount_stats = *hal_sd_card_get_stats();
+    hal_sd_card_reset_stats();
+
+    char path[PATH_SIZE] = "";
+    uint64_t read_start = hal_get_cycles();
+    f_err = read_directory(path);
+    uint64_t read_cycles = hal_get_cycles() - read_start;
+    double wall_seconds = get_wall_seconds() - wall_start;
+
+    if (f_err != FR_OK) {
+        fprintf(stderr, "Reading %s failed: %d\n", path, f_err);
+        return EXIT_FAILURE;
+    }
+
+    const hal_sd_card_stats_t *stats = hal_sd_card_get_stats();
+    double read_seconds = cycles_to_seconds(read_cycles);
+
+    printf("Mount: %.3f ms, %u sectors\n", cycles_to_seconds(mount_cycles) * 1e3, mount_stats.sectors_read);
+    printf("Read: %u directories, %u files, %llu bytes in %u calls of %u bytes\n",
+        bench.directories, bench.files, (unsigned long long)bench.bytes, bench.read_calls, bench.chunk_size);
+    printf("Board time: %.3f s\n", read_seconds);
+    printf("Sectors: %u, %.1f per second\n", stats->sectors_read, read_seconds > 0 ? stats->sectors_read / read_seconds : 0);
+    printf("Throughput: %.1f KB/s of file data\n", read_seconds > 0 ? bench.bytes / read_seconds / 1024 : 0);
+    printf("Repeated sector reads: %u (%.1f%%)\n", stats->repeated_sector_reads,
+        stats->sectors_read != 0 ? 100.0 * stats->repeated_sector_reads / stats->sectors_read : 0);
+    printf("Bus bytes: %llu, %.1f%% waiting for data\n", (unsigned long long)stats->bus_bytes,
+        stats->bus_bytes != 0 ? 100.0 * stats->latency_bytes / stats->bus_bytes : 0);
+    printf("Host time: %.3f s\n", wall_seconds);
+
+    printf("Commands during mount:\n");
+    print_commands("CMD", mount_stats.commands);
+    print_commands("ACMD", mount_stats.app_commands);
+    printf("Commands during reads:\n");
+    print_commands("CMD", stats->commands);
+    print_commands("ACMD", stats->app_commands);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,213 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <millis.h>
+#include "fatfs/ff.h"
+#include "hal.h"
+#include "hal_sd_card.h"
+#include "avr109_target.h"
+#include "uploader.h"
+#include "usart.h"
+
+// Flashes an image from a disk image into the mock Caterina target over a
+// pty, through the real SD, FatFs, decoder, uploader and USART code. The
+// target runs on its own thread with wall clock program delays, so the
+// board runs on the wall clock too.
+
+#define TARGET_USART USART_PORT_1
+#define DOUBLE_SPEED_PRESCALER 8
+// Raw UCSZ value for eight data bits
+#define CHARACTER_SIZE_8 3
+
+static struct {
+    avr109_target_config_t target_config;
+    upload_mode_t mode;
+    uint16_t runs;
+    volatile sig_atomic_t stop_target;
+} bench;
+
+static void *serve_target(void *fd) {
+    avr109_target_serve(*(int *)fd, &bench.target_config, &bench.stop_target);
+    return NULL;
+}
+
+static bool open_pty(int *master, int *slave) {
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (*master < 0 || grantpt(*master) != 0 || unlockpt(*master) != 0) {
+        return false;
+    }
+
+    *slave = open(ptsname(*master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (*slave < 0) {
+        return false;
+    }
+
+    struct termios settings;
+    tcgetattr(*master, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(*master, TCSANOW, &settings);
+    tcsetattr(*slave, TCSANOW, &settings);
+    return true;
+}
+
+static void configure_usart(uint32_t baud_rate) {
+    uint32_t divider = (F_CPU + DOUBLE_SPEED_PRESCALER / 2 * baud_rate) / (DOUBLE_SPEED_PRESCALER * baud_rate);
+
+    usart_init();
+    usart_configure(TARGET_USART, divider - 1, true, CHARACTER_SIZE_8, 0, 0);
+}
+
+static upload_result_t run_upload(FIL *file, image_format_t format) {
+    upload_config_t config = {
+        .flash_file = file,
+        .flash_format = format,
+        .flash_timestamp = 0,
+        .eeprom_file = NULL,
+        .mode = bench.mode,
+        .expected_part = NULL
+    };
+
+    uploader_start(&config);
+
+    upload_result_t result;
+    while ((result = uploader_step()) == UPLOAD_IN_PROGRESS) {
+        hal_poll();
+    }
+
+    return result;
+}
+
+static image_format_t get_format(const char *name) {
+    const char *extension = strrchr(name, '.');
+    if (extension != NULL && strcasecmp(extension, ".bin") == 0) {
+        return IMAGE_FORMAT_BINARY;
+    } else if (extension != NULL && strcasecmp(extension, ".elf") == 0) {
+        return IMAGE_FORMAT_ELF;
+    }
+    return IMAGE_FORMAT_INTEL_HEX;
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-b baud] [-w page_program_us] [-x page_erase_us] [-s page_size] [-m full|changes] [-r runs] [-f fault_interval] disk_image file\n", name);
+}
+
+int main(int argc, char **argv) {
+    avr109_target_get_default_config(&bench.target_config);
+    bench.mode = UPLOAD_MODE_FULL;
+    bench.runs = 1;
+
+    int option;
+    while ((option = getopt(argc, argv, "b:w:x:s:m:r:f:")) != -1) {
+        switch (option) {
+            case 'b':
+                bench.target_config.baud_rate = atol(optarg);
+                break;
+            case 'w':
+                bench.target_config.page_program_us = atol(optarg);
+                break;
+            case 'x':
+                bench.target_config.page_erase_us = atol(optarg);
+                break;
+            case 's':
+                bench.target_config.page_size = atoi(optarg);
+                break;
+            case 'm':
+                bench.mode = strcmp(optarg, "changes") == 0 ? UPLOAD_MODE_CHANGES : UPLOAD_MODE_FULL;
+                break;
+            case 'r':
+                bench.runs = atoi(optarg);
+                break;
+            case 'f':
+                bench.target_config.fault_interval = atoi(optarg);
+                break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 2 || bench.target_config.baud_rate == 0 || bench.runs == 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    hal_sd_card_config_t card_config;
+    hal_sd_card_get_default_config(&card_config);
+    if (!hal_sd_card_insert(argv[optind], &card_config)) {
+        fprintf(stderr, "Can't use %s as a disk image\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    int master;
+    int slave;
+    if (!open_pty(&master, &slave)) {
+        perror("pty");
+        return EXIT_FAILURE;
+    }
+
+    avr109_target_reset();
+    pthread_t target_thread;
+    pthread_create(&target_thread, NULL, &serve_target, &master);
+
+    millis_init();
+    configure_usart(bench.target_config.baud_rate);
+    hal_usart_attach(TARGET_USART, slave);
+    hal_sei();
+
+    FATFS file_system;
+    FIL file;
+    FRESULT f_err = f_mount(&file_system, "", 1);
+    if (f_err == FR_OK) {
+        f_err = f_open(&file, argv[optind + 1], FA_READ);
+    }
+    if (f_err != FR_OK) {
+        fprintf(stderr, "Opening %s failed: %d\n", argv[optind + 1], f_err);
+        return EXIT_FAILURE;
+    }
+
+    double total_seconds = 0;
+    for (uint16_t run = 0; run < bench.runs; run++) {
+        // Every run but the first finds the target already programmed
+        if (run != 0 && bench.mode == UPLOAD_MODE_FULL) {
+            avr109_target_reset();
+        }
+
+        const hal_sd_card_stats_t *card_stats = hal_sd_card_get_stats();
+        uint32_t sectors_before = card_stats->sectors_read;
+        uint64_t rx_before = avr109_target_get_stats()->rx_bytes;
+        uint64_t tx_before = avr109_target_get_stats()->tx_bytes;
+        uint64_t busy_before = avr109_target_get_stats()->busy_ns;
+
+        uint64_t start = hal_get_cycles();
+        upload_result_t result = run_upload(&file, get_format(argv[optind + 1]));
+        double seconds = (double)(hal_get_cycles() - start) / F_CPU;
+
+        // Give the target time to take the exit command off the line
+        usleep(10000);
+        const avr109_target_stats_t *stats = avr109_target_get_stats();
+
+        if (result != UPLOAD_DONE) {
+            printf("Run %u failed after %.3f s: %s\n", run + 1, seconds, uploader_get_error());
+            return EXIT_FAILURE;
+        }
+
+        total_seconds += seconds;
+        printf("Run %u: %.3f s, %llu bytes to the target, %llu back, %u pages written, %u skipped, %u retries, %u sectors, %.1f%% idle while programming\n",
+            run + 1, seconds, (unsigned long long)(stats->rx_bytes - rx_before), (unsigned long long)(stats->tx_bytes - tx_before),
+            uploader_get_written_pages(), uploader_get_skipped_pages(), uploader_get_retries(), card_stats->sectors_read - sectors_before,
+            stats->session_ns != 0 ? 100.0 * (stats->busy_ns - busy_before) / stats->session_ns : 0);
+    }
+
+    printf("Average: %.3f s per image at %u baud\n", total_seconds / bench.runs, bench.target_config.baud_rate);
+
+    bench.stop_target = true;
+    pthread_join(target_thread, NULL);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,55 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Digits are written backwards, then turned around like avr-libc does it
+static char *unsigned_to_string(unsigned long value, char *buffer, int radix, bool negative) {
+    char *position = buffer;
+
+    if (radix < 2 || radix > 36) {
+        *buffer = '\0';
+        return buffer;
+    }
+
+    do {
+        unsigned long digit = value % radix;
+        *position++ = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        value /= radix;
+    } while (value != 0);
+
+    if (negative) {
+        *position++ = '-';
+    }
+    *position = '\0';
+
+    for (char *start = buffer, *end = position - 1; start < end; start++, end--) {
+        char c = *start;
+        *start = *end;
+        *end = c;
+    }
+
+    return buffer;
+}
+
+// Only radix 10 gets a sign, other radixes print the two's complement
+static char *signed_to_string(long value, unsigned long mask, char *buffer, int radix) {
+    if (radix == 10 && value < 0) {
+        return unsigned_to_string(-(unsigned long)value, buffer, radix, true);
+    }
+    return unsigned_to_string((unsigned long)value & mask, buffer, radix, false);
+}
+
+char *itoa(int value, char *buffer, int radix) {
+    return signed_to_string(value, (unsigned)-1, buffer, radix);
+}
+
+char *ltoa(long value, char *buffer, int radix) {
+    return signed_to_string(value, (unsigned long)-1, buffer, radix);
+}
+
+char *utoa(unsigned int value, char *buffer, int radix) {
+    return unsigned_to_string(value, buffer, radix, false);
+}
+
+char *ultoa(unsigned long value, char *buffer, int radix) {
+    return unsigned_to_string(value, buffer, radix, false);
+}
@@ -0,0 +1,138 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include "hal.h"
+#include "hal_internal.h"
+
+// Long enough for the 30 Hz main loop to see both edges
+#define PRESS_MS 50
+#define RELEASE_MS 50
+// How often stdin is checked for keys
+#define KEYBOARD_POLL_MS 10
+
+#define PRESS_QUEUE_SIZE 64
+#define NO_PIN 0xFF
+
+// The buttons pull the PORTC pins low
+typedef struct {
+    char key;
+    uint8_t pin;
+} key_binding_t;
+
+static const key_binding_t key_bindings[] = {
+    {'w', 7},
+    {'\n', 6},
+    {'\r', 6},
+    {' ', 6},
+    {'s', 5},
+    {'1', 4},
+    {'2', 3},
+    {'3', 2},
+    {'4', 1},
+    {'q', 0},
+    {0x7F, 0},
+    {'\b', 0},
+};
+static const uint8_t key_binding_count = sizeof(key_bindings) / sizeof(key_binding_t);
+
+static struct {
+    uint8_t queue[PRESS_QUEUE_SIZE];
+    uint8_t queue_head;
+    uint8_t queue_tail;
+    uint8_t pressed_pin;
+    uint64_t phase_end_cycles;
+    uint64_t next_keyboard_cycles;
+    bool keyboard_open;
+    bool terminal_changed;
+    struct termios terminal_settings;
+} buttons;
+
+void hal_buttons_press(uint8_t pin) {
+    uint8_t next_head = (buttons.queue_head + 1) % PRESS_QUEUE_SIZE;
+    if (next_head == buttons.queue_tail) {
+        return;
+    }
+
+    buttons.queue[buttons.queue_head] = pin;
+    buttons.queue_head = next_head;
+}
+
+static void read_keyboard() {
+    char key;
+    ssize_t result;
+
+    while ((result = read(STDIN_FILENO, &key, 1)) == 1) {
+        for (uint8_t i = 0; i < key_binding_count; i++) {
+            if (key_bindings[i].key == key) {
+                hal_buttons_press(key_bindings[i].pin);
+                break;
+            }
+        }
+    }
+
+    // A script piped into stdin has ended
+    if (result == 0) {
+        buttons.keyboard_open = false;
+    }
+}
+
+void hal_buttons_update(uint64_t now) {
+    if (buttons.keyboard_open && now >= buttons.next_keyboard_cycles) {
+        buttons.next_keyboard_cycles = now + (uint64_t)KEYBOARD_POLL_MS * (F_CPU / 1000);
+        read_keyboard();
+    }
+
+    if (now < buttons.phase_end_cycles) {
+        return;
+    }
+
+    if (buttons.pressed_pin != NO_PIN) {
+        PINC |= _BV(buttons.pressed_pin);
+        buttons.pressed_pin = NO_PIN;
+        buttons.phase_end_cycles = now + (uint64_t)RELEASE_MS * (F_CPU / 1000);
+    } else if (buttons.queue_tail != buttons.queue_head) {
+        buttons.pressed_pin = buttons.queue[buttons.queue_tail];
+
+        char event[8];
+        snprintf(event, sizeof(event), "key %u", buttons.pressed_pin);
+        hal_lcd_log(event);
+
+        buttons.queue_tail = (buttons.queue_tail + 1) % PRESS_QUEUE_SIZE;
+        PINC &= ~_BV(buttons.pressed_pin);
+        buttons.phase_end_cycles = now + (uint64_t)PRESS_MS * (F_CPU / 1000);
+    }
+}
+
+static void restore_terminal() {
+    if (buttons.terminal_changed) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &buttons.terminal_settings);
+    }
+}
+
+void hal_buttons_init() {
+    buttons.pressed_pin = NO_PIN;
+
+    int flags = fcntl(STDIN_FILENO, F_GETFL);
+    if (flags < 0 || fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return;
+    }
+    buttons.keyboard_open = true;
+
+    // Keys count as soon as they are typed
+    if (tcgetattr(STDIN_FILENO, &buttons.terminal_settings) == 0) {
+        struct termios settings = buttons.terminal_settings;
+        settings.c_lflag &= ~(ICANON | ECHO);
+        settings.c_cc[VMIN] = 0;
+        settings.c_cc[VTIME] = 0;
+
+        if (tcsetattr(STDIN_FILENO, TCSANOW, &settings) == 0) {
+            buttons.terminal_changed = true;
+            atexit(&restore_terminal);
+        }
+    }
+}
@@ -0,0 +1,314 @@
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <avr/io.h>
+#include "hal.h"
+#include "hal_internal.h"
+
+#define HAL_REGISTER8(name) volatile uint8_t name;
+#define HAL_REGISTER16(name) volatile uint16_t name;
+#include "hal_registers.h"
+#undef HAL_REGISTER8
+#undef HAL_REGISTER16
+
+#define NS_PER_SECOND 1000000000ULL
+#define CYCLES_PER_US (F_CPU / 1000000UL)
+#define CYCLES_PER_MS (F_CPU / 1000UL)
+
+#define CLOCK_SELECT_MASK 0x07
+
+// Half a character at 1 Mbaud, the fastest rate the firmware offers
+#define DELAY_STEP_CYCLES (5 * CYCLES_PER_US)
+
+// Guards against an interrupt which never stops being pending
+#define MAX_VECTORS_PER_POLL 10000
+
+// Weak, so the firmware can leave out any module with an ISR
+#define HAL_VECTOR(name) void name(void) __attribute__((weak));
+HAL_VECTOR(TIMER2_COMP_vect)
+HAL_VECTOR(TIMER1_COMPA_vect)
+HAL_VECTOR(TIMER0_COMP_vect)
+HAL_VECTOR(TIMER3_COMPA_vect)
+#undef HAL_VECTOR
+
+// Prescalers indexed by the clock select bits, 0 means stopped. External
+// clock sources are not emulated.
+static const uint16_t timer0_prescalers[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+static const uint16_t timer_prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+
+// Only normal and CTC mode are emulated, which is all the firmware uses
+typedef struct {
+    volatile uint8_t *control;
+    uint8_t ctc_bit;
+    const uint16_t *prescalers;
+    volatile uint8_t *counter8;
+    volatile uint16_t *counter16;
+    volatile uint8_t *compare8;
+    volatile uint16_t *compare16;
+    volatile uint8_t *mask;
+    volatile uint8_t *flags;
+    uint8_t compare_bit;
+    hal_vector_t vector;
+} timer_config_t;
+
+typedef enum {
+    TIMER_0,
+    TIMER_1,
+    TIMER_2,
+    TIMER_3,
+    TIMER_COUNT
+} timer_index_t;
+
+static const timer_config_t timer_configs[TIMER_COUNT] = {
+    [TIMER_0] = {&TCCR0, WGM01, timer0_prescalers, &TCNT0, NULL, &OCR0, NULL, &TIMSK, &TIFR, OCF0, TIMER0_COMP_vect},
+    [TIMER_1] = {&TCCR1B, WGM12, timer_prescalers, NULL, &TCNT1, NULL, &OCR1A, &TIMSK, &TIFR, OCF1A, TIMER1_COMPA_vect},
+    [TIMER_2] = {&TCCR2, WGM21, timer_prescalers, &TCNT2, NULL, &OCR2, NULL, &TIMSK, &TIFR, OCF2, TIMER2_COMP_vect},
+    [TIMER_3] = {&TCCR3B, WGM32, timer_prescalers, NULL, &TCNT3, NULL, &OCR3A, &ETIMSK, &ETIFR, OCF3A, TIMER3_COMPA_vect},
+};
+
+typedef struct {
+    uint64_t last_cycles;
+    uint32_t pending;
+    bool was_enabled;
+} timer_state_t;
+
+static struct {
+    uint64_t start_ns;
+    uint64_t skipped_cycles;
+    uint64_t exit_cycles;
+    bool virtual_time;
+    timer_state_t timers[TIMER_COUNT];
+    bool polling;
+    volatile sig_atomic_t exit_requested;
+} hal;
+
+static uint64_t get_monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SECOND + now.tv_nsec;
+}
+
+uint64_t hal_get_cycles() {
+    if (hal.virtual_time) {
+        return hal.skipped_cycles;
+    }
+    return (get_monotonic_ns() - hal.start_ns) * CYCLES_PER_US / 1000 + hal.skipped_cycles;
+}
+
+void hal_set_virtual_time(bool enabled) {
+    hal.skipped_cycles = hal_get_cycles();
+    hal.virtual_time = enabled;
+    hal.start_ns = get_monotonic_ns();
+}
+
+// Long delays are skipped in steps, so the peripherals see the time pass and
+// a USART receives as many characters as it would meanwhile
+void hal_delay_cycles(uint64_t cycles) {
+    hal_lcd_update(cycles);
+
+    while (cycles > DELAY_STEP_CYCLES) {
+        hal.skipped_cycles += DELAY_STEP_CYCLES;
+        cycles -= DELAY_STEP_CYCLES;
+        hal_poll();
+    }
+    hal.skipped_cycles += cycles;
+    hal_poll();
+}
+
+bool hal_interrupts_enabled() {
+    return SREG & _BV(SREG_I);
+}
+
+void hal_cli() {
+    SREG &= ~_BV(SREG_I);
+}
+
+void hal_sei() {
+    SREG |= _BV(SREG_I);
+    hal_poll();
+}
+
+void hal_run_vector(hal_vector_t vector) {
+    uint8_t sreg = SREG;
+    SREG &= ~_BV(SREG_I);
+    vector();
+    SREG = sreg | _BV(SREG_I);
+}
+
+static uint32_t read_timer_value(volatile uint8_t *value8, volatile uint16_t *value16) {
+    return value8 != NULL ? *value8 : *value16;
+}
+
+static void write_timer_value(volatile uint8_t *value8, volatile uint16_t *value16, uint32_t value) {
+    if (value8 != NULL) {
+        *value8 = value;
+    } else {
+        *value16 = value;
+    }
+}
+
+// Counts the compare matches since the last update. Matches which happened
+// while the interrupt was masked are dropped once it gets enabled, because
+// the firmware always clears the flag right before and a write of one to a
+// flag register can't be told from a read here.
+static void update_timer(timer_index_t index, uint64_t now) {
+    const timer_config_t *config = &timer_configs[index];
+    timer_state_t *state = &hal.timers[index];
+
+    bool enabled = *config->mask & _BV(config->compare_bit);
+    if (enabled && !state->was_enabled) {
+        state->pending = 0;
+    }
+    state->was_enabled = enabled;
+
+    uint16_t prescaler = config->prescalers[*config->control & CLOCK_SELECT_MASK];
+    if (prescaler == 0) {
+        state->last_cycles = now;
+        return;
+    }
+
+    uint64_t ticks = (now - state->last_cycles) / prescaler;
+    state->last_cycles += ticks * prescaler;
+
+    if (ticks != 0) {
+        uint64_t max = config->counter8 != NULL ? UINT8_MAX : UINT16_MAX;
+        uint64_t counter = read_timer_value(config->counter8, config->counter16);
+        uint64_t compare = read_timer_value(config->compare8, config->compare16);
+        bool ctc = *config->control & _BV(config->ctc_bit);
+
+        uint64_t period = ctc ? compare + 1 : max + 1;
+        uint64_t to_match = counter <= compare ? compare - counter : max + 1 - counter + compare;
+        // A counter sitting on the compare value has already matched
+        if (to_match == 0) {
+            to_match = period;
+        }
+
+        uint64_t matches = ticks >= to_match ? 1 + (ticks - to_match) / period : 0;
+        if (matches == 0 || !ctc) {
+            counter = (counter + ticks) % (max + 1);
+        } else {
+            counter = (compare + (ticks - to_match) % period) % period;
+        }
+        write_timer_value(config->counter8, config->counter16, counter);
+
+        state->pending = matches + state->pending > UINT16_MAX ? UINT16_MAX : state->pending + matches;
+    }
+
+    // A masked interrupt only leaves its flag behind
+    if (!enabled && state->pending > 1) {
+        state->pending = 1;
+    }
+
+    if (state->pending != 0) {
+        *config->flags |= _BV(config->compare_bit);
+    } else {
+        *config->flags &= ~_BV(config->compare_bit);
+    }
+}
+
+static bool service_timer(timer_index_t index) {
+    const timer_config_t *config = &timer_configs[index];
+    timer_state_t *state = &hal.timers[index];
+
+    if (state->pending == 0 || !(*config->mask & _BV(config->compare_bit))) {
+        return false;
+    }
+
+    state->pending--;
+    if (state->pending == 0) {
+        *config->flags &= ~_BV(config->compare_bit);
+    }
+
+    if (config->vector != NULL) {
+        hal_run_vector(config->vector);
+    }
+    return true;
+}
+
+// Runs one pending interrupt, in the order of the ATmega128 vector table
+static bool service_next_vector() {
+    return service_timer(TIMER_2)
+        || service_timer(TIMER_1)
+        || service_timer(TIMER_0)
+        || hal_usart_service_rx(0)
+        || hal_usart_service_udre(0)
+        || service_timer(TIMER_3)
+        || hal_usart_service_rx(1)
+        || hal_usart_service_udre(1);
+}
+
+void hal_poll() {
+    // Vectors may poll too, they only ever see their own state
+    if (hal.polling) {
+        return;
+    }
+    hal.polling = true;
+
+    uint64_t now = hal_get_cycles();
+    for (uint8_t i = 0; i < TIMER_COUNT; i++) {
+        update_timer(i, now);
+    }
+    hal_usart_update(now);
+    hal_buttons_update(now);
+
+    for (uint16_t i = 0; i < MAX_VECTORS_PER_POLL && hal_interrupts_enabled(); i++) {
+        if (!service_next_vector()) {
+            break;
+        }
+    }
+
+    hal.polling = false;
+
+    // Leaving through exit() lets gprof write its profile
+    if (hal.exit_requested || (hal.exit_cycles != 0 && now >= hal.exit_cycles)) {
+        exit(EXIT_SUCCESS);
+    }
+}
+
+bool hal_loop_until_bit_is_set(volatile uint8_t *sfr, uint8_t bit) {
+    if (sfr == &SPSR && bit == SPIF) {
+        hal_spi_transfer();
+    }
+
+    while (!(*sfr & _BV(bit))) {
+        hal_poll();
+    }
+    return true;
+}
+
+bool hal_loop_until_bit_is_clear(volatile uint8_t *sfr, uint8_t bit) {
+    while (*sfr & _BV(bit)) {
+        hal_poll();
+    }
+    return true;
+}
+
+static void request_exit(int signal) {
+    (void)signal;
+    hal.exit_requested = true;
+}
+
+// Runs before the firmware's main
+__attribute__((constructor)) static void hal_init() {
+    hal.start_ns = get_monotonic_ns();
+
+    const char *exit_after = getenv("HAL_EXIT_AFTER_MS");
+    if (exit_after != NULL) {
+        hal.exit_cycles = strtoull(exit_after, NULL, 10) * CYCLES_PER_MS;
+    }
+
+    signal(SIGINT, &request_exit);
+    signal(SIGTERM, &request_exit);
+
+    // Nothing drives the pins low unless a stand-in does
+    PINA = PINB = PINC = PIND = PINE = PINF = PING = 0xFF;
+    UCSR0A = UCSR1A = _BV(UDRE);
+
+    hal_eeprom_init();
+    hal_usart_init();
+    hal_buttons_init();
+    hal_sd_card_init();
+    hal_lcd_init();
+}
@@ -0,0 +1,81 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include "hal_internal.h"
+
+#define EEPROM_SIZE (E2END + 1)
+#define ERASED_BYTE 0xFF
+
+static struct {
+    uint8_t data[EEPROM_SIZE];
+    // Without a file, the EEPROM starts erased on every run
+    const char *path;
+} eeprom;
+
+static void save() {
+    if (eeprom.path == NULL) {
+        return;
+    }
+
+    FILE *file = fopen(eeprom.path, "wb");
+    if (file != NULL) {
+        fwrite(eeprom.data, 1, EEPROM_SIZE, file);
+        fclose(file);
+    }
+}
+
+void hal_eeprom_init() {
+    memset(eeprom.data, ERASED_BYTE, EEPROM_SIZE);
+
+    eeprom.path = getenv("HAL_EEPROM");
+    if (eeprom.path == NULL) {
+        return;
+    }
+
+    FILE *file = fopen(eeprom.path, "rb");
+    if (file != NULL) {
+        fread(eeprom.data, 1, EEPROM_SIZE, file);
+        fclose(file);
+    }
+}
+
+// Addresses are offsets into the EEPROM, as on the AVR
+static inline size_t get_offset(const void *address) {
+    return (uintptr_t)address % EEPROM_SIZE;
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address) {
+    return eeprom.data[get_offset(address)];
+}
+
+void eeprom_write_byte(uint8_t *address, uint8_t value) {
+    eeprom.data[get_offset(address)] = value;
+    save();
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value) {
+    if (eeprom_read_byte(address) != value) {
+        eeprom_write_byte(address, value);
+    }
+}
+
+void eeprom_read_block(void *destination, const void *source, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        ((uint8_t *)destination)[i] = eeprom.data[get_offset((const uint8_t *)source + i)];
+    }
+}
+
+void eeprom_write_block(const void *source, void *destination, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        eeprom.data[get_offset((uint8_t *)destination + i)] = ((const uint8_t *)source)[i];
+    }
+    save();
+}
+
+void eeprom_update_block(const void *source, void *destination, size_t size) {
+    eeprom_write_block(source, destination, size);
+}
@@ -0,0 +1,36 @@
+#ifndef HAL_INTERNAL_H
+#define HAL_INTERNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Shared between the parts of the HAL, not meant for the firmware
+
+typedef void (*hal_vector_t)(void);
+
+bool hal_interrupts_enabled(void);
+// Runs the vector with interrupts disabled, like the CPU does
+void hal_run_vector(hal_vector_t vector);
+
+void hal_usart_init(void);
+void hal_usart_update(uint64_t now);
+// Each runs the interrupt of the USART if it is pending and returns whether
+// it did
+bool hal_usart_service_rx(uint8_t port);
+bool hal_usart_service_udre(uint8_t port);
+
+void hal_spi_transfer(void);
+void hal_sd_card_init(void);
+
+void hal_buttons_init(void);
+void hal_buttons_update(uint64_t now);
+
+void hal_eeprom_init(void);
+
+void hal_lcd_init(void);
+// Samples the LCD lines, called at every delay
+void hal_lcd_update(uint64_t delay_cycles);
+// Appends the bus activity since the last entry and the screen to the log
+void hal_lcd_log(const char *event);
+
+#endif // HAL_INTERNAL_H
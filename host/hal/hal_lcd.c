@@ -0,0 +1,324 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include "hal.h"
+#include "hal_lcd.h"
+#include "hal_internal.h"
+
+#define CYCLES_PER_US (F_CPU / 1000000UL)
+
+#define RS_BIT PG4
+#define EN_BIT PD7
+#define DATA_MASK 0x0F
+
+#define DDRAM_SIZE (HAL_LCD_ROWS * HAL_LCD_ROW_SIZE)
+#define SECOND_ROW_ADDRESS 0x40
+#define ADDRESS_MASK 0x7F
+#define CGRAM_ADDRESS_MASK 0x3F
+
+#define COMMAND_CLEAR_DISPLAY 0x01
+#define COMMAND_RETURN_HOME 0x02
+#define COMMAND_ENTRY_MODE_SET 0x04
+#define COMMAND_DISPLAY_CONTROL 0x08
+#define COMMAND_CURSOR_DISPLAY_SHIFT 0x10
+#define COMMAND_FUNCTION_SET 0x20
+#define COMMAND_SET_CGRAM_ADDRESS 0x40
+#define COMMAND_SET_DDRAM_ADDRESS 0x80
+
+#define ENTRY_SHIFT_BIT 0
+#define ENTRY_INCREMENT_BIT 1
+#define DISPLAY_BLINK_BIT 0
+#define DISPLAY_CURSOR_BIT 1
+#define DISPLAY_ON_BIT 2
+#define SHIFT_RIGHT_BIT 2
+#define SHIFT_DISPLAY_BIT 3
+#define FUNCTION_TWO_LINES_BIT 3
+#define FUNCTION_EIGHT_BIT_BIT 4
+
+// Execution times with the typical 270 kHz oscillator
+#define SHORT_EXECUTION_US 37
+#define LONG_EXECUTION_US 1520
+
+#define BLANK ' '
+
+static struct {
+    uint8_t ddram[DDRAM_SIZE];
+    uint8_t cgram[HAL_LCD_CGRAM_SIZE];
+    uint8_t address;
+    bool cgram_selected;
+    bool increment;
+    bool entry_shift;
+    bool display_on;
+    bool cursor_shown;
+    bool blink;
+    bool two_lines;
+    bool eight_bit;
+    // Columns the display is shifted to the left
+    uint8_t display_shift;
+
+    // EN was high at the last sample, with these on the other lines
+    bool enable_high;
+    uint8_t sampled_nibble;
+    bool sampled_rs;
+    // The upper nibble of a transfer in 4-bit mode
+    bool high_nibble_received;
+    uint8_t high_nibble;
+    uint64_t ready_cycles;
+
+    hal_lcd_stats_t stats;
+    FILE *log;
+    hal_lcd_stats_t logged_stats;
+} lcd;
+
+// 2-line mode has 40 characters per row at 0x00 and 0x40, 1-line mode 80
+// characters from 0x00, which run through both halves of the DDRAM
+static uint8_t ddram_index(uint8_t address) {
+    if (!lcd.two_lines) {
+        return address % DDRAM_SIZE;
+    }
+
+    uint8_t row = (address & SECOND_ROW_ADDRESS) ? 1 : 0;
+    uint8_t column = (address & ~SECOND_ROW_ADDRESS) % HAL_LCD_ROW_SIZE;
+    return row * HAL_LCD_ROW_SIZE + column;
+}
+
+static uint8_t ddram_address(uint8_t index) {
+    if (!lcd.two_lines) {
+        return index;
+    }
+    return index >= HAL_LCD_ROW_SIZE ? SECOND_ROW_ADDRESS + index - HAL_LCD_ROW_SIZE : index;
+}
+
+static void move_address(bool increment) {
+    if (lcd.cgram_selected) {
+        lcd.address = (lcd.address + (increment ? 1 : -1)) & CGRAM_ADDRESS_MASK;
+        return;
+    }
+
+    // The end of the first row continues on the second and the other way round
+    uint8_t index = ddram_index(lcd.address);
+    index = increment ? (index + 1) % DDRAM_SIZE : (index + DDRAM_SIZE - 1) % DDRAM_SIZE;
+    lcd.address = ddram_address(index);
+}
+
+static void shift_display(bool right) {
+    uint8_t width = lcd.two_lines ? HAL_LCD_ROW_SIZE : DDRAM_SIZE;
+    lcd.display_shift = right ? (lcd.display_shift + width - 1) % width : (lcd.display_shift + 1) % width;
+}
+
+static void execute_command(uint8_t command) {
+    lcd.stats.commands++;
+
+    if (command & COMMAND_SET_DDRAM_ADDRESS) {
+        lcd.address = command & ADDRESS_MASK;
+        lcd.cgram_selected = false;
+    } else if (command & COMMAND_SET_CGRAM_ADDRESS) {
+        lcd.address = command & CGRAM_ADDRESS_MASK;
+        lcd.cgram_selected = true;
+    } else if (command & COMMAND_FUNCTION_SET) {
+        lcd.eight_bit = command & _BV(FUNCTION_EIGHT_BIT_BIT);
+        lcd.two_lines = command & _BV(FUNCTION_TWO_LINES_BIT);
+        lcd.high_nibble_received = false;
+    } else if (command & COMMAND_CURSOR_DISPLAY_SHIFT) {
+        bool right = command & _BV(SHIFT_RIGHT_BIT);
+        if (command & _BV(SHIFT_DISPLAY_BIT)) {
+            shift_display(right);
+        } else {
+            move_address(right);
+        }
+    } else if (command & COMMAND_DISPLAY_CONTROL) {
+        lcd.display_on = command & _BV(DISPLAY_ON_BIT);
+        lcd.cursor_shown = command & _BV(DISPLAY_CURSOR_BIT);
+        lcd.blink = command & _BV(DISPLAY_BLINK_BIT);
+    } else if (command & COMMAND_ENTRY_MODE_SET) {
+        lcd.increment = command & _BV(ENTRY_INCREMENT_BIT);
+        lcd.entry_shift = command & _BV(ENTRY_SHIFT_BIT);
+    } else if (command & COMMAND_RETURN_HOME) {
+        lcd.address = 0;
+        lcd.cgram_selected = false;
+        lcd.display_shift = 0;
+    } else if (command & COMMAND_CLEAR_DISPLAY) {
+        memset(lcd.ddram, BLANK, sizeof(lcd.ddram));
+        lcd.address = 0;
+        lcd.cgram_selected = false;
+        lcd.display_shift = 0;
+        lcd.increment = true;
+    }
+}
+
+static void write_data(uint8_t data) {
+    lcd.stats.data_writes++;
+
+    if (lcd.cgram_selected) {
+        lcd.cgram[lcd.address] = data;
+    } else {
+        lcd.ddram[ddram_index(lcd.address)] = data;
+        if (lcd.entry_shift) {
+            shift_display(!lcd.increment);
+        }
+    }
+    move_address(lcd.increment);
+}
+
+static void transfer(uint8_t byte, bool rs, uint64_t now) {
+    if (now < lcd.ready_cycles) {
+        lcd.stats.busy_writes++;
+    }
+
+    bool long_command = !rs && (byte == COMMAND_CLEAR_DISPLAY || (byte & ~COMMAND_CLEAR_DISPLAY) == COMMAND_RETURN_HOME);
+    if (long_command) {
+        lcd.stats.long_commands++;
+    }
+    lcd.ready_cycles = now + (uint64_t)(long_command ? LONG_EXECUTION_US : SHORT_EXECUTION_US) * CYCLES_PER_US;
+
+    if (rs) {
+        write_data(byte);
+    } else {
+        execute_command(byte);
+    }
+}
+
+// Only D4-D7 are wired, in 8-bit mode D0-D3 read as low
+static void latch_nibble(uint8_t nibble, bool rs, uint64_t now) {
+    lcd.stats.nibbles++;
+
+    if (lcd.eight_bit) {
+        transfer(nibble << 4, rs, now);
+    } else if (!lcd.high_nibble_received) {
+        lcd.high_nibble = nibble;
+        lcd.high_nibble_received = true;
+    } else {
+        lcd.high_nibble_received = false;
+        transfer((lcd.high_nibble << 4) | nibble, rs, now);
+    }
+}
+
+void hal_lcd_update(uint64_t delay_cycles) {
+    lcd.stats.delay_cycles += delay_cycles;
+
+    bool enable = (DDRD & _BV(EN_BIT)) && (PORTD & _BV(EN_BIT));
+    if (enable) {
+        // The lines are taken at the falling edge, so the last sample counts
+        lcd.sampled_nibble = PORTG & DATA_MASK;
+        lcd.sampled_rs = PORTG & _BV(RS_BIT);
+    } else if (lcd.enable_high) {
+        latch_nibble(lcd.sampled_nibble, lcd.sampled_rs, hal_get_cycles());
+    }
+    lcd.enable_high = enable;
+}
+
+void hal_lcd_get_row(uint8_t row, char *text) {
+    for (uint8_t column = 0; column < HAL_LCD_COLUMNS; column++) {
+        uint8_t index;
+        if (lcd.two_lines) {
+            index = row * HAL_LCD_ROW_SIZE + (lcd.display_shift + column) % HAL_LCD_ROW_SIZE;
+        } else {
+            index = (lcd.display_shift + column) % DDRAM_SIZE;
+        }
+
+        // 1-line mode only drives the first row
+        bool shown = lcd.display_on && (lcd.two_lines || row == 0);
+        text[column] = shown ? lcd.ddram[index] : BLANK;
+    }
+    text[HAL_LCD_COLUMNS] = '\0';
+}
+
+bool hal_lcd_row_equals(uint8_t row, const char *text) {
+    char shown[HAL_LCD_COLUMNS + 1];
+    hal_lcd_get_row(row, shown);
+
+    size_t length = strlen(text);
+    if (length > HAL_LCD_COLUMNS || memcmp(shown, text, length) != 0) {
+        return false;
+    }
+
+    for (size_t i = length; i < HAL_LCD_COLUMNS; i++) {
+        if (shown[i] != BLANK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool hal_lcd_is_display_on() {
+    return lcd.display_on;
+}
+
+void hal_lcd_get_cursor(uint8_t *column, uint8_t *row) {
+    uint8_t index = ddram_index(lcd.address);
+    uint8_t row_size = lcd.two_lines ? HAL_LCD_ROW_SIZE : DDRAM_SIZE;
+
+    *column = index % row_size;
+    *row = index / row_size;
+}
+
+bool hal_lcd_is_cursor_shown() {
+    return lcd.cursor_shown || lcd.blink;
+}
+
+const uint8_t *hal_lcd_get_cgram() {
+    return lcd.cgram;
+}
+
+const hal_lcd_stats_t *hal_lcd_get_stats() {
+    return &lcd.stats;
+}
+
+void hal_lcd_reset_stats() {
+    memset(&lcd.stats, 0, sizeof(lcd.stats));
+    lcd.logged_stats = lcd.stats;
+}
+
+void hal_lcd_log(const char *event) {
+    if (lcd.log == NULL) {
+        return;
+    }
+
+    const hal_lcd_stats_t *now = &lcd.stats;
+    const hal_lcd_stats_t *then = &lcd.logged_stats;
+
+    fprintf(lcd.log, "%10.3f ms %-8s cmd %5u data %5u long %3u busy %3u delay %9.1f us",
+        (double)hal_get_cycles() / (CYCLES_PER_US * 1000), event,
+        now->commands - then->commands, now->data_writes - then->data_writes,
+        now->long_commands - then->long_commands, now->busy_writes - then->busy_writes,
+        (double)(now->delay_cycles - then->delay_cycles) / CYCLES_PER_US);
+
+    for (uint8_t row = 0; row < HAL_LCD_ROWS; row++) {
+        char text[HAL_LCD_COLUMNS + 1];
+        hal_lcd_get_row(row, text);
+
+        // CGRAM characters and the like
+        for (uint8_t i = 0; i < HAL_LCD_COLUMNS; i++) {
+            if (text[i] < ' ' || text[i] > '~') {
+                text[i] = '?';
+            }
+        }
+        fprintf(lcd.log, " |%s", text);
+    }
+    fprintf(lcd.log, "|\n");
+    fflush(lcd.log);
+
+    lcd.logged_stats = lcd.stats;
+}
+
+static void log_exit() {
+    hal_lcd_log("exit");
+}
+
+void hal_lcd_init() {
+    // Power up leaves the DDRAM blank and the display off
+    memset(lcd.ddram, BLANK, sizeof(lcd.ddram));
+    lcd.eight_bit = true;
+    lcd.increment = true;
+
+    const char *log_path = getenv("HAL_LCD_LOG");
+    if (log_path != NULL) {
+        lcd.log = fopen(log_path, "a");
+        if (lcd.log != NULL) {
+            atexit(&log_exit);
+        }
+    }
+}
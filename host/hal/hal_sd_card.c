@@ -0,0 +1,453 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "hal.h"
+#include "hal_sd_card.h"
+#include "hal_internal.h"
+
+#define SECTOR_SIZE 512
+#define COMMAND_SIZE 6
+#define MAX_RESPONSE_DELAY_BYTES 8
+// Delay bytes, R1 and up to four bytes of R3 or R7
+#define MAX_RESPONSE_SIZE (MAX_RESPONSE_DELAY_BYTES + 5)
+
+#define COMMAND_START_MASK 0xC0
+#define COMMAND_START 0x40
+#define COMMAND_INDEX_MASK 0x3F
+#define IDLE_BYTE 0xFF
+
+#define CMD0 0
+#define CMD8 8
+#define CMD12 12
+#define CMD16 16
+#define CMD17 17
+#define CMD18 18
+#define CMD55 55
+#define CMD58 58
+#define ACMD41 41
+
+#define R1_IDLE 0x01
+#define R1_ILLEGAL_COMMAND 0x04
+#define R1_COMMAND_CRC 0x08
+#define R1_ADDRESS_ERROR 0x20
+#define R1_PARAMETER 0x40
+
+#define DATA_START_TOKEN 0xFE
+#define DATA_CRC_SIZE 2
+
+#define OCR_POWER_UP_DONE (1UL << 31)
+#define OCR_CCS (1UL << 30)
+#define OCR_VOLTAGE_WINDOW 0x00FF8000UL
+#define ACMD41_HCS (1UL << 30)
+
+#define DEFAULT_INIT_MS 50
+#define DEFAULT_RESPONSE_DELAY_BYTES 1
+#define DEFAULT_READ_LATENCY_US 250
+
+typedef enum {
+    PHASE_COMMAND,
+    PHASE_RESPONSE,
+    PHASE_READ_LATENCY,
+    PHASE_READ_DATA
+} phase_t;
+
+static struct {
+    int fd;
+    uint32_t sector_count;
+    hal_sd_card_config_t config;
+    hal_sd_card_stats_t stats;
+    // One bit per sector, for the repeated reads
+    uint8_t *read_sectors;
+
+    bool idle;
+    bool app_command;
+    bool init_started;
+    uint64_t init_done_cycles;
+
+    phase_t phase;
+    uint8_t command[COMMAND_SIZE];
+    uint8_t command_received;
+
+    uint8_t response[MAX_RESPONSE_SIZE];
+    uint8_t response_length;
+    uint8_t response_sent;
+
+    // The data of a read follows its response
+    bool read_pending;
+    bool multiple_blocks;
+    uint32_t next_sector;
+    uint64_t data_ready_cycles;
+    // Token, sector and CRC
+    uint8_t data[1 + SECTOR_SIZE + DATA_CRC_SIZE];
+    uint16_t data_sent;
+} card = {.fd = -1};
+
+// CRC7 over the command, only checked for CMD0 and CMD8 as SPI mode does
+static uint8_t crc7(const uint8_t *data, uint8_t length) {
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < length; i++) {
+        uint8_t byte = data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc <<= 1;
+            if ((byte ^ crc) & 0x80) {
+                crc ^= 0x09;
+            }
+            byte <<= 1;
+        }
+    }
+
+    return crc & 0x7F;
+}
+
+static uint16_t crc16(const uint8_t *data, uint16_t length) {
+    uint16_t crc = 0;
+
+    for (uint16_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+static uint64_t us_to_cycles(uint32_t us) {
+    return (uint64_t)us * (F_CPU / 1000000UL);
+}
+
+static void start_response(uint8_t r1) {
+    card.response_length = 0;
+    card.response_sent = 0;
+
+    for (uint8_t i = 0; i < card.config.response_delay_bytes; i++) {
+        card.response[card.response_length++] = IDLE_BYTE;
+    }
+    card.response[card.response_length++] = card.idle ? r1 | R1_IDLE : r1;
+
+    card.phase = PHASE_RESPONSE;
+}
+
+static void add_response_word(uint32_t word) {
+    for (int8_t shift = 24; shift >= 0; shift -= 8) {
+        card.response[card.response_length++] = word >> shift;
+    }
+}
+
+static bool start_sector_read(uint32_t sector) {
+    if (sector >= card.sector_count) {
+        return false;
+    }
+
+    card.next_sector = sector;
+    card.data_ready_cycles = hal_get_cycles() + us_to_cycles(card.config.read_latency_us);
+    return true;
+}
+
+static void load_sector() {
+    uint32_t sector = card.next_sector++;
+    uint8_t *sector_data = &card.data[1];
+
+    card.data[0] = DATA_START_TOKEN;
+    if (pread(card.fd, sector_data, SECTOR_SIZE, (off_t)sector * SECTOR_SIZE) != SECTOR_SIZE) {
+        memset(sector_data, 0, SECTOR_SIZE);
+    }
+
+    uint16_t crc = crc16(sector_data, SECTOR_SIZE);
+    card.data[1 + SECTOR_SIZE] = crc >> 8;
+    card.data[2 + SECTOR_SIZE] = crc;
+    card.data_sent = 0;
+
+    card.stats.sectors_read++;
+    uint8_t sector_bit = 1 << (sector % 8);
+    if (card.read_sectors[sector / 8] & sector_bit) {
+        card.stats.repeated_sector_reads++;
+    }
+    card.read_sectors[sector / 8] |= sector_bit;
+}
+
+// Addresses count in sectors on high capacity cards and in bytes otherwise
+static bool get_sector(uint32_t argument, uint32_t *sector) {
+    if (card.config.type == HAL_SD_CARD_V2_HC) {
+        *sector = argument;
+        return true;
+    }
+
+    *sector = argument / SECTOR_SIZE;
+    return argument % SECTOR_SIZE == 0;
+}
+
+static void handle_read(uint32_t argument, bool multiple_blocks) {
+    uint32_t sector;
+
+    if (card.idle) {
+        start_response(R1_ILLEGAL_COMMAND);
+    } else if (!get_sector(argument, &sector)) {
+        start_response(R1_ADDRESS_ERROR);
+    } else if (!start_sector_read(sector)) {
+        start_response(R1_PARAMETER);
+    } else {
+        card.multiple_blocks = multiple_blocks;
+        card.read_pending = true;
+        start_response(0);
+    }
+}
+
+static void handle_app_command(uint8_t index, uint32_t argument) {
+    card.stats.app_commands[index]++;
+
+    if (index != ACMD41) {
+        start_response(R1_ILLEGAL_COMMAND);
+        return;
+    }
+
+    uint64_t now = hal_get_cycles();
+    if (!card.init_started) {
+        card.init_started = true;
+        card.init_done_cycles = now + us_to_cycles(card.config.init_ms * 1000UL);
+    }
+
+    // A high capacity card stays busy for hosts which don't support it
+    bool host_supports_card = card.config.type != HAL_SD_CARD_V2_HC || (argument & ACMD41_HCS);
+    if (now >= card.init_done_cycles && host_supports_card) {
+        card.idle = false;
+    }
+
+    start_response(0);
+}
+
+static void handle_command() {
+    uint8_t index = card.command[0] & COMMAND_INDEX_MASK;
+    uint32_t argument = ((uint32_t)card.command[1] << 24) | ((uint32_t)card.command[2] << 16) | ((uint32_t)card.command[3] << 8) | card.command[4];
+    bool crc_valid = (card.command[5] >> 1) == crc7(card.command, COMMAND_SIZE - 1);
+
+    bool app_command = card.app_command;
+    card.app_command = false;
+    if (app_command) {
+        handle_app_command(index, argument);
+        return;
+    }
+
+    card.stats.commands[index]++;
+
+    switch (index) {
+        case CMD0:
+            card.idle = true;
+            card.init_started = false;
+            start_response(crc_valid ? 0 : R1_COMMAND_CRC);
+            break;
+        case CMD8:
+            if (card.config.type == HAL_SD_CARD_V1) {
+                start_response(R1_ILLEGAL_COMMAND);
+            } else if (!crc_valid) {
+                start_response(R1_COMMAND_CRC);
+            } else {
+                // Echoes the voltage and the check pattern
+                start_response(0);
+                add_response_word(argument & 0xFFF);
+            }
+            break;
+        case CMD12:
+            start_response(0);
+            break;
+        case CMD16:
+            start_response(argument == SECTOR_SIZE ? 0 : R1_PARAMETER);
+            break;
+        case CMD17:
+            handle_read(argument, false);
+            break;
+        case CMD18:
+            handle_read(argument, true);
+            break;
+        case CMD55:
+            card.app_command = true;
+            start_response(0);
+            break;
+        case CMD58: {
+            uint32_t ocr = OCR_VOLTAGE_WINDOW;
+            if (!card.idle) {
+                ocr |= OCR_POWER_UP_DONE;
+                if (card.config.type == HAL_SD_CARD_V2_HC) {
+                    ocr |= OCR_CCS;
+                }
+            }
+
+            start_response(0);
+            add_response_word(ocr);
+            break;
+        }
+        default:
+            start_response(R1_ILLEGAL_COMMAND);
+            break;
+    }
+}
+
+// What the card drives onto MISO during this transfer
+static uint8_t next_output_byte() {
+    switch (card.phase) {
+        case PHASE_RESPONSE:
+            if (card.response_sent < card.response_length) {
+                return card.response[card.response_sent++];
+            }
+            if (card.read_pending) {
+                card.read_pending = false;
+                card.phase = PHASE_READ_LATENCY;
+                return next_output_byte();
+            }
+            card.phase = PHASE_COMMAND;
+            return IDLE_BYTE;
+        case PHASE_READ_LATENCY:
+            if (hal_get_cycles() < card.data_ready_cycles) {
+                card.stats.latency_bytes++;
+                return IDLE_BYTE;
+            }
+            load_sector();
+            card.phase = PHASE_READ_DATA;
+            return next_output_byte();
+        case PHASE_READ_DATA:
+            if (card.data_sent < sizeof(card.data)) {
+                return card.data[card.data_sent++];
+            }
+            if (card.multiple_blocks && start_sector_read(card.next_sector)) {
+                card.phase = PHASE_READ_LATENCY;
+                return next_output_byte();
+            }
+            card.phase = PHASE_COMMAND;
+            return IDLE_BYTE;
+        case PHASE_COMMAND:
+        default:
+            return IDLE_BYTE;
+    }
+}
+
+static void receive_byte(uint8_t byte) {
+    if (card.command_received == 0) {
+        // The host clocks out 0xFF while it reads, anything else starts a
+        // command, which also stops a multiple block read
+        if ((byte & COMMAND_START_MASK) != COMMAND_START) {
+            return;
+        }
+        card.phase = PHASE_COMMAND;
+        card.read_pending = false;
+        card.multiple_blocks = false;
+    }
+
+    card.command[card.command_received++] = byte;
+    if (card.command_received == COMMAND_SIZE) {
+        card.command_received = 0;
+        handle_command();
+    }
+}
+
+static uint8_t transfer(uint8_t byte, bool selected) {
+    card.stats.bus_bytes++;
+
+    if (!selected) {
+        card.command_received = 0;
+        return IDLE_BYTE;
+    }
+
+    uint8_t output = next_output_byte();
+    receive_byte(byte);
+    return output;
+}
+
+void hal_sd_card_get_default_config(hal_sd_card_config_t *config) {
+    config->type = HAL_SD_CARD_V2_HC;
+    config->init_ms = DEFAULT_INIT_MS;
+    config->response_delay_bytes = DEFAULT_RESPONSE_DELAY_BYTES;
+    config->read_latency_us = DEFAULT_READ_LATENCY_US;
+}
+
+bool hal_sd_card_insert(const char *image_path, const hal_sd_card_config_t *config) {
+    hal_sd_card_remove();
+
+    int fd = open(image_path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat image_stat;
+    if (fstat(fd, &image_stat) != 0 || image_stat.st_size == 0 || image_stat.st_size % SECTOR_SIZE != 0) {
+        close(fd);
+        return false;
+    }
+
+    card.fd = fd;
+    card.sector_count = image_stat.st_size / SECTOR_SIZE;
+    card.config = *config;
+    if (card.config.response_delay_bytes > MAX_RESPONSE_DELAY_BYTES) {
+        card.config.response_delay_bytes = MAX_RESPONSE_DELAY_BYTES;
+    }
+    card.read_sectors = calloc((card.sector_count + 7) / 8, 1);
+
+    card.idle = true;
+    card.app_command = false;
+    card.init_started = false;
+    card.phase = PHASE_COMMAND;
+    card.command_received = 0;
+    card.read_pending = false;
+    card.multiple_blocks = false;
+    hal_sd_card_reset_stats();
+
+    hal_spi_attach(&transfer);
+    return true;
+}
+
+void hal_sd_card_remove() {
+    if (card.fd < 0) {
+        return;
+    }
+
+    hal_spi_attach(NULL);
+    close(card.fd);
+    free(card.read_sectors);
+    card.fd = -1;
+    card.read_sectors = NULL;
+}
+
+const hal_sd_card_stats_t *hal_sd_card_get_stats() {
+    return &card.stats;
+}
+
+void hal_sd_card_reset_stats() {
+    memset(&card.stats, 0, sizeof(card.stats));
+    if (card.read_sectors != NULL) {
+        memset(card.read_sectors, 0, (card.sector_count + 7) / 8);
+    }
+}
+
+void hal_sd_card_init() {
+    const char *image_path = getenv("HAL_SD_IMAGE");
+    if (image_path == NULL) {
+        return;
+    }
+
+    hal_sd_card_config_t config;
+    hal_sd_card_get_default_config(&config);
+
+    const char *type = getenv("HAL_SD_TYPE");
+    if (type != NULL && strcmp(type, "v1") == 0) {
+        config.type = HAL_SD_CARD_V1;
+    } else if (type != NULL && strcmp(type, "sc") == 0) {
+        config.type = HAL_SD_CARD_V2_SC;
+    }
+
+    const char *value;
+    if ((value = getenv("HAL_SD_INIT_MS")) != NULL) {
+        config.init_ms = atoi(value);
+    }
+    if ((value = getenv("HAL_SD_NCR")) != NULL) {
+        config.response_delay_bytes = atoi(value);
+    }
+    if ((value = getenv("HAL_SD_LATENCY_US")) != NULL) {
+        config.read_latency_us = atoi(value);
+    }
+
+    hal_sd_card_insert(image_path, &config);
+}
@@ -0,0 +1,36 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <avr/io.h>
+#include "hal.h"
+#include "hal_internal.h"
+
+#define BITS_PER_TRANSFER 8
+#define CLOCK_RATE_MASK (_BV(SPR1) | _BV(SPR0))
+
+// Indexed by SPR1:SPR0, halved by SPI2X
+static const uint8_t clock_dividers[4] = {4, 16, 64, 128};
+
+static hal_spi_transfer_t device;
+
+void hal_spi_attach(hal_spi_transfer_t transfer) {
+    device = transfer;
+}
+
+// Writing SPDR can't be noticed, so the byte is clocked out once the
+// firmware starts waiting for SPIF
+void hal_spi_transfer() {
+    uint8_t divider = clock_dividers[SPCR & CLOCK_RATE_MASK];
+    if (SPSR & _BV(SPI2X)) {
+        divider /= 2;
+    }
+
+    uint8_t byte = SPDR;
+    bool selected = !(PORTB & _BV(PB0));
+
+    SPSR &= ~_BV(SPIF);
+    SPDR = device != NULL ? device(byte, selected) : 0xFF;
+
+    hal_delay_cycles((uint64_t)divider * BITS_PER_TRANSFER);
+    SPSR |= _BV(SPIF);
+}
@@ -0,0 +1,172 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include "hal.h"
+#include "hal_internal.h"
+
+#define USART_COUNT 2
+#define CLOCKS_PER_BIT 16
+#define CLOCKS_PER_BIT_DOUBLE_SPEED 8
+
+// Weak, so the firmware can leave out the USART driver
+#define HAL_VECTOR(name) void name(void) __attribute__((weak));
+HAL_VECTOR(USART0_RX_vect)
+HAL_VECTOR(USART0_UDRE_vect)
+HAL_VECTOR(USART1_RX_vect)
+HAL_VECTOR(USART1_UDRE_vect)
+#undef HAL_VECTOR
+
+typedef struct {
+    volatile uint8_t *ucsra;
+    volatile uint8_t *ucsrb;
+    volatile uint8_t *ucsrc;
+    volatile uint8_t *ubrrh;
+    volatile uint8_t *ubrrl;
+    volatile uint8_t *udr;
+    hal_vector_t rx_vector;
+    hal_vector_t udre_vector;
+    const char *environment_variable;
+} usart_config_t;
+
+static const usart_config_t usart_configs[USART_COUNT] = {
+    {&UCSR0A, &UCSR0B, &UCSR0C, &UBRR0H, &UBRR0L, &UDR0, USART0_RX_vect, USART0_UDRE_vect, "HAL_USART0"},
+    {&UCSR1A, &UCSR1B, &UCSR1C, &UBRR1H, &UBRR1L, &UDR1, USART1_RX_vect, USART1_UDRE_vect, "HAL_USART1"},
+};
+
+static struct {
+    int fd;
+    // Bytes move no faster than the configured baud rate allows
+    uint64_t next_rx_cycles;
+    uint64_t next_tx_cycles;
+} usarts[USART_COUNT];
+
+// Start bit, data bits, parity and stop bits of one character
+static uint8_t get_frame_bits(const usart_config_t *config) {
+    uint8_t character_size = ((*config->ucsrc >> UCSZ00) & 0x03) + 5;
+    if (*config->ucsrb & _BV(UCSZ02)) {
+        character_size = 9;
+    }
+
+    uint8_t parity_bits = (*config->ucsrc & _BV(UPM01)) ? 1 : 0;
+    uint8_t stop_bits = (*config->ucsrc & _BV(USBS0)) ? 2 : 1;
+
+    return 1 + character_size + parity_bits + stop_bits;
+}
+
+static uint64_t get_frame_cycles(const usart_config_t *config) {
+    uint16_t ubrr = ((uint16_t)(*config->ubrrh & 0x0F) << 8) | *config->ubrrl;
+    uint8_t clocks_per_bit = (*config->ucsra & _BV(U2X0)) ? CLOCKS_PER_BIT_DOUBLE_SPEED : CLOCKS_PER_BIT;
+
+    return (uint64_t)get_frame_bits(config) * clocks_per_bit * (ubrr + 1);
+}
+
+void hal_usart_attach(uint8_t port, int fd) {
+    usarts[port].fd = fd;
+}
+
+static void attach_from_environment(uint8_t port) {
+    const char *path = getenv(usart_configs[port].environment_variable);
+    if (path == NULL) {
+        return;
+    }
+
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        return;
+    }
+
+    // A pty has to pass every byte through unchanged
+    struct termios settings;
+    if (tcgetattr(fd, &settings) == 0) {
+        cfmakeraw(&settings);
+        tcsetattr(fd, TCSANOW, &settings);
+    }
+
+    hal_usart_attach(port, fd);
+}
+
+void hal_usart_init() {
+    for (uint8_t port = 0; port < USART_COUNT; port++) {
+        usarts[port].fd = -1;
+        attach_from_environment(port);
+    }
+}
+
+// A received character waits in UDR until the RX interrupt took it. Further
+// characters are left with the other end meanwhile instead of overrunning.
+static void receive(uint8_t port, uint64_t now) {
+    const usart_config_t *config = &usart_configs[port];
+
+    if (!(*config->ucsrb & _BV(RXEN0)) || (*config->ucsra & _BV(RXC0)) || now < usarts[port].next_rx_cycles) {
+        return;
+    }
+
+    // Also limits how often an idle line is asked for data
+    usarts[port].next_rx_cycles = now + get_frame_cycles(config);
+
+    uint8_t byte;
+    if (usarts[port].fd < 0 || read(usarts[port].fd, &byte, 1) != 1) {
+        return;
+    }
+
+    *config->udr = byte;
+    *config->ucsra = (*config->ucsra & ~(_BV(FE0) | _BV(DOR0) | _BV(UPE0))) | _BV(RXC0);
+}
+
+void hal_usart_update(uint64_t now) {
+    for (uint8_t port = 0; port < USART_COUNT; port++) {
+        receive(port, now);
+    }
+}
+
+bool hal_usart_service_rx(uint8_t port) {
+    const usart_config_t *config = &usart_configs[port];
+
+    if (!(*config->ucsra & _BV(RXC0)) || !(*config->ucsrb & _BV(RXCIE0))) {
+        return false;
+    }
+
+    if (config->rx_vector != NULL) {
+        hal_run_vector(config->rx_vector);
+    }
+
+    // Reading UDR clears the flag
+    *config->ucsra &= ~_BV(RXC0);
+    return true;
+}
+
+// The vector has to either fill UDR or disable itself, so it wrote a character
+// exactly when the interrupt is still enabled afterwards
+bool hal_usart_service_udre(uint8_t port) {
+    const usart_config_t *config = &usart_configs[port];
+
+    uint8_t enable_bits = _BV(TXEN0) | _BV(UDRIE0);
+    if ((*config->ucsrb & enable_bits) != enable_bits) {
+        return false;
+    }
+
+    uint64_t now = hal_get_cycles();
+    if (now < usarts[port].next_tx_cycles || config->udre_vector == NULL) {
+        return false;
+    }
+
+    hal_run_vector(config->udre_vector);
+    if (!(*config->ucsrb & _BV(UDRIE0))) {
+        return true;
+    }
+
+    usarts[port].next_tx_cycles = now + get_frame_cycles(config);
+
+    uint8_t byte = *config->udr;
+    if (usarts[port].fd >= 0) {
+        while (write(usarts[port].fd, &byte, 1) < 0 && errno == EAGAIN) {
+            // The other end keeps up with the baud rate or the board waits
+        }
+    }
+    return true;
+}
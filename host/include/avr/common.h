@@ -0,0 +1,11 @@
+#ifndef HAL_AVR_COMMON_H
+#define HAL_AVR_COMMON_H
+
+#include <stdint.h>
+
+extern volatile uint8_t SREG;
+extern volatile uint16_t SP;
+
+#define SREG_I 7
+
+#endif // HAL_AVR_COMMON_H
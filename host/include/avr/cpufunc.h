@@ -0,0 +1,7 @@
+#ifndef HAL_AVR_CPUFUNC_H
+#define HAL_AVR_CPUFUNC_H
+
+#define _NOP() ((void)0)
+#define _MemoryBarrier() __asm__ __volatile__("" ::: "memory")
+
+#endif // HAL_AVR_CPUFUNC_H
@@ -0,0 +1,17 @@
+#ifndef HAL_AVR_INTERRUPT_H
+#define HAL_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+#include "hal.h"
+
+// Vectors are plain functions which the HAL calls
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+
+#define sei() hal_sei()
+#define cli() hal_cli()
+
+#endif // HAL_AVR_INTERRUPT_H
@@ -0,0 +1,186 @@
+#ifndef HAL_AVR_IO_H
+#define HAL_AVR_IO_H
+
+#include <stdint.h>
+#include <avr/common.h>
+#include <avr/sfr_defs.h>
+
+#define HAL_REGISTER8(name) extern volatile uint8_t name;
+#define HAL_REGISTER16(name) extern volatile uint16_t name;
+#include "hal_registers.h"
+#undef HAL_REGISTER8
+#undef HAL_REGISTER16
+
+#define RAMSTART 0x100
+#define RAMEND 0x10FF
+#define XRAMEND 0xFFFF
+#define E2END 0x0FFF
+
+// Interrupt vectors, the HAL calls them by these names
+#define TIMER2_COMP_vect hal_vector_timer2_comp
+#define TIMER1_COMPA_vect hal_vector_timer1_compa
+#define TIMER0_COMP_vect hal_vector_timer0_comp
+#define USART0_RX_vect hal_vector_usart0_rx
+#define USART0_UDRE_vect hal_vector_usart0_udre
+#define TIMER3_COMPA_vect hal_vector_timer3_compa
+#define USART1_RX_vect hal_vector_usart1_rx
+#define USART1_UDRE_vect hal_vector_usart1_udre
+
+// Port pins
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PD7 7
+#define PG0 0
+#define PG1 1
+#define PG2 2
+#define PG3 3
+#define PG4 4
+
+// SPCR
+#define SPIE 7
+#define SPE 6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPR1 1
+#define SPR0 0
+
+// SPSR
+#define SPIF 7
+#define WCOL 6
+#define SPI2X 0
+
+// UCSRnA
+#define RXC 7
+#define TXC 6
+#define UDRE 5
+#define FE 4
+#define DOR 3
+#define UPE 2
+#define U2X 1
+#define MPCM 0
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define FE0 4
+#define DOR0 3
+#define UPE0 2
+#define U2X0 1
+#define MPCM0 0
+#define RXC1 7
+#define TXC1 6
+#define UDRE1 5
+#define FE1 4
+#define DOR1 3
+#define UPE1 2
+#define U2X1 1
+#define MPCM1 0
+
+// UCSRnB
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UCSZ02 2
+#define RXB80 1
+#define TXB80 0
+#define RXCIE1 7
+#define TXCIE1 6
+#define UDRIE1 5
+#define RXEN1 4
+#define TXEN1 3
+#define UCSZ12 2
+#define RXB81 1
+#define TXB81 0
+
+// UCSRnC
+#define UMSEL0 6
+#define UPM01 5
+#define UPM00 4
+#define USBS0 3
+#define UCSZ01 2
+#define UCSZ00 1
+#define UCPOL0 0
+#define UMSEL1 6
+#define UPM11 5
+#define UPM10 4
+#define USBS1 3
+#define UCSZ11 2
+#define UCSZ10 1
+#define UCPOL1 0
+
+// TIMSK and TIFR
+#define OCIE2 7
+#define TOIE2 6
+#define TICIE1 5
+#define OCIE1A 4
+#define OCIE1B 3
+#define TOIE1 2
+#define OCIE0 1
+#define TOIE0 0
+#define OCF2 7
+#define TOV2 6
+#define ICF1 5
+#define OCF1A 4
+#define OCF1B 3
+#define TOV1 2
+#define OCF0 1
+#define TOV0 0
+
+// ETIMSK and ETIFR
+#define OCIE3A 4
+#define OCF3A 4
+
+// TCCR0
+#define FOC0 7
+#define WGM00 6
+#define COM01 5
+#define COM00 4
+#define WGM01 3
+#define CS02 2
+#define CS01 1
+#define CS00 0
+
+// TCCR1B and TCCR3B
+#define ICNC1 7
+#define ICES1 6
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+#define WGM33 4
+#define WGM32 3
+#define CS32 2
+#define CS31 1
+#define CS30 0
+
+// TCCR2
+#define FOC2 7
+#define WGM20 6
+#define COM21 5
+#define COM20 4
+#define WGM21 3
+#define CS22 2
+#define CS21 1
+#define CS20 0
+
+// MCUCR, XMCRA and XMCRB
+#define SRE 7
+#define SRW10 6
+#define SRL2 6
+#define SRL1 5
+#define SRL0 4
+#define SRW01 3
+#define SRW00 2
+#define SRW11 1
+#define XMBK 7
+#define XMM2 2
+#define XMM1 1
+#define XMM0 0
+
+#endif // HAL_AVR_IO_H
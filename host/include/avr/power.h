@@ -0,0 +1,12 @@
+#ifndef HAL_AVR_POWER_H
+#define HAL_AVR_POWER_H
+
+// The ATmega128 has no power reduction register, neither does the host
+#define power_timer0_enable() ((void)0)
+#define power_timer0_disable() ((void)0)
+#define power_timer1_enable() ((void)0)
+#define power_timer1_disable() ((void)0)
+#define power_timer2_enable() ((void)0)
+#define power_timer2_disable() ((void)0)
+
+#endif // HAL_AVR_POWER_H
@@ -0,0 +1,15 @@
+#ifndef HAL_AVR_SFR_DEFS_H
+#define HAL_AVR_SFR_DEFS_H
+
+#include "hal.h"
+
+#define _BV(bit) (1 << (bit))
+
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+
+// The peripheral which sets the bit is emulated while waiting for it
+#define loop_until_bit_is_set(sfr, bit) hal_loop_until_bit_is_set(&(sfr), (bit))
+#define loop_until_bit_is_clear(sfr, bit) hal_loop_until_bit_is_clear(&(sfr), (bit))
+
+#endif // HAL_AVR_SFR_DEFS_H
@@ -0,0 +1,52 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Stand-in for the ATmega128 board when the firmware is built for the host.
+// The I/O registers are plain variables. The peripherals behind them are
+// emulated whenever the firmware would wait for hardware: at the end of
+// atomic blocks, in sei(), in the delay functions and while polling a status
+// bit. Pending interrupts are run from there too, so everything happens on
+// the firmware's own thread and profiles stay readable.
+//
+// Environment variables:
+//   HAL_USART0, HAL_USART1  device, pty or FIFO which the USART talks to
+//   HAL_SD_IMAGE            disk image of the SD card, see hal_sd_card.h
+//   HAL_EEPROM              file which keeps the EEPROM between runs
+//   HAL_LCD_LOG             file which gets the LCD traffic, see hal_lcd.h
+//   HAL_EXIT_AFTER_MS       exit once this much board time has passed
+//
+// Buttons are read from stdin, see hal_buttons.c for the keys.
+
+// Board time in CPU cycles. It is the wall time since start plus every delay
+// the firmware asked for, which is skipped instead of slept.
+uint64_t hal_get_cycles(void);
+void hal_delay_cycles(uint64_t cycles);
+// With virtual time the board clock only moves through delays and bus
+// transfers, which makes benchmark results independent of the host. The main
+// loop of the firmware waits for the clock and needs the wall time.
+void hal_set_virtual_time(bool enabled);
+
+// Emulates the peripherals up to the current time and runs pending interrupts
+void hal_poll(void);
+
+void hal_cli(void);
+void hal_sei(void);
+bool hal_loop_until_bit_is_set(volatile uint8_t *sfr, uint8_t bit);
+bool hal_loop_until_bit_is_clear(volatile uint8_t *sfr, uint8_t bit);
+
+// Called for every byte clocked out of the SPI. Selected is true while the
+// SS pin (PB0), which is wired to the SD card, is driven low.
+typedef uint8_t (*hal_spi_transfer_t)(uint8_t byte, bool selected);
+// Without a device MISO is pulled high and every byte reads as 0xFF
+void hal_spi_attach(hal_spi_transfer_t transfer);
+
+// The file descriptor has to be non-blocking. -1 disconnects the USART.
+void hal_usart_attach(uint8_t port, int fd);
+
+// Queues a press of the button on the given PORTC pin
+void hal_buttons_press(uint8_t pin);
+
+#endif // HAL_H
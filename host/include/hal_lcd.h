@@ -0,0 +1,53 @@
+#ifndef HAL_LCD_H
+#define HAL_LCD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// HD44780 character LCD wired like on the board: RS on PG4, EN on PD7 and
+// D4-D7 on PG0-PG3, with R/W grounded. The lines are sampled whenever the
+// firmware delays, which clcd.c does while EN is high and after every
+// transfer, and a nibble is taken on the falling edge of EN. The controller
+// starts in 8-bit mode like after power up, so the initialization sequence
+// has to be right for the screen to come out right.
+//
+// With HAL_LCD_LOG set to a file, a line is appended to it at every button
+// press and at exit, with the bus activity since the previous line and the
+// screen contents at that point.
+
+#define HAL_LCD_ROWS 2
+#define HAL_LCD_COLUMNS 16
+// DDRAM per row in 2-line mode
+#define HAL_LCD_ROW_SIZE 40
+#define HAL_LCD_CGRAM_SIZE 64
+
+typedef struct {
+    uint32_t nibbles;
+    uint32_t commands;
+    uint32_t data_writes;
+    // Clear display and return home, which take 1.52 ms each
+    uint32_t long_commands;
+    // Transfers which came while the controller was still executing the
+    // previous one, a real one would have missed them
+    uint32_t busy_writes;
+    // Every delay the firmware asked for, which clcd.c is the only user of
+    uint64_t delay_cycles;
+} hal_lcd_stats_t;
+
+// Visible characters of the row, with the display shift applied. Character
+// codes are kept as they are, 0-7 are the CGRAM characters. The text is zero
+// terminated, so text has to hold HAL_LCD_COLUMNS + 1 bytes.
+void hal_lcd_get_row(uint8_t row, char *text);
+// Compares the start of the visible row, the rest of it has to be blank
+bool hal_lcd_row_equals(uint8_t row, const char *text);
+
+bool hal_lcd_is_display_on(void);
+// Column and row of the cursor in DDRAM, whether it is shown or not
+void hal_lcd_get_cursor(uint8_t *column, uint8_t *row);
+bool hal_lcd_is_cursor_shown(void);
+const uint8_t *hal_lcd_get_cgram(void);
+
+const hal_lcd_stats_t *hal_lcd_get_stats(void);
+void hal_lcd_reset_stats(void);
+
+#endif // HAL_LCD_H
@@ -0,0 +1,80 @@
+// I/O registers of the ATmega128 which the firmware touches. Included with
+// HAL_REGISTER8 and HAL_REGISTER16 defined to either declare or define them.
+
+HAL_REGISTER8(PINA)
+HAL_REGISTER8(DDRA)
+HAL_REGISTER8(PORTA)
+HAL_REGISTER8(PINB)
+HAL_REGISTER8(DDRB)
+HAL_REGISTER8(PORTB)
+HAL_REGISTER8(PINC)
+HAL_REGISTER8(DDRC)
+HAL_REGISTER8(PORTC)
+HAL_REGISTER8(PIND)
+HAL_REGISTER8(DDRD)
+HAL_REGISTER8(PORTD)
+HAL_REGISTER8(PINE)
+HAL_REGISTER8(DDRE)
+HAL_REGISTER8(PORTE)
+HAL_REGISTER8(PINF)
+HAL_REGISTER8(DDRF)
+HAL_REGISTER8(PORTF)
+HAL_REGISTER8(PING)
+HAL_REGISTER8(DDRG)
+HAL_REGISTER8(PORTG)
+
+HAL_REGISTER8(SPCR)
+HAL_REGISTER8(SPSR)
+HAL_REGISTER8(SPDR)
+
+HAL_REGISTER8(UCSR0A)
+HAL_REGISTER8(UCSR0B)
+HAL_REGISTER8(UCSR0C)
+HAL_REGISTER8(UDR0)
+HAL_REGISTER8(UBRR0H)
+HAL_REGISTER8(UBRR0L)
+HAL_REGISTER8(UCSR1A)
+HAL_REGISTER8(UCSR1B)
+HAL_REGISTER8(UCSR1C)
+HAL_REGISTER8(UDR1)
+HAL_REGISTER8(UBRR1H)
+HAL_REGISTER8(UBRR1L)
+
+HAL_REGISTER8(TIMSK)
+HAL_REGISTER8(TIFR)
+HAL_REGISTER8(ETIMSK)
+HAL_REGISTER8(ETIFR)
+HAL_REGISTER8(ASSR)
+
+HAL_REGISTER8(TCCR0)
+HAL_REGISTER8(TCNT0)
+HAL_REGISTER8(OCR0)
+
+HAL_REGISTER8(TCCR1A)
+HAL_REGISTER8(TCCR1B)
+HAL_REGISTER8(TCCR1C)
+HAL_REGISTER16(TCNT1)
+HAL_REGISTER16(OCR1A)
+HAL_REGISTER16(OCR1B)
+HAL_REGISTER16(OCR1C)
+HAL_REGISTER16(ICR1)
+
+HAL_REGISTER8(TCCR2)
+HAL_REGISTER8(TCNT2)
+HAL_REGISTER8(OCR2)
+
+HAL_REGISTER8(TCCR3A)
+HAL_REGISTER8(TCCR3B)
+HAL_REGISTER8(TCCR3C)
+HAL_REGISTER16(TCNT3)
+HAL_REGISTER16(OCR3A)
+HAL_REGISTER16(OCR3B)
+HAL_REGISTER16(OCR3C)
+HAL_REGISTER16(ICR3)
+
+HAL_REGISTER8(MCUCR)
+HAL_REGISTER8(XMCRA)
+HAL_REGISTER8(XMCRB)
+
+HAL_REGISTER8(SREG)
+HAL_REGISTER16(SP)
@@ -0,0 +1,59 @@
+#ifndef HAL_SD_CARD_H
+#define HAL_SD_CARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// SD card in SPI mode on the board's SPI bus, with its contents taken from a
+// disk image. It answers CMD0, CMD8, CMD12, CMD16, CMD17, CMD18, CMD55,
+// CMD58 and ACMD41 like a card does, everything else is an illegal command.
+//
+// With HAL_SD_IMAGE set, a card is inserted at start. HAL_SD_TYPE (v1, sc or
+// hc), HAL_SD_INIT_MS, HAL_SD_NCR and HAL_SD_LATENCY_US override the
+// defaults of the configuration below.
+
+typedef enum {
+    // Doesn't know CMD8 and uses byte addresses
+    HAL_SD_CARD_V1,
+    // Standard capacity, byte addresses
+    HAL_SD_CARD_V2_SC,
+    // High capacity, block addresses
+    HAL_SD_CARD_V2_HC
+} hal_sd_card_type_t;
+
+typedef struct {
+    hal_sd_card_type_t type;
+    // ACMD41 keeps answering idle for this long after the first one
+    uint16_t init_ms;
+    // Bytes of 0xFF between a command and its response, 0 to 8
+    uint8_t response_delay_bytes;
+    // Time from a read command, or the end of the previous block of a
+    // multiple block read, to the data token
+    uint16_t read_latency_us;
+} hal_sd_card_config_t;
+
+#define HAL_SD_CARD_COMMAND_COUNT 64
+
+typedef struct {
+    // Indexed by the command number, ACMDs are counted separately
+    uint32_t commands[HAL_SD_CARD_COMMAND_COUNT];
+    uint32_t app_commands[HAL_SD_CARD_COMMAND_COUNT];
+    uint32_t sectors_read;
+    // Reads of a sector which was read before since the stats were reset
+    uint32_t repeated_sector_reads;
+    // Every byte clocked over the bus, with the card selected or not
+    uint64_t bus_bytes;
+    // Bytes clocked while a read waited for its data token
+    uint64_t latency_bytes;
+} hal_sd_card_stats_t;
+
+void hal_sd_card_get_default_config(hal_sd_card_config_t *config);
+// Returns false when the image can't be opened or is no whole number of
+// sectors. The config is copied.
+bool hal_sd_card_insert(const char *image_path, const hal_sd_card_config_t *config);
+void hal_sd_card_remove(void);
+
+const hal_sd_card_stats_t *hal_sd_card_get_stats(void);
+void hal_sd_card_reset_stats(void);
+
+#endif // HAL_SD_CARD_H
@@ -0,0 +1,12 @@
+#ifndef HAL_STDLIB_H
+#define HAL_STDLIB_H
+
+#include_next <stdlib.h>
+
+// Number conversions which avr-libc has on top of the C library
+char *itoa(int value, char *buffer, int radix);
+char *ltoa(long value, char *buffer, int radix);
+char *utoa(unsigned int value, char *buffer, int radix);
+char *ultoa(unsigned long value, char *buffer, int radix);
+
+#endif // HAL_STDLIB_H
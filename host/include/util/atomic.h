@@ -0,0 +1,42 @@
+#ifndef HAL_UTIL_ATOMIC_H
+#define HAL_UTIL_ATOMIC_H
+
+#include <stdint.h>
+#include <avr/common.h>
+#include "hal.h"
+
+// Same shape as the avr-libc macros: the saved SREG is put back by a cleanup
+// handler, which also runs the interrupts that became pending meanwhile
+
+static inline uint8_t hal_atomic_enter(void) {
+    hal_cli();
+    return 1;
+}
+
+static inline void hal_atomic_restore(const uint8_t *sreg) {
+    if (*sreg & (1 << SREG_I)) {
+        hal_sei();
+    } else {
+        hal_cli();
+    }
+}
+
+static inline void hal_atomic_force_on(const uint8_t *sreg) {
+    (void)sreg;
+    hal_sei();
+}
+
+static inline void hal_atomic_force_off(const uint8_t *sreg) {
+    (void)sreg;
+    hal_cli();
+}
+
+#define ATOMIC_BLOCK(type) for (type, hal_atomic_todo = hal_atomic_enter(); hal_atomic_todo; hal_atomic_todo = 0)
+#define NONATOMIC_BLOCK(type) for (type, hal_atomic_todo = (hal_sei(), 1); hal_atomic_todo; hal_atomic_todo = 0)
+
+#define ATOMIC_RESTORESTATE uint8_t hal_sreg_save __attribute__((__cleanup__(hal_atomic_restore))) = SREG
+#define ATOMIC_FORCEON uint8_t hal_sreg_save __attribute__((__cleanup__(hal_atomic_force_on))) = 0
+#define NONATOMIC_RESTORESTATE uint8_t hal_sreg_save __attribute__((__cleanup__(hal_atomic_restore))) = SREG
+#define NONATOMIC_FORCEOFF uint8_t hal_sreg_save __attribute__((__cleanup__(hal_atomic_force_off))) = 0
+
+#endif // HAL_UTIL_ATOMIC_H
@@ -0,0 +1,19 @@
+#ifndef HAL_UTIL_DELAY_H
+#define HAL_UTIL_DELAY_H
+
+#include "hal.h"
+
+#ifndef F_CPU
+#error "F_CPU not defined!"
+#endif
+
+// Delays move the board time forward instead of sleeping
+static inline void _delay_us(double us) {
+    hal_delay_cycles((uint64_t)(us * (F_CPU / 1e6)));
+}
+
+static inline void _delay_ms(double ms) {
+    hal_delay_cycles((uint64_t)(ms * (F_CPU / 1e3)));
+}
+
+#endif // HAL_UTIL_DELAY_H
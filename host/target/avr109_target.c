@@ -0,0 +1,391 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "avr109_target.h"
+
+#define POLL_INTERVAL_MS 50
+#define NS_PER_SECOND 1000000000ULL
+#define NS_PER_US 1000ULL
+// Start, eight data bits and a stop bit
+#define BITS_PER_BYTE 10
+
+#define RESPONSE_ACK '\r'
+#define RESPONSE_YES 'Y'
+#define RESPONSE_UNKNOWN '?'
+#define COMMAND_SYNC 0x1B
+
+#define MEMORY_FLASH 'F'
+#define MEMORY_EEPROM 'E'
+
+// Larger than any AVR flash page, bigger blocks are read but not stored
+#define MAX_BLOCK_SIZE 1024
+
+#define ERASED_BYTE 0xFF
+#define FUSE_BYTE 0xFF
+
+static struct {
+    uint8_t flash[AVR109_TARGET_MAX_FLASH_SIZE];
+    uint8_t eeprom[AVR109_TARGET_MAX_EEPROM_SIZE];
+    uint8_t block[MAX_BLOCK_SIZE];
+    const avr109_target_config_t *config;
+    int fd;
+    volatile sig_atomic_t *stop;
+    // Word address for flash, byte address for EEPROM
+    uint32_t address;
+    uint64_t session_start_ns;
+    uint64_t last_byte_ns;
+    // Bytes written are on the line until then
+    uint64_t tx_done_ns;
+    // Address and block commands, counted for the fault interval
+    uint32_t page_commands;
+    avr109_target_stats_t stats;
+} target;
+
+static uint64_t get_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SECOND + now.tv_nsec;
+}
+
+static void sleep_until(uint64_t ns) {
+    struct timespec until = {ns / NS_PER_SECOND, ns % NS_PER_SECOND};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+        // Keep sleeping
+    }
+}
+
+static void stay_busy(uint64_t us) {
+    uint64_t start = get_ns();
+    sleep_until(start + us * NS_PER_US);
+    target.stats.busy_ns += get_ns() - start;
+}
+
+void avr109_target_get_default_config(avr109_target_config_t *config) {
+    // ATmega32U4 as on the Leonardo
+    config->programmer_id = "CATERIN";
+    config->signature[0] = 0x1E;
+    config->signature[1] = 0x95;
+    config->signature[2] = 0x87;
+    config->device_code = 0x44;
+    config->flash_size = 28 * 1024;
+    config->eeprom_size = 1024;
+    config->page_size = 128;
+    config->baud_rate = 57600;
+    config->page_program_us = 4500;
+    config->page_erase_us = 4000;
+    config->eeprom_byte_us = 3400;
+    config->fault_interval = 0;
+    config->session_finished = NULL;
+}
+
+void avr109_target_reset() {
+    memset(target.flash, ERASED_BYTE, sizeof(target.flash));
+    memset(target.eeprom, ERASED_BYTE, sizeof(target.eeprom));
+    memset(&target.stats, 0, sizeof(target.stats));
+    target.session_start_ns = 0;
+    target.page_commands = 0;
+}
+
+// Blocks until a byte arrives, false once there won't be any more
+static bool read_byte(uint8_t *byte) {
+    struct pollfd poll_fd = {target.fd, POLLIN, 0};
+
+    while (!*target.stop) {
+        int ready = poll(&poll_fd, 1, POLL_INTERVAL_MS);
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        } else if (ready <= 0) {
+            continue;
+        }
+
+        ssize_t result = read(target.fd, byte, 1);
+        if (result == 1) {
+            target.last_byte_ns = get_ns();
+            if (target.session_start_ns == 0) {
+                target.session_start_ns = target.last_byte_ns;
+            }
+            target.stats.rx_bytes++;
+            return true;
+        } else if (result == 0 || (errno != EAGAIN && errno != EINTR)) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+static bool read_word(uint16_t *word) {
+    uint8_t high;
+    uint8_t low;
+
+    if (!read_byte(&high) || !read_byte(&low)) {
+        return false;
+    }
+
+    *word = ((uint16_t)high << 8) | low;
+    return true;
+}
+
+// The next response waits until this one has left at the baud rate
+static void send(const uint8_t *data, uint16_t size) {
+    uint64_t now = get_ns();
+    if (target.tx_done_ns > now) {
+        sleep_until(target.tx_done_ns);
+        now = target.tx_done_ns;
+    }
+
+    for (uint16_t written = 0; written < size;) {
+        ssize_t result = write(target.fd, data + written, size - written);
+        if (result > 0) {
+            written += result;
+        } else if (errno != EAGAIN && errno != EINTR) {
+            return;
+        }
+    }
+
+    target.stats.tx_bytes += size;
+    if (target.config->baud_rate != 0) {
+        target.tx_done_ns = now + (uint64_t)size * BITS_PER_BYTE * NS_PER_SECOND / target.config->baud_rate;
+    }
+}
+
+static void send_byte(uint8_t byte) {
+    send(&byte, 1);
+}
+
+static bool inject_fault() {
+    target.page_commands++;
+    if (target.config->fault_interval == 0 || target.page_commands % target.config->fault_interval != 0) {
+        return false;
+    }
+
+    target.stats.faults++;
+    return true;
+}
+
+static void finish_session() {
+    if (target.session_start_ns != 0) {
+        target.stats.session_ns = target.last_byte_ns - target.session_start_ns;
+    }
+}
+
+static void chip_erase() {
+    // Caterina erases the application section page by page
+    uint32_t pages = target.config->flash_size / target.config->page_size;
+    stay_busy((uint64_t)pages * target.config->page_erase_us);
+
+    memset(target.flash, ERASED_BYTE, target.config->flash_size);
+    target.stats.chip_erases++;
+}
+
+static bool write_block() {
+    uint16_t size;
+    uint8_t memory;
+
+    if (!read_word(&size) || !read_byte(&memory)) {
+        return false;
+    }
+    bool drop_ack = inject_fault();
+
+    uint16_t stored = size <= sizeof(target.block) ? size : sizeof(target.block);
+    for (uint16_t i = 0; i < size; i++) {
+        uint8_t byte;
+        if (!read_byte(&byte)) {
+            return false;
+        }
+        if (i < stored) {
+            target.block[i] = byte;
+        }
+    }
+
+    if (memory == MEMORY_FLASH) {
+        // The page is erased before it is filled and written
+        uint32_t byte_address = target.address * 2;
+        for (uint16_t i = 0; i < stored && byte_address + i < target.config->flash_size; i++) {
+            target.flash[byte_address + i] = target.block[i];
+        }
+        target.address += (stored + 1) / 2;
+
+        stay_busy((uint64_t)target.config->page_erase_us + target.config->page_program_us);
+        target.stats.pages_written++;
+        if (!drop_ack) {
+            send_byte(RESPONSE_ACK);
+        }
+    } else if (memory == MEMORY_EEPROM) {
+        for (uint16_t i = 0; i < stored && target.address < target.config->eeprom_size; i++) {
+            target.eeprom[target.address++] = target.block[i];
+        }
+
+        stay_busy((uint64_t)stored * target.config->eeprom_byte_us);
+        target.stats.eeprom_bytes_written += stored;
+        if (!drop_ack) {
+            send_byte(RESPONSE_ACK);
+        }
+    } else {
+        send_byte(RESPONSE_UNKNOWN);
+    }
+
+    return true;
+}
+
+static bool read_block() {
+    uint16_t size;
+    uint8_t memory;
+
+    if (!read_word(&size) || !read_byte(&memory)) {
+        return false;
+    }
+    if (size > sizeof(target.block)) {
+        size = sizeof(target.block);
+    }
+
+    for (uint16_t i = 0; i < size; i++) {
+        if (memory == MEMORY_FLASH) {
+            uint32_t byte_address = target.address * 2 + i;
+            target.block[i] = byte_address < target.config->flash_size ? target.flash[byte_address] : ERASED_BYTE;
+        } else {
+            uint32_t byte_address = target.address + i;
+            target.block[i] = byte_address < target.config->eeprom_size ? target.eeprom[byte_address] : ERASED_BYTE;
+        }
+    }
+
+    target.address += memory == MEMORY_FLASH ? (size + 1) / 2 : size;
+    target.stats.blocks_read++;
+    send(target.block, inject_fault() ? size / 2 : size);
+    return true;
+}
+
+// Returns false once the other end is gone
+static bool handle_command(uint8_t command) {
+    uint8_t response[3];
+    uint8_t byte;
+    uint16_t word;
+
+    switch (command) {
+        case 'S':
+            send((const uint8_t *)target.config->programmer_id, strlen(target.config->programmer_id));
+            break;
+        case 'V':
+            send((const uint8_t *)"10", 2);
+            break;
+        case 'v':
+            send_byte(RESPONSE_UNKNOWN);
+            break;
+        case 'p':
+            send_byte('S');
+            break;
+        case 'a':
+            send_byte(RESPONSE_YES);
+            break;
+        case 'b':
+            response[0] = RESPONSE_YES;
+            response[1] = target.config->page_size >> 8;
+            response[2] = target.config->page_size;
+            send(response, 3);
+            break;
+        case 't':
+            response[0] = target.config->device_code;
+            response[1] = 0;
+            send(response, 2);
+            break;
+        case 's':
+            response[0] = target.config->signature[2];
+            response[1] = target.config->signature[1];
+            response[2] = target.config->signature[0];
+            send(response, 3);
+            break;
+        case 'r':
+        case 'F':
+        case 'N':
+        case 'Q':
+            send_byte(FUSE_BYTE);
+            break;
+        case 'T':
+        case 'x':
+        case 'y':
+        case 'l':
+            if (!read_byte(&byte)) {
+                return false;
+            }
+            send_byte(RESPONSE_ACK);
+            break;
+        case 'P':
+        case 'L':
+            send_byte(RESPONSE_ACK);
+            break;
+        case 'E':
+            send_byte(RESPONSE_ACK);
+            target.stats.exited = true;
+            finish_session();
+            if (target.config->session_finished != NULL) {
+                target.config->session_finished(&target.stats);
+            }
+            break;
+        case 'e':
+            chip_erase();
+            send_byte(RESPONSE_ACK);
+            break;
+        case 'A':
+            if (!read_word(&word)) {
+                return false;
+            }
+            // As if the command got lost on the line
+            if (!inject_fault()) {
+                target.address = word;
+                send_byte(RESPONSE_ACK);
+            }
+            break;
+        case 'B':
+            return write_block();
+        case 'g':
+            return read_block();
+        case COMMAND_SYNC:
+            // Caterina ignores ESC, which lets a host flush a cut off command
+            break;
+        default:
+            send_byte(RESPONSE_UNKNOWN);
+            break;
+    }
+
+    return true;
+}
+
+void avr109_target_serve(int fd, const avr109_target_config_t *config, volatile sig_atomic_t *stop) {
+    target.fd = fd;
+    target.config = config;
+    target.stop = stop;
+    target.tx_done_ns = 0;
+
+    uint8_t command;
+    while (read_byte(&command)) {
+        // The next command after an exit starts a new session
+        if (target.stats.exited) {
+            target.stats.exited = false;
+            target.session_start_ns = target.last_byte_ns;
+        }
+
+        if (!handle_command(command)) {
+            break;
+        }
+    }
+
+    if (!target.stats.exited) {
+        finish_session();
+    }
+}
+
+const avr109_target_stats_t *avr109_target_get_stats() {
+    return &target.stats;
+}
+
+const uint8_t *avr109_target_get_flash() {
+    return target.flash;
+}
+
+const uint8_t *avr109_target_get_eeprom() {
+    return target.eeprom;
+}
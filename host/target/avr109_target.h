@@ -0,0 +1,67 @@
+#ifndef AVR109_TARGET_H
+#define AVR109_TARGET_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Host stand-in for a board running the Caterina bootloader, the AVR109
+// variant of the Arduino Leonardo. It talks over a file descriptor, usually
+// the master side of a pty, and keeps its flash and EEPROM in memory.
+
+#define AVR109_TARGET_MAX_FLASH_SIZE (256UL * 1024)
+#define AVR109_TARGET_MAX_EEPROM_SIZE 4096
+
+typedef struct avr109_target_stats avr109_target_stats_t;
+
+typedef struct {
+    const char *programmer_id;
+    uint8_t signature[3];
+    uint8_t device_code;
+    uint32_t flash_size;
+    uint16_t eeprom_size;
+    uint16_t page_size;
+    // Responses leave no faster than this, 0 sends them at once
+    uint32_t baud_rate;
+    // Erase and write of one flash page, as the bootloader does both per block
+    uint32_t page_program_us;
+    uint32_t page_erase_us;
+    uint32_t eeprom_byte_us;
+    // Every fault_interval-th address, block write or block read command goes
+    // wrong, 0 for never. An address command gets no answer, a written block
+    // is stored but not acknowledged and a read block is cut off halfway, so
+    // the host times out each time.
+    uint16_t fault_interval;
+    // Called after each exit command, may be NULL
+    void (*session_finished)(const avr109_target_stats_t *stats);
+} avr109_target_config_t;
+
+struct avr109_target_stats {
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint32_t pages_written;
+    uint32_t eeprom_bytes_written;
+    uint32_t blocks_read;
+    uint32_t chip_erases;
+    uint32_t faults;
+    // From the first byte to the exit command or the last byte
+    uint64_t session_ns;
+    // Spent programming and erasing, the line is idle meanwhile
+    uint64_t busy_ns;
+    bool exited;
+};
+
+void avr109_target_get_default_config(avr109_target_config_t *config);
+
+// Erases the memories and clears the stats
+void avr109_target_reset(void);
+
+// Answers commands until the other end goes away or stop is set. A session
+// ends with the exit command, serving continues with the next one.
+void avr109_target_serve(int fd, const avr109_target_config_t *config, volatile sig_atomic_t *stop);
+
+const avr109_target_stats_t *avr109_target_get_stats(void);
+const uint8_t *avr109_target_get_flash(void);
+const uint8_t *avr109_target_get_eeprom(void);
+
+#endif // AVR109_TARGET_H
@@ -0,0 +1,114 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "avr_parts.h"
+#include "avr109_target.h"
+
+// Serves the Caterina bootloader on a new pty until interrupted. The path of
+// the pty is printed, pass it to the host firmware as HAL_USART1.
+
+static volatile sig_atomic_t stop;
+
+static void request_stop(int signal) {
+    (void)signal;
+    stop = true;
+}
+
+static void print_stats(const avr109_target_stats_t *stats) {
+    double seconds = stats->session_ns / 1e9;
+
+    printf("Session: %.3f s, %llu bytes received, %llu sent, %u pages, %u EEPROM bytes, %u faults, %.1f%% programming\n",
+        seconds, (unsigned long long)stats->rx_bytes, (unsigned long long)stats->tx_bytes, stats->pages_written,
+        stats->eeprom_bytes_written, stats->faults, stats->session_ns != 0 ? 100.0 * stats->busy_ns / stats->session_ns : 0);
+    fflush(stdout);
+    avr109_target_reset();
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-p part] [-b baud] [-s page_size] [-w page_program_us] [-x page_erase_us] [-e eeprom_byte_us] [-f fault_interval]\n", name);
+}
+
+int main(int argc, char **argv) {
+    avr109_target_config_t config;
+    avr109_target_get_default_config(&config);
+    config.session_finished = &print_stats;
+
+    int option;
+    while ((option = getopt(argc, argv, "p:b:s:w:x:e:f:")) != -1) {
+        const avr_part_t *part;
+
+        switch (option) {
+            case 'p':
+                part = avr_parts_find_by_name(optarg);
+                if (part == NULL) {
+                    fprintf(stderr, "Unknown part %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                memcpy(config.signature, part->signature, sizeof(config.signature));
+                config.device_code = part->device_code;
+                config.flash_size = part->flash_size;
+                config.eeprom_size = part->eeprom_size;
+                break;
+            case 'b':
+                config.baud_rate = atol(optarg);
+                break;
+            case 's':
+                config.page_size = atoi(optarg);
+                break;
+            case 'w':
+                config.page_program_us = atol(optarg);
+                break;
+            case 'x':
+                config.page_erase_us = atol(optarg);
+                break;
+            case 'e':
+                config.eeprom_byte_us = atol(optarg);
+                break;
+            case 'f':
+                config.fault_interval = atoi(optarg);
+                break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (config.flash_size > AVR109_TARGET_MAX_FLASH_SIZE || config.page_size == 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("pty");
+        return EXIT_FAILURE;
+    }
+
+    struct termios settings;
+    tcgetattr(master, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(master, TCSANOW, &settings);
+
+    // Kept open, so the pty doesn't hang up between clients
+    const char *slave_path = ptsname(master);
+    int slave = open(slave_path, O_RDWR | O_NOCTTY);
+
+    signal(SIGINT, &request_stop);
+    signal(SIGTERM, &request_stop);
+
+    printf("%s\n", slave_path);
+    fflush(stdout);
+
+    avr109_target_reset();
+    avr109_target_serve(master, &config, &stop);
+
+    close(slave);
+    close(master);
+    return EXIT_SUCCESS;
+}
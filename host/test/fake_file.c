@@ -0,0 +1,50 @@
+#include <string.h>
+#include "fake_file.h"
+
+static struct {
+    const char *contents;
+    uint32_t seeks;
+} fake;
+
+void fake_file_set_contents(const char *contents) {
+    fake.contents = contents;
+    fake.seeks = 0;
+}
+
+void fake_file_open(FIL *file, const char *contents) {
+    fake_file_set_contents(contents);
+    f_open(file, "", FA_READ);
+}
+
+uint32_t fake_file_get_seeks() {
+    return fake.seeks;
+}
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode) {
+    if (fake.contents == NULL) {
+        return FR_NO_FILE;
+    }
+
+    memset(fp, 0, sizeof(*fp));
+    fp->obj.objsize = strlen(fake.contents);
+    return FR_OK;
+}
+
+FRESULT f_close(FIL *fp) {
+    return FR_OK;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br) {
+    FSIZE_t left = f_size(fp) - fp->fptr;
+    *br = btr < left ? btr : left;
+
+    memcpy(buff, fake.contents + fp->fptr, *br);
+    fp->fptr += *br;
+    return FR_OK;
+}
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs) {
+    fake.seeks++;
+    fp->fptr = ofs < f_size(fp) ? ofs : f_size(fp);
+    return FR_OK;
+}
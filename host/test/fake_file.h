@@ -0,0 +1,16 @@
+#ifndef FAKE_FILE_H
+#define FAKE_FILE_H
+
+#include <stdint.h>
+#include "fatfs/ff.h"
+
+// f_open, f_read, f_lseek and f_close over a string in memory, so the
+// decoders can be tested without a disk image. f_open opens the contents
+// set last, or fails with FR_NO_FILE if there are none.
+void fake_file_set_contents(const char *contents);
+void fake_file_open(FIL *file, const char *contents);
+
+// Seeks since the contents were set
+uint32_t fake_file_get_seeks(void);
+
+#endif // FAKE_FILE_H
@@ -0,0 +1,291 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "intel_hex.h"
+#include "page_reader.h"
+#include "check.h"
+#include "fake_file.h"
+
+#define RECORD_DATA 0x00
+#define RECORD_END_OF_FILE 0x01
+#define RECORD_EXTENDED_SEGMENT_ADDRESS 0x02
+#define RECORD_EXTENDED_LINEAR_ADDRESS 0x04
+
+#define FILE_SIZE 4096
+#define PAGE_SIZE 64
+#define BLANK_BYTE 0xFF
+
+static char file_contents[FILE_SIZE];
+
+static void start_file() {
+    file_contents[0] = '\0';
+}
+
+// Appends a record with a correct checksum, plus checksum_error
+static void append_record(uint8_t type, uint16_t offset, const uint8_t *data, uint8_t length, uint8_t checksum_error, const char *line_end) {
+    char *end = file_contents + strlen(file_contents);
+    uint8_t checksum = length + (offset >> 8) + (offset & 0xFF) + type;
+
+    end += sprintf(end, ":%02X%04X%02X", length, offset, type);
+    for (uint8_t i = 0; i < length; i++) {
+        end += sprintf(end, "%02X", data[i]);
+        checksum += data[i];
+    }
+    sprintf(end, "%02X%s", (uint8_t)(-checksum + checksum_error), line_end);
+}
+
+static void append_data(uint16_t offset, const uint8_t *data, uint8_t length) {
+    append_record(RECORD_DATA, offset, data, length, 0, "\r\n");
+}
+
+static void append_address(uint8_t type, uint16_t address) {
+    uint8_t data[2] = {address >> 8, address & 0xFF};
+    append_record(type, 0, data, sizeof(data), 0, "\r\n");
+}
+
+static void append_end_of_file() {
+    append_record(RECORD_END_OF_FILE, 0, NULL, 0, 0, "\r\n");
+}
+
+static void fill_pattern(uint8_t *data, uint16_t length, uint8_t first) {
+    for (uint16_t i = 0; i < length; i++) {
+        data[i] = first + i;
+    }
+}
+
+// Decodes the whole file and checks every byte against the expected
+// addresses and values, which follow each other from start
+static void check_decodes(uint32_t start, const uint8_t *expected, uint16_t length) {
+    FIL file;
+    intel_hex_decoder_t decoder;
+    uint32_t address;
+    uint8_t byte;
+
+    fake_file_open(&file, file_contents);
+    intel_hex_init(&decoder, &file);
+
+    for (uint16_t i = 0; i < length; i++) {
+        CHECK(intel_hex_next_byte(&decoder, &address, &byte) == INTEL_HEX_OK);
+        CHECK(address == start + i);
+        CHECK(byte == expected[i]);
+    }
+    CHECK(intel_hex_next_byte(&decoder, &address, &byte) == INTEL_HEX_END);
+}
+
+static intel_hex_result_t decode_first_byte(uint32_t *address, uint8_t *byte) {
+    FIL file;
+    intel_hex_decoder_t decoder;
+
+    fake_file_open(&file, file_contents);
+    intel_hex_init(&decoder, &file);
+    return intel_hex_next_byte(&decoder, address, byte);
+}
+
+static void test_data_records() {
+    uint8_t data[32];
+    fill_pattern(data, sizeof(data), 0x10);
+
+    start_file();
+    append_data(0x0100, data, 16);
+    append_data(0x0110, data + 16, 16);
+    append_end_of_file();
+    check_decodes(0x0100, data, sizeof(data));
+}
+
+static void test_line_ends_and_lowercase() {
+    uint8_t data[4] = {0xAB, 0xCD, 0xEF, 0x01};
+
+    start_file();
+    append_record(RECORD_DATA, 0, data, 2, 0, "\n");
+    append_record(RECORD_DATA, 2, data + 2, 2, 0, "");
+    append_end_of_file();
+    for (char *c = file_contents; *c != '\0'; c++) {
+        if (*c >= 'A' && *c <= 'F') {
+            *c += 'a' - 'A';
+        }
+    }
+    check_decodes(0, data, sizeof(data));
+}
+
+static void test_extended_segment_address() {
+    uint8_t data[4];
+    fill_pattern(data, sizeof(data), 0x40);
+
+    start_file();
+    append_address(RECORD_EXTENDED_SEGMENT_ADDRESS, 0x1000);
+    append_data(0x0010, data, sizeof(data));
+    append_end_of_file();
+    check_decodes(0x10010, data, sizeof(data));
+}
+
+static void test_extended_linear_address() {
+    uint8_t data[4];
+    fill_pattern(data, sizeof(data), 0x80);
+
+    start_file();
+    append_address(RECORD_EXTENDED_LINEAR_ADDRESS, 0x0001);
+    append_data(0xFFFE, data, sizeof(data));
+    append_end_of_file();
+    // The offset wraps within the 64 KB segment on purpose in some files,
+    // the decoder just keeps counting
+    check_decodes(0x1FFFE, data, sizeof(data));
+}
+
+static void test_bad_checksum_returns_no_byte() {
+    uint8_t data[16];
+    uint32_t address = 0x12345678;
+    uint8_t byte = 0x5A;
+    fill_pattern(data, sizeof(data), 0);
+
+    start_file();
+    append_record(RECORD_DATA, 0, data, sizeof(data), 1, "\r\n");
+    append_end_of_file();
+
+    CHECK(decode_first_byte(&address, &byte) == INTEL_HEX_ERROR_CHECKSUM);
+    CHECK(address == 0x12345678);
+    CHECK(byte == 0x5A);
+}
+
+static void test_bad_checksum_in_address_record() {
+    uint8_t data[2] = {0x10, 0x00};
+    uint32_t address;
+    uint8_t byte;
+
+    start_file();
+    append_record(RECORD_EXTENDED_LINEAR_ADDRESS, 0, data, sizeof(data), 0x80, "\r\n");
+    append_data(0, data, sizeof(data));
+    append_end_of_file();
+
+    CHECK(decode_first_byte(&address, &byte) == INTEL_HEX_ERROR_CHECKSUM);
+}
+
+// Short records are checked within the read buffer, longer ones need a seek
+static void test_record_longer_than_the_buffer() {
+    uint8_t data[200];
+    fill_pattern(data, sizeof(data), 0x33);
+
+    start_file();
+    append_data(0, data, 16);
+    append_data(16, data + 16, 184);
+    append_end_of_file();
+    check_decodes(0, data, sizeof(data));
+    CHECK(fake_file_get_seeks() > 0);
+
+    start_file();
+    append_data(0, data, 16);
+    append_data(16, data + 16, 16);
+    append_data(32, data + 32, 32);
+    append_end_of_file();
+    check_decodes(0, data, 64);
+    CHECK(fake_file_get_seeks() == 0);
+
+    uint32_t address;
+    uint8_t byte;
+    start_file();
+    append_record(RECORD_DATA, 0, data, 184, 1, "\r\n");
+    append_end_of_file();
+    CHECK(decode_first_byte(&address, &byte) == INTEL_HEX_ERROR_CHECKSUM);
+}
+
+static void test_syntax_errors() {
+    uint8_t data[2] = {1, 2};
+    uint32_t address;
+    uint8_t byte;
+
+    // No end of file record
+    start_file();
+    append_data(0, data, sizeof(data));
+    FIL file;
+    intel_hex_decoder_t decoder;
+    fake_file_open(&file, file_contents);
+    intel_hex_init(&decoder, &file);
+    CHECK(intel_hex_next_byte(&decoder, &address, &byte) == INTEL_HEX_OK);
+    CHECK(intel_hex_next_byte(&decoder, &address, &byte) == INTEL_HEX_OK);
+    CHECK(intel_hex_next_byte(&decoder, &address, &byte) == INTEL_HEX_ERROR_SYNTAX);
+
+    // Cut off in the middle of the data
+    start_file();
+    append_data(0, data, sizeof(data));
+    file_contents[12] = '\0';
+    CHECK(decode_first_byte(&address, &byte) == INTEL_HEX_ERROR_SYNTAX);
+
+    start_file();
+    strcpy(file_contents, ":02000000G10E\r\n");
+    CHECK(decode_first_byte(&address, &byte) == INTEL_HEX_ERROR_SYNTAX);
+
+    start_file();
+    append_record(0x07, 0, data, sizeof(data), 0, "\r\n");
+    CHECK(decode_first_byte(&address, &byte) == INTEL_HEX_ERROR_RECORD_TYPE);
+}
+
+static page_reader_result_t read_page(page_reader_t *reader, uint32_t *page_address, uint8_t *page) {
+    memset(page, 0, PAGE_SIZE);
+    return page_reader_next_page(reader, page_address, page);
+}
+
+static void test_record_spanning_a_page_boundary() {
+    FIL file;
+    page_reader_t reader;
+    uint32_t page_address;
+    uint8_t page[PAGE_SIZE];
+    uint8_t data[16];
+    fill_pattern(data, sizeof(data), 0xA0);
+
+    start_file();
+    append_data(PAGE_SIZE - 8, data, sizeof(data));
+    append_end_of_file();
+    fake_file_open(&file, file_contents);
+    page_reader_init(&reader, &file, IMAGE_FORMAT_INTEL_HEX, PAGE_SIZE, true);
+
+    CHECK(read_page(&reader, &page_address, page) == PAGE_READER_OK);
+    CHECK(page_address == 0);
+    CHECK(page[PAGE_SIZE - 9] == BLANK_BYTE);
+    CHECK(memcmp(page + PAGE_SIZE - 8, data, 8) == 0);
+
+    CHECK(read_page(&reader, &page_address, page) == PAGE_READER_OK);
+    CHECK(page_address == PAGE_SIZE);
+    CHECK(memcmp(page, data + 8, 8) == 0);
+    CHECK(page[8] == BLANK_BYTE);
+
+    CHECK(read_page(&reader, &page_address, page) == PAGE_READER_END);
+}
+
+static void test_damaged_record_stays_out_of_the_page() {
+    FIL file;
+    page_reader_t reader;
+    uint32_t page_address;
+    uint8_t page[PAGE_SIZE];
+    uint8_t good[16];
+    uint8_t damaged[16];
+    fill_pattern(good, sizeof(good), 0x01);
+    memset(damaged, 0x55, sizeof(damaged));
+
+    start_file();
+    append_data(0, good, sizeof(good));
+    append_record(RECORD_DATA, sizeof(good), damaged, sizeof(damaged), 1, "\r\n");
+    append_end_of_file();
+    fake_file_open(&file, file_contents);
+    page_reader_init(&reader, &file, IMAGE_FORMAT_INTEL_HEX, PAGE_SIZE, true);
+
+    CHECK(read_page(&reader, &page_address, page) == PAGE_READER_ERROR_DECODE);
+    CHECK(reader.decode_result == INTEL_HEX_ERROR_CHECKSUM);
+    for (uint8_t i = 0; i < sizeof(damaged); i++) {
+        CHECK(page[sizeof(good) + i] != 0x55);
+    }
+}
+
+int main() {
+    test_data_records();
+    test_line_ends_and_lowercase();
+    test_extended_segment_address();
+    test_extended_linear_address();
+    test_bad_checksum_returns_no_byte();
+    test_bad_checksum_in_address_record();
+    test_record_longer_than_the_buffer();
+    test_syntax_errors();
+    test_record_spanning_a_page_boundary();
+    test_damaged_record_stays_out_of_the_page();
+
+    return CHECK_RESULT();
+}
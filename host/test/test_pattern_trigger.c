@@ -0,0 +1,108 @@
+#include <stdbool.h>
+#include <string.h>
+#include "pattern_trigger.h"
+#include "check.h"
+#include "fake_file.h"
+
+// Feeds text and records after which bytes a match was reported, as a
+// string of '.' and '^' with one char per byte
+static void feed(const char *text, char *marks) {
+    size_t length = strlen(text);
+
+    for (size_t i = 0; i < length; i++) {
+        marks[i] = pattern_trigger_feed(text[i]) ? '^' : '.';
+    }
+    marks[length] = '\0';
+}
+
+static void check_matches(const char *pattern, const char *text, const char *expected) {
+    char marks[128];
+
+    pattern_trigger_arm(pattern);
+    feed(text, marks);
+    if (strcmp(marks, expected) != 0) {
+        fprintf(stderr, "pattern \"%s\" in \"%s\": got %s, expected %s\n", pattern, text, marks, expected);
+    }
+    CHECK(strcmp(marks, expected) == 0);
+}
+
+static void test_single_matches() {
+    check_matches("ERROR", "boot ok, ERROR 5", ".............^..");
+    check_matches("ERROR", "ERRO ERROR", ".........^");
+    check_matches("x", "axbx", ".^.^");
+    check_matches("panic", "pani", "....");
+}
+
+static void test_overlapping_matches() {
+    check_matches("aa", "aaaa", ".^^^");
+    check_matches("abab", "abababab", "...^.^.^");
+    check_matches("aab", "aaab", "...^");
+    check_matches("abcab", "abcabcab", "....^..^");
+}
+
+// The failure function has to send these back to a partial match
+static void test_fallback_to_partial_match() {
+    check_matches("abac", "ababac", ".....^");
+    check_matches("aaab", "aaaaab", ".....^");
+    check_matches("abcabd", "abcabcabd", "........^");
+}
+
+static void test_bytes_outside_the_pattern_restart() {
+    check_matches("ab", "a\xff" "ab\x01" "ab", "...^..^");
+    check_matches("\xff\xfe", "\xff\xff\xfe", "..^");
+}
+
+static void test_long_patterns_are_truncated() {
+    pattern_trigger_arm("0123456789abcdefXYZ");
+    CHECK(strcmp(pattern_trigger_get_pattern(), "0123456789abcdef") == 0);
+
+    char marks[32];
+    feed("0123456789abcdef", marks);
+    CHECK(strcmp(marks, "...............^") == 0);
+}
+
+static void test_disarm_and_restart() {
+    char marks[16];
+
+    pattern_trigger_arm("abc");
+    CHECK(pattern_trigger_is_armed());
+    feed("ab", marks);
+    pattern_trigger_restart();
+    feed("cabc", marks);
+    CHECK(strcmp(marks, "...^") == 0);
+
+    pattern_trigger_disarm();
+    CHECK(!pattern_trigger_is_armed());
+    feed("abc", marks);
+    CHECK(strcmp(marks, "...") == 0);
+
+    pattern_trigger_arm("");
+    CHECK(!pattern_trigger_is_armed());
+}
+
+static void test_read_file() {
+    char pattern[PATTERN_TRIGGER_MAX_LENGTH + 1];
+
+    fake_file_set_contents("FATAL\r\nsecond line\n");
+    CHECK(pattern_trigger_read_file("/trigger.txt", pattern) == FR_OK);
+    CHECK(strcmp(pattern, "FATAL") == 0);
+
+    fake_file_set_contents("a pattern longer than sixteen");
+    CHECK(pattern_trigger_read_file("/trigger.txt", pattern) == FR_OK);
+    CHECK(strcmp(pattern, "a pattern longer") == 0);
+
+    fake_file_set_contents(NULL);
+    CHECK(pattern_trigger_read_file("/trigger.txt", pattern) == FR_NO_FILE);
+}
+
+int main() {
+    test_single_matches();
+    test_overlapping_matches();
+    test_fallback_to_partial_match();
+    test_bytes_outside_the_pattern_restart();
+    test_long_patterns_are_truncated();
+    test_disarm_and_restart();
+    test_read_file();
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,178 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <millis.h>
+#include "fatfs/ff.h"
+#include "hal.h"
+#include "hal_sd_card.h"
+#include "avr109_target.h"
+#include "fat_image.h"
+#include "uploader.h"
+#include "usart.h"
+#include "check.h"
+
+// Uploads into the mock bootloader while it drops acknowledgments, cuts off
+// read blocks and ignores address commands, and checks that the retries end
+// with the image in the target's flash.
+
+#define TARGET_USART USART_PORT_1
+#define BAUD_RATE 1000000UL
+#define DOUBLE_SPEED_PRESCALER 8
+// Raw UCSZ value for eight data bits
+#define CHARACTER_SIZE_8 3
+
+#define PAGE_SIZE 128
+#define IMAGE_PAGES 4
+#define IMAGE_SIZE (IMAGE_PAGES * PAGE_SIZE)
+// Every page takes at least two page commands per attempt, so no page runs
+// out of attempts
+#define FAULT_INTERVAL 4
+#define ERASED_BYTE 0xFF
+
+static struct {
+    avr109_target_config_t target_config;
+    volatile sig_atomic_t stop_target;
+    uint8_t image[IMAGE_SIZE];
+} test;
+
+static void *serve_target(void *fd) {
+    avr109_target_serve(*(int *)fd, &test.target_config, &test.stop_target);
+    return NULL;
+}
+
+static bool open_pty(int *master, int *slave) {
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (*master < 0 || grantpt(*master) != 0 || unlockpt(*master) != 0) {
+        return false;
+    }
+
+    *slave = open(ptsname(*master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (*slave < 0) {
+        return false;
+    }
+
+    struct termios settings;
+    tcgetattr(*master, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(*master, TCSANOW, &settings);
+    tcsetattr(*slave, TCSANOW, &settings);
+    return true;
+}
+
+static bool create_card() {
+    char card_path[] = "/tmp/upload_retries_XXXXXX";
+    int card_fd = mkstemp(card_path);
+    if (card_fd < 0) {
+        return false;
+    }
+    close(card_fd);
+
+    // No byte is 0xFF, so no page is left out as blank
+    for (uint16_t i = 0; i < IMAGE_SIZE; i++) {
+        test.image[i] = (i * 7 + (i >> 8)) % ERASED_BYTE;
+    }
+    fat_image_file_t file = {"PROG.BIN", test.image, IMAGE_SIZE};
+
+    hal_sd_card_config_t config;
+    hal_sd_card_get_default_config(&config);
+    bool created = fat_image_write(card_path, &file, 1) && hal_sd_card_insert(card_path, &config);
+    unlink(card_path);
+    return created;
+}
+
+static void upload(FIL *file, upload_mode_t mode) {
+    upload_config_t config = {
+        .flash_file = file,
+        .flash_format = IMAGE_FORMAT_BINARY,
+        .flash_timestamp = 0,
+        .eeprom_file = NULL,
+        .mode = mode,
+        .expected_part = NULL
+    };
+
+    avr109_target_reset();
+    uploader_start(&config);
+
+    upload_result_t result;
+    while ((result = uploader_step()) == UPLOAD_IN_PROGRESS) {
+        hal_poll();
+    }
+
+    CHECK(result == UPLOAD_DONE);
+    if (result != UPLOAD_DONE) {
+        fprintf(stderr, "Upload failed: %s\n", uploader_get_error());
+    }
+
+    // Give the target time to take the exit command off the line
+    usleep(10000);
+    const avr109_target_stats_t *stats = avr109_target_get_stats();
+    const uint8_t *flash = avr109_target_get_flash();
+
+    CHECK(stats->faults != 0);
+    // Each fault costs exactly one attempt
+    CHECK(uploader_get_retries() == stats->faults);
+    CHECK(memcmp(flash, test.image, IMAGE_SIZE) == 0);
+    for (uint32_t i = IMAGE_SIZE; i < test.target_config.flash_size; i++) {
+        if (flash[i] != ERASED_BYTE) {
+            CHECK(flash[i] == ERASED_BYTE);
+            break;
+        }
+    }
+}
+
+int main() {
+    avr109_target_get_default_config(&test.target_config);
+    test.target_config.baud_rate = BAUD_RATE;
+    test.target_config.page_size = PAGE_SIZE;
+    test.target_config.page_program_us = 0;
+    test.target_config.page_erase_us = 0;
+    test.target_config.fault_interval = FAULT_INTERVAL;
+
+    if (!create_card()) {
+        fprintf(stderr, "Creating the SD image failed\n");
+        return EXIT_FAILURE;
+    }
+
+    int master;
+    int slave;
+    if (!open_pty(&master, &slave)) {
+        perror("pty");
+        return EXIT_FAILURE;
+    }
+
+    avr109_target_reset();
+    pthread_t target_thread;
+    pthread_create(&target_thread, NULL, &serve_target, &master);
+
+    millis_init();
+    usart_init();
+    uint32_t divider = (F_CPU + DOUBLE_SPEED_PRESCALER / 2 * BAUD_RATE) / (DOUBLE_SPEED_PRESCALER * BAUD_RATE);
+    usart_configure(TARGET_USART, divider - 1, true, CHARACTER_SIZE_8, 0, 0);
+    hal_usart_attach(TARGET_USART, slave);
+    hal_sei();
+
+    FATFS file_system;
+    FIL file;
+    FRESULT f_err = f_mount(&file_system, "", 1);
+    if (f_err == FR_OK) {
+        f_err = f_open(&file, "PROG.BIN", FA_READ);
+    }
+    if (f_err != FR_OK) {
+        fprintf(stderr, "Opening PROG.BIN failed: %d\n", f_err);
+        return EXIT_FAILURE;
+    }
+
+    upload(&file, UPLOAD_MODE_FULL);
+    upload(&file, UPLOAD_MODE_CHANGES);
+
+    test.stop_target = true;
+    pthread_join(target_thread, NULL);
+    return CHECK_RESULT();
+}
@@ -1,10 +1,74 @@
 #ifndef AVR109_DRIVER_H
 #define AVR109_DRIVER_H
 
-asdasd
-asdasdjkkjkjkjkj
+#include <stdint.h>
+#include <millis.h>
 
+// Talks to an AVR109 (Butterfly/Caterina) bootloader on the target USART.
+// Commands only get started by their functions and are then carried out by
+// calling avr109_poll, so nothing here waits for the target.
 
+#define AVR109_RESPONSE_TIMEOUT_MS 1000
+// Erasing the whole application section takes a few seconds on larger parts
+#define AVR109_ERASE_TIMEOUT_MS 10000
 
+#define AVR109_PROGRAMMER_ID_LENGTH 7
+#define AVR109_SIGNATURE_SIZE 3
 
-#endif // AVR109_DRIVER_H
\ No newline at end of file
+typedef enum {
+    AVR109_MEMORY_FLASH = 'F',
+    AVR109_MEMORY_EEPROM = 'E'
+} avr109_memory_t;
+
+typedef enum {
+    AVR109_ERROR_OK = 0,
+    // Not an error, the command is still running
+    AVR109_ERROR_PENDING,
+    AVR109_ERROR_TIMEOUT,
+    AVR109_ERROR_NO_ACK,
+    AVR109_ERROR_NO_BLOCK_SUPPORT,
+    AVR109_ERROR_ADDRESS_RANGE
+} avr109_error_t;
+
+// Short description of an error, fits on an LCD line
+const char *avr109_error_to_string(avr109_error_t error);
+
+// Takes over the target USART, responses are taken in its RX interrupt
+void avr109_begin(void);
+void avr109_end(void);
+
+// Returns AVR109_ERROR_PENDING until the last started command has finished.
+// Every call sends and receives as much as the USART buffers allow.
+avr109_error_t avr109_poll(void);
+
+// programmer_id needs room for AVR109_PROGRAMMER_ID_LENGTH characters and a
+// terminator, like "CATERIN" or "AVRBOOT"
+void avr109_read_programmer_id(char *programmer_id);
+// Zero terminated list of supported AVR910 device codes, codes which don't
+// fit into buffer_size are dropped
+void avr109_read_device_codes(uint8_t *device_codes, uint8_t buffer_size);
+// Signature bytes in memory order, starting with 0x1E for Atmel parts
+void avr109_read_signature(uint8_t *signature);
+
+void avr109_enter_programming_mode(void);
+void avr109_leave_programming_mode(void);
+void avr109_exit_bootloader(void);
+void avr109_chip_erase(void);
+// block_size is written once the command has finished
+void avr109_get_block_size(uint16_t *block_size);
+
+// Flash addresses are in words, EEPROM addresses in bytes
+void avr109_set_address(uint32_t address);
+// data has to stay valid until the command has finished
+void avr109_write_block(avr109_memory_t memory, const uint8_t *data, uint16_t size);
+
+// Reads a block back and compares it against expected while it arrives.
+// mismatch_offset is set to the first differing byte, or to size if the
+// block matches.
+void avr109_compare_block(avr109_memory_t memory, const uint8_t *expected, uint16_t size, uint16_t *mismatch_offset);
+
+// Brings the bootloader back to waiting for a command after bytes got lost.
+// The address counter is undefined afterwards and has to be set again.
+void avr109_resync(uint16_t block_size);
+
+#endif // AVR109_DRIVER_H
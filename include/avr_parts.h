@@ -0,0 +1,26 @@
+#ifndef AVR_PARTS_H
+#define AVR_PARTS_H
+
+#include <stdint.h>
+
+#define AVR_SIGNATURE_SIZE 3
+// Longest part name in the table
+#define AVR_PART_NAME_MAX_LENGTH 11
+
+typedef struct {
+    const char *name;
+    uint8_t signature[AVR_SIGNATURE_SIZE];
+    // AVR910/AVR109 device code, 0 if the part never had one
+    uint8_t device_code;
+    uint32_t flash_size;
+    uint16_t eeprom_size;
+} avr_part_t;
+
+// Return NULL for parts which are not in the table
+const avr_part_t *avr_parts_find_by_signature(const uint8_t *signature);
+// Device code lists are zero terminated, like the AVR109 't' response
+const avr_part_t *avr_parts_find_by_device_codes(const uint8_t *device_codes);
+// Case insensitive, so both "ATmega328P" and "atmega328p" work
+const avr_part_t *avr_parts_find_by_name(const char *name);
+
+#endif // AVR_PARTS_H
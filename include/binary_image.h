@@ -0,0 +1,58 @@
+#ifndef BINARY_IMAGE_H
+#define BINARY_IMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fatfs/ff.h"
+
+typedef enum {
+    BINARY_IMAGE_OK = 0,
+    BINARY_IMAGE_END,
+    BINARY_IMAGE_ERROR_READ,
+    BINARY_IMAGE_ERROR_NOT_ELF,
+    BINARY_IMAGE_ERROR_WRONG_MACHINE
+} binary_image_result_t;
+
+static inline const char *binary_image_result_to_string(binary_image_result_t result) {
+    switch (result) {
+        case BINARY_IMAGE_OK:
+            return "Image OK";
+        case BINARY_IMAGE_END:
+            return "Image End";
+        case BINARY_IMAGE_ERROR_READ:
+            return "Image Read Error";
+        case BINARY_IMAGE_ERROR_NOT_ELF:
+            return "Not an ELF file";
+        case BINARY_IMAGE_ERROR_WRONG_MACHINE:
+            return "ELF not for AVR";
+        default:
+            return "Image Unknown";
+    }
+}
+
+// Reads images which store their data as it is, so it can be copied straight
+// into pages. A raw binary is a single segment starting at address 0, an ELF
+// file has one segment for each PT_LOAD program header in flash.
+typedef struct {
+    FIL *file;
+    bool elf;
+    bool header_read;
+    uint32_t program_header_offset;
+    uint16_t program_header_size;
+    uint16_t program_header_count;
+    uint16_t next_program_header;
+    // Rest of the current segment
+    uint32_t file_offset;
+    uint32_t address;
+    uint32_t remaining;
+} binary_image_t;
+
+void binary_image_init(binary_image_t *image, FIL *file, bool elf);
+
+// Moves on to the next segment, which can be empty
+binary_image_result_t binary_image_next_segment(binary_image_t *image);
+
+// Reads from the current segment, length must not exceed what remains of it
+binary_image_result_t binary_image_read(binary_image_t *image, uint8_t *buffer, uint16_t length);
+
+#endif // BINARY_IMAGE_H
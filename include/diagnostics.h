@@ -0,0 +1,10 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <millis.h>
+#include "tick_callback.h"
+
+// Free RAM and the least stack headroom since reset, see memory_usage.h
+tick_callback_t switch_to_diagnostics(void);
+
+#endif // DIAGNOSTICS_H
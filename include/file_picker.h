@@ -1,12 +1,19 @@
 #ifndef FILE_PICKER_H
 #define FILE_PICKER_H
 
+#include <stdint.h>
 #include "fatfs/ff.h"
 #include "tick_callback.h"
 
-// File picker should only be used when the file system is already mounted
+// File picker should only be used when the file system is already mounted.
+// It finishes when a file is opened or when the user goes back, in which case
+// file_picker_get_selected_file returns NULL.
 FRESULT file_picker_tick(tick_callback_result_t *result);
 FRESULT start_file_picker();
 FIL *file_picker_get_selected_file();
+// Name of the selected file, the current directory is the one it is in
+const char *file_picker_get_selected_name();
+// FAT date in the upper half, FAT time in the lower half
+uint32_t file_picker_get_selected_timestamp();
 
 #endif // FILE_PICKER_H
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef FIRMWARE_H
+#define FIRMWARE_H
+
+#include <millis.h>
+
+// The firmware without its main loop, so the host perf suite runs the same
+// setup and ticks as entry_point.c
+
+#define FIRMWARE_LOOP_RATE 30
+#define FIRMWARE_LOOP_INTERVAL (1000 / FIRMWARE_LOOP_RATE)
+
+void firmware_setup(void);
+// Buttons and the current screen, FIRMWARE_LOOP_RATE times a second
+void firmware_tick(millis_t current_time);
+// Background work, on every pass of the main loop
+void firmware_poll(millis_t current_time);
+
+#endif // FIRMWARE_H
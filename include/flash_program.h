@@ -0,0 +1,11 @@
+#ifndef FLASH_PROGRAM_H
+#define FLASH_PROGRAM_H
+
+#include <millis.h>
+#include "tick_callback.h"
+
+tick_callback_t switch_to_flash_program(void);
+// Only writes the pages which differ from what the target already has
+tick_callback_t switch_to_flash_changes(void);
+
+#endif // FLASH_PROGRAM_H
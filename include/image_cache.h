@@ -0,0 +1,76 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Keeps the pages of the last flash image, so flashing it again skips reading
+// and decoding the file. Selected at build time with -D IMAGE_CACHE_BACKEND=...
+#define IMAGE_CACHE_BACKEND_NONE 0
+// External SRAM, see xmem.h. The SD card is mounted read only, so there is no
+// cache file next to the image.
+#define IMAGE_CACHE_BACKEND_XMEM 1
+
+#ifndef IMAGE_CACHE_BACKEND
+#define IMAGE_CACHE_BACKEND IMAGE_CACHE_BACKEND_NONE
+#endif
+
+// A changed file gets a new size or timestamp. The start cluster tells apart
+// files which happen to share both.
+typedef struct {
+    uint32_t file_size;
+    uint32_t start_cluster;
+    // FAT date in the upper half, FAT time in the lower half
+    uint32_t timestamp;
+    uint16_t page_size;
+    uint8_t format;
+    bool skip_blank_pages;
+} image_cache_key_t;
+
+#if IMAGE_CACHE_BACKEND == IMAGE_CACHE_BACKEND_XMEM
+
+void image_cache_init(void);
+
+// True if the cache holds all pages of the image described by key
+bool image_cache_lookup(const image_cache_key_t *key);
+
+// Drops the cached image and starts storing pages for a new one, which only
+// becomes visible to lookups once it is committed
+void image_cache_begin(const image_cache_key_t *key);
+// Pages have to be added in the order they should be returned in
+void image_cache_append(uint32_t page_address, const uint8_t *page);
+void image_cache_commit(void);
+
+uint16_t image_cache_get_page_count(void);
+void image_cache_get_page(uint16_t index, uint32_t *page_address, uint8_t *page);
+
+#elif IMAGE_CACHE_BACKEND == IMAGE_CACHE_BACKEND_NONE
+
+static inline void image_cache_init(void) {
+}
+
+static inline bool image_cache_lookup(const image_cache_key_t *key) {
+    return false;
+}
+
+static inline void image_cache_begin(const image_cache_key_t *key) {
+}
+
+static inline void image_cache_append(uint32_t page_address, const uint8_t *page) {
+}
+
+static inline void image_cache_commit(void) {
+}
+
+static inline uint16_t image_cache_get_page_count(void) {
+    return 0;
+}
+
+static inline void image_cache_get_page(uint16_t index, uint32_t *page_address, uint8_t *page) {
+}
+
+#else
+#error "Unknown IMAGE_CACHE_BACKEND"
+#endif
+
+#endif // IMAGE_CACHE_H
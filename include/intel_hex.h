@@ -0,0 +1,45 @@
+#ifndef INTEL_HEX_H
+#define INTEL_HEX_H
+
+#include <stdint.h>
+#include "fatfs/ff.h"
+
+// Holds the data and checksum chars of a record with 32 data bytes, so going
+// back after checking a record is a move within the buffer
+#define INTEL_HEX_READ_BUFFER_SIZE 72
+
+typedef enum {
+    INTEL_HEX_OK = 0,
+    INTEL_HEX_END,
+    INTEL_HEX_ERROR_READ,
+    INTEL_HEX_ERROR_SYNTAX,
+    INTEL_HEX_ERROR_CHECKSUM,
+    INTEL_HEX_ERROR_RECORD_TYPE
+} intel_hex_result_t;
+
+// Short description of a result, fits on an LCD line
+const char *intel_hex_result_to_string(intel_hex_result_t result);
+
+// Decodes a file one data byte at a time, so no record ever has to be held
+// in memory. A data record is read ahead up to its checksum before its first
+// byte is returned, so only bytes of intact records come out.
+typedef struct {
+    FIL *file;
+    uint8_t buffer[INTEL_HEX_READ_BUFFER_SIZE];
+    UINT buffer_length;
+    UINT buffer_position;
+    // Set by the extended address records
+    uint32_t base_address;
+    uint32_t address;
+    uint8_t remaining_data_bytes;
+    uint8_t checksum;
+} intel_hex_decoder_t;
+
+// Starts decoding from the current file position
+void intel_hex_init(intel_hex_decoder_t *decoder, FIL *file);
+
+// Returns INTEL_HEX_OK with the next data byte and its absolute address,
+// INTEL_HEX_END after the end of file record or an error
+intel_hex_result_t intel_hex_next_byte(intel_hex_decoder_t *decoder, uint32_t *address, uint8_t *byte);
+
+#endif // INTEL_HEX_H
@@ -2,9 +2,15 @@
 #define MAIN_MENU_H
 
 #include <millis.h>
+#include "tick_callback.h"
 
 void main_menu_init(void);
 void switch_to_main_menu(void);
 void main_menu_tick(millis_t current_time);
 
+// The background task is called on every pass of the main loop, in between
+// the ticks, until it returns TICK_CALLBACK_FINISHED
+void main_menu_set_background_task(tick_callback_t task);
+void main_menu_run_background_task(millis_t current_time);
+
 #endif // MAIN_MENU_H
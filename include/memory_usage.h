@@ -0,0 +1,18 @@
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <stdint.h>
+
+// The RAM between the end of .bss and the top of the stack is filled with a
+// canary pattern before main runs. The stack overwrites it as it grows, so
+// the pattern left above .bss is the least headroom the stack ever had.
+
+// Returned by the host build, which has no fixed SRAM to measure
+#define MEMORY_USAGE_UNKNOWN UINT16_MAX
+
+// Bytes between the end of .bss and the stack pointer right now
+uint16_t memory_usage_get_free_ram(void);
+// Bytes the stack never reached since reset
+uint16_t memory_usage_get_min_stack_headroom(void);
+
+#endif // MEMORY_USAGE_H
@@ -0,0 +1,55 @@
+#ifndef PAGE_READER_H
+#define PAGE_READER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fatfs/ff.h"
+#include "intel_hex.h"
+#include "binary_image.h"
+
+#define PAGE_READER_MAX_PAGE_SIZE 256
+
+typedef enum {
+    IMAGE_FORMAT_INTEL_HEX = 0,
+    IMAGE_FORMAT_BINARY,
+    IMAGE_FORMAT_ELF
+} image_format_t;
+
+typedef enum {
+    PAGE_READER_OK = 0,
+    PAGE_READER_END,
+    PAGE_READER_ERROR_DECODE,
+    PAGE_READER_ERROR_UNSORTED
+} page_reader_result_t;
+
+// Groups the decoded image into pages. Pages which no record touches are
+// never returned. Pages which only contain 0xFF can be skipped as well when
+// the target was chip erased, because they already read 0xFF.
+// HEX files are decoded a byte at a time, binary images are read straight
+// into the page.
+typedef struct {
+    image_format_t format;
+    union {
+        intel_hex_decoder_t decoder;
+        binary_image_t image;
+    };
+    intel_hex_result_t decode_result;
+    binary_image_result_t image_result;
+    uint16_t page_size;
+    uint32_t next_page_address;
+    uint32_t pending_address;
+    uint8_t pending_byte;
+    bool has_pending_byte;
+    bool finished;
+    bool skip_blank_pages;
+} page_reader_t;
+
+// Page size has to be a power of two
+void page_reader_init(page_reader_t *reader, FIL *file, image_format_t format, uint16_t page_size, bool skip_blank_pages);
+
+// Fills page with the next page which has data, unused bytes are 0xFF
+page_reader_result_t page_reader_next_page(page_reader_t *reader, uint32_t *page_address, uint8_t *page);
+
+const char *page_reader_error_to_string(const page_reader_t *reader, page_reader_result_t result);
+
+#endif // PAGE_READER_H
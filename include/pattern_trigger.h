@@ -0,0 +1,28 @@
+#ifndef PATTERN_TRIGGER_H
+#define PATTERN_TRIGGER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fatfs/ff.h"
+
+#define PATTERN_TRIGGER_MAX_LENGTH 16
+
+// Patterns longer than PATTERN_TRIGGER_MAX_LENGTH are truncated, an empty
+// pattern disarms the trigger
+void pattern_trigger_arm(const char *pattern);
+void pattern_trigger_disarm(void);
+bool pattern_trigger_is_armed(void);
+const char *pattern_trigger_get_pattern(void);
+
+// Forgets any partial match, so matching starts over with the next byte
+void pattern_trigger_restart(void);
+
+// Feeds one received byte to the matcher (KMP, amortized O(1) per byte),
+// returns true when the byte completes a match. Safe to call from an ISR.
+bool pattern_trigger_feed(char c);
+
+// Reads the first line of a file into buffer, which has to be able to hold
+// PATTERN_TRIGGER_MAX_LENGTH + 1 chars. The file system has to be mounted.
+FRESULT pattern_trigger_read_file(const char *path, char *buffer);
+
+#endif // PATTERN_TRIGGER_H
@@ -0,0 +1,12 @@
+#ifndef PRODUCTION_H
+#define PRODUCTION_H
+
+#include <millis.h>
+#include "tick_callback.h"
+
+// Flashes the same image onto one board after another. The image is picked
+// once, then every board is erased, written and verified at the press of a
+// single button, or as soon as its bootloader answers with auto start on.
+tick_callback_t switch_to_production(void);
+
+#endif // PRODUCTION_H
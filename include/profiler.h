@@ -0,0 +1,49 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Sampling profiler. Timer 0 interrupts the firmware PROFILER_RATE times a
+// second and counts the program counter it interrupted in a histogram, which
+// is sent over USART0 on request. tools/profile_report.py drives it and
+// symbolizes the result with the ELF file. Built in with
+// -D PROFILER_ENABLED=1, without it the calls below compile to nothing.
+//
+// Commands, one character each except for the window:
+//   s            clear the histogram and start sampling
+//   p            pause sampling
+//   d            send the histogram
+//   wSSSSEEEE\n  only count word addresses from SSSS to EEEE, in hex
+//
+// The histogram is sent as text lines:
+//   profile start=SSSS shift=N rate=R samples=S outside=O
+//   AAAA C       for every bin with samples, AAAA is its first word address
+//   end
+// Each bin covers 2^shift words. Samples outside the window only count in
+// outside, so a hot region can be narrowed down with a smaller window.
+//
+// The serial bridge takes over USART0 while it runs.
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 0
+#endif
+
+#define PROFILER_RATE 4000
+#define PROFILER_BINS 128
+
+#if PROFILER_ENABLED
+
+// Timer 0 has to be set up after millis_init, which overwrites TIMSK
+void profiler_init(void);
+// Answers commands and sends the histogram, called from the main loop
+void profiler_poll(void);
+
+#else
+
+static inline void profiler_init(void) {
+}
+
+static inline void profiler_poll(void) {
+}
+
+#endif
+
+#endif // PROFILER_H
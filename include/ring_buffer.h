@@ -0,0 +1,57 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Single producer, single consumer byte queue. One side may run in an ISR,
+// because each index is only ever written by one side. Storage size has to be
+// a power of two no larger than 128.
+typedef struct {
+    uint8_t *data;
+    uint8_t mask;
+    volatile uint8_t head;
+    volatile uint8_t tail;
+} ring_buffer_t;
+
+#define RING_BUFFER_INIT(storage) {(storage), sizeof(storage) - 1, 0, 0}
+
+static inline uint8_t ring_buffer_count(const ring_buffer_t *ring) {
+    return (ring->head - ring->tail) & ring->mask;
+}
+
+static inline bool ring_buffer_is_empty(const ring_buffer_t *ring) {
+    return ring->head == ring->tail;
+}
+
+// One slot is always left empty to tell a full buffer from an empty one
+static inline bool ring_buffer_is_full(const ring_buffer_t *ring) {
+    return ring_buffer_count(ring) == ring->mask;
+}
+
+static inline bool ring_buffer_push(ring_buffer_t *ring, uint8_t byte) {
+    if (ring_buffer_is_full(ring)) {
+        return false;
+    }
+
+    ring->data[ring->head] = byte;
+    ring->head = (ring->head + 1) & ring->mask;
+    return true;
+}
+
+static inline bool ring_buffer_pop(ring_buffer_t *ring, uint8_t *byte) {
+    if (ring_buffer_is_empty(ring)) {
+        return false;
+    }
+
+    *byte = ring->data[ring->tail];
+    ring->tail = (ring->tail + 1) & ring->mask;
+    return true;
+}
+
+// Only the consumer may clear the buffer
+static inline void ring_buffer_clear(ring_buffer_t *ring) {
+    ring->tail = ring->head;
+}
+
+#endif // RING_BUFFER_H
@@ -0,0 +1,59 @@
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include <stdint.h>
+#include <millis.h>
+#include "common.h"
+#include "xmem.h"
+#include "image_cache.h"
+
+// Storage backend for the serial monitor history, selected at build time
+// with -D SCROLLBACK_BACKEND=...
+#define SCROLLBACK_BACKEND_INTERNAL 0
+// External SRAM, see xmem.h
+#define SCROLLBACK_BACKEND_XMEM 1
+
+#ifndef SCROLLBACK_BACKEND
+#define SCROLLBACK_BACKEND SCROLLBACK_BACKEND_INTERNAL
+#endif
+
+#define SCROLLBACK_COLS DISPLAY_VISIBLE_COLS
+
+typedef struct {
+    // Time at which the first byte of the row was received
+    millis_t timestamp;
+    char chars[SCROLLBACK_COLS];
+} scrollback_row_t;
+
+#if SCROLLBACK_BACKEND == SCROLLBACK_BACKEND_XMEM
+
+// Row count is not a power of two
+#define SCROLLBACK_XMEM_START XMEM_START
+#if IMAGE_CACHE_BACKEND == IMAGE_CACHE_BACKEND_XMEM
+#define SCROLLBACK_XMEM_END (XMEM_SHARED_SPLIT - 1)
+#else
+#define SCROLLBACK_XMEM_END XMEM_END
+#endif
+#define SCROLLBACK_ROWS ((scrollback_index_t)((SCROLLBACK_XMEM_END - SCROLLBACK_XMEM_START + 1) / sizeof(scrollback_row_t)))
+
+typedef uint16_t scrollback_index_t;
+
+#elif SCROLLBACK_BACKEND == SCROLLBACK_BACKEND_INTERNAL
+
+#define SCROLLBACK_ROWS 16
+
+typedef uint8_t scrollback_index_t;
+
+#else
+#error "Unknown SCROLLBACK_BACKEND"
+#endif
+
+extern scrollback_row_t *const scrollback_rows;
+
+void scrollback_init(void);
+
+static inline scrollback_row_t *scrollback_get_row(scrollback_index_t row) {
+    return &scrollback_rows[row];
+}
+
+#endif // SCROLLBACK_H
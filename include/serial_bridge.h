@@ -0,0 +1,9 @@
+#ifndef SERIAL_BRIDGE_H
+#define SERIAL_BRIDGE_H
+
+#include <millis.h>
+#include "tick_callback.h"
+
+tick_callback_t switch_to_serial_bridge(void);
+
+#endif // SERIAL_BRIDGE_H
@@ -0,0 +1,17 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "fatfs/ff.h"
+
+// Short description of a FatFs result, fits on an LCD line
+const char *fresult_to_string(FRESULT result);
+
+// (Re)initializes the SD card and mounts its file system. Has to be called
+// before any other FatFs function, calling it again picks up a swapped card.
+FRESULT storage_mount(void);
+
+// Opens the file which has the same base name as name, but a different
+// extension, in the current directory. The extension includes the dot.
+FRESULT storage_open_sibling(FIL *file, const char *name, const char *extension);
+
+#endif // STORAGE_H
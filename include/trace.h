@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Event trace. Trace points put a 6 byte record with a microsecond timestamp
+// into a ring in RAM, which is sent over USART0 in binary on request and laid
+// out on a timeline by tools/trace_view.py. Built in with -D TRACE_ENABLED=1,
+// without it the trace points compile to nothing.
+//
+// Commands, one character each:
+//   t  send the records and start over with an empty ring
+//   c  drop the records
+//
+// The dump is the header "TRC1", the record count and the count of events
+// dropped while the previous dump was sent, both 16-bit, followed by the
+// records from the oldest one. A record is the timestamp in microseconds,
+// 16-bit, the event and a 24-bit argument, everything little endian. The
+// timestamp wraps every 65.5 ms, the main loop tick comes often enough to
+// unwrap it.
+//
+// The serial bridge takes over USART0 while it runs.
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+#define TRACE_RECORDS 128
+
+typedef enum {
+    TRACE_TICK_START = 1,
+    TRACE_TICK_END,
+    // The argument is the command index
+    TRACE_SD_COMMAND_START,
+    // The argument is the sd_error_t result
+    TRACE_SD_COMMAND_END,
+    // The argument is the LBA
+    TRACE_DISK_READ_START,
+    // The argument is the DRESULT
+    TRACE_DISK_READ_END,
+    TRACE_LCD_FLUSH_START,
+    TRACE_LCD_FLUSH_END,
+    // The argument is the byte address of the page
+    TRACE_UPLOAD_PAGE_SENT,
+    TRACE_UPLOAD_PAGE_ACKED
+} trace_event_t;
+
+#if TRACE_ENABLED
+
+void trace_event(trace_event_t event, uint32_t argument);
+// Answers commands and sends the records, called from the main loop
+void trace_poll(void);
+
+#else
+
+static inline void trace_event(trace_event_t event, uint32_t argument) {
+}
+
+static inline void trace_poll(void) {
+}
+
+#endif
+
+#endif // TRACE_H
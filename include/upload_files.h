@@ -0,0 +1,16 @@
+#ifndef UPLOAD_FILES_H
+#define UPLOAD_FILES_H
+
+#include <stdbool.h>
+#include "fatfs/ff.h"
+#include "uploader.h"
+
+// Gathers what belongs to the image picked in the file picker: its format,
+// the optional .part file naming the target and the optional .eep EEPROM
+// image. On failure, title and message describe the problem for the display.
+bool upload_files_prepare(FIL *file, upload_mode_t mode, upload_config_t *config, const char **title, const char **message);
+
+// Closes the EEPROM image once no upload needs it anymore
+void upload_files_close(void);
+
+#endif // UPLOAD_FILES_H
@@ -0,0 +1,70 @@
+#ifndef UPLOADER_H
+#define UPLOADER_H
+
+#include <stdint.h>
+#include "fatfs/ff.h"
+#include "avr_parts.h"
+#include "page_reader.h"
+
+typedef enum {
+    // Chip erase, then write every page with data
+    UPLOAD_MODE_FULL = 0,
+    // No chip erase, pages are read back and only written, and verified,
+    // when they differ
+    UPLOAD_MODE_CHANGES
+} upload_mode_t;
+
+typedef enum {
+    UPLOAD_IN_PROGRESS = 0,
+    UPLOAD_DONE,
+    UPLOAD_FAILED
+} upload_result_t;
+
+typedef struct {
+    FIL *flash_file;
+    image_format_t flash_format;
+    // FAT date and time of the flash image, used to tell if it is cached
+    uint32_t flash_timestamp;
+    // NULL without an EEPROM image, which has to be a HEX file
+    FIL *eeprom_file;
+    upload_mode_t mode;
+    // The target has to be this part, without one it only has to be big
+    // enough for the image
+    const avr_part_t *expected_part;
+} upload_config_t;
+
+#define UPLOADER_ETA_UNKNOWN UINT16_MAX
+#define UPLOADER_ETA_MAX_SECONDS 999
+
+// Flashes an image through the AVR109 bootloader and verifies it, followed
+// by the EEPROM image if there is one. The upload is driven by calling
+// uploader_step until it stops returning UPLOAD_IN_PROGRESS. Each call does
+// as much as it can without waiting for the target, so it can be called from
+// the idle loop.
+void uploader_start(const upload_config_t *config);
+upload_result_t uploader_step(void);
+// The upload fails once the command which is running has finished
+void uploader_abort(void);
+
+// Short description of what the upload is doing right now
+const char *uploader_get_activity(void);
+
+// Part found by its signature, NULL until then or if it is not known
+const avr_part_t *uploader_get_part(void);
+const char *uploader_get_programmer_id(void);
+
+// Only valid after the upload failed
+const char *uploader_get_error(void);
+
+uint16_t uploader_get_written_pages(void);
+// Blank pages and, in UPLOAD_MODE_CHANGES, pages which already matched
+uint16_t uploader_get_skipped_pages(void);
+// Pages which had to be sent again after a timeout or a missing acknowledgment
+uint16_t uploader_get_retries(void);
+// Percentage of the current image file which has been processed in the
+// current pass
+uint8_t uploader_get_progress(void);
+// Seconds left in the current pass, or UPLOADER_ETA_UNKNOWN
+uint16_t uploader_get_eta_seconds(void);
+
+#endif // UPLOADER_H
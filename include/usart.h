@@ -0,0 +1,50 @@
+#ifndef USART_H
+#define USART_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define USART_RX_BUFFER_SIZE 64
+#define USART_TX_BUFFER_SIZE 128
+
+// The drain handler is called once the TX buffer empties down to this level
+#define USART_TX_DRAIN_LEVEL (USART_TX_BUFFER_SIZE / 4)
+
+typedef enum {
+    USART_PORT_0 = 0,
+    USART_PORT_1,
+    USART_PORT_COUNT
+} usart_port_t;
+
+// Handlers are called from the USART interrupts
+typedef void (*usart_rx_handler_t)(uint8_t byte);
+typedef void (*usart_tx_drain_handler_t)(void);
+
+void usart_init(void);
+
+// Values are the raw UCSZ, USBS and UPM register fields
+void usart_configure(usart_port_t port, uint16_t ubrr, bool double_speed, uint8_t character_size, uint8_t stop_bits, uint8_t parity);
+
+void usart_start_receive(usart_port_t port);
+void usart_stop_receive(usart_port_t port);
+void usart_start_transmit(usart_port_t port);
+void usart_stop_transmit(usart_port_t port);
+
+// Also used as a critical section against the RX handler
+void usart_enable_rx_interrupt(usart_port_t port);
+void usart_disable_rx_interrupt(usart_port_t port);
+
+// Without a handler, received bytes are queued for usart_read_byte
+void usart_set_rx_handler(usart_port_t port, usart_rx_handler_t handler);
+void usart_set_tx_drain_handler(usart_port_t port, usart_tx_drain_handler_t handler);
+
+bool usart_read_byte(usart_port_t port, uint8_t *byte);
+void usart_clear_rx(usart_port_t port);
+
+// Returns false when the TX buffer is full
+bool usart_write_byte(usart_port_t port, uint8_t byte);
+// Sent before any buffered data, used for XON/XOFF flow control
+void usart_write_control_byte(usart_port_t port, uint8_t byte);
+uint8_t usart_tx_buffered(usart_port_t port);
+
+#endif // USART_H
@@ -15,6 +15,7 @@
 
 #define u8max(a, b) ((a) > (b) ? (a) : (b))
 #define u8min(a, b) ((a) < (b) ? (a) : (b))
+#define u32min(a, b) ((a) < (b) ? (a) : (b))
 
 #define set_bit(byte, bit) ((byte) | _BV(bit))
 #define clear_bit(byte, bit) ((byte) & ~_BV(bit))
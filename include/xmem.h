@@ -0,0 +1,19 @@
+#ifndef XMEM_H
+#define XMEM_H
+
+// External SRAM on the XMEM bus. The bus takes over PORTA, PORTC and PG0-PG2,
+// so it can only be used on boards which have the buttons and the display
+// wired to other pins. Whatever is built to live there shares the range.
+
+// Everything above the internal SRAM
+#define XMEM_START 0x1100UL
+#define XMEM_END 0xFFFFUL
+
+// With both in XMEM, the scrollback keeps the first 16 KB and the image cache
+// gets the rest
+#define XMEM_SHARED_SPLIT 0x5100UL
+
+// Enables the bus, can be called more than once
+void xmem_init(void);
+
+#endif // XMEM_H
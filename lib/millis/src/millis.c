@@ -44,8 +44,11 @@
 #define REG_TCCRB		TCCR0
 #define REG_TIMSK		TIMSK
 #define REG_OCR			OCR0
+#define REG_TCNT		TCNT0
+#define REG_TIFR		TIFR
 #define BIT_WGM			WGM01
 #define BIT_OCIE		OCIE0
+#define BIT_OCF			OCF0
 #ifdef TIMER0_COMP_vect
 	#define ISR_VECT		TIMER0_COMP_vect
 #else
@@ -69,8 +72,11 @@
 #define REG_TCCRB		TCCR1
 #define REG_TIMSK		TIMSK
 #define REG_OCR			OCR1
+#define REG_TCNT		TCNT1
+#define REG_TIFR		TIFR
 #define BIT_WGM			WGM12
 #define BIT_OCIE		OCIE1
+#define BIT_OCF			OCF1
 #ifdef TIMER1_COMP_vect
 	#define ISR_VECT		TIMER1_COMP_vect
 #else
@@ -104,8 +110,11 @@
 #define REG_TCCRB		TCCR2
 #define REG_TIMSK		TIMSK
 #define REG_OCR			OCR2
+#define REG_TCNT		TCNT2
+#define REG_TIFR		TIFR
 #define BIT_WGM			WGM21
 #define BIT_OCIE		OCIE2
+#define BIT_OCF			OCF2
 #define ISR_VECT		TIMER2_COMP_vect
 #define pwr_enable()	power_timer2_enable()
 #define pwr_disable()	power_timer2_disable()
@@ -117,7 +126,17 @@
 	#error "Bad MILLIS_TIMER set"
 #endif
 
+// Timer counts to microseconds, without a division when a count is a whole
+// number of microseconds
+#if (PRESCALER * 1000000UL) % F_CPU == 0
+	#define TICKS_TO_MICROS(ticks) ((micros_t)(ticks) * (PRESCALER * 1000000UL / F_CPU))
+#else
+	#define TICKS_TO_MICROS(ticks) ((micros_t)(ticks) * (PRESCALER * 1000UL) / (F_CPU / 1000UL))
+#endif
+
 static volatile millis_t milliseconds;
+// Kept apart from milliseconds, which can be changed and wraps much earlier
+static volatile micros_t microseconds;
 
 // Initialise library
 void millis_init()
@@ -140,6 +159,24 @@ millis_t millis_get()
 	return ms;
 }
 
+// Get current microseconds
+micros_t micros_get()
+{
+	micros_t us;
+	unsigned int ticks;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		us = microseconds;
+		ticks = REG_TCNT;
+		// The counter went back to 0 after a compare match whose interrupt has
+		// not run yet. A set flag with the counter still on the compare value
+		// means the match came after the counter was read.
+		if((REG_TIFR & _BV(BIT_OCF)) && ticks < REG_OCR)
+			us += 1000;
+	}
+	return us + TICKS_TO_MICROS(ticks);
+}
+
 // Turn on timer and resume time keeping
 void millis_resume()
 {
@@ -182,4 +219,5 @@ void millis_subtract(millis_t ms)
 ISR(ISR_VECT)
 {
 	++milliseconds;
+	microseconds += 1000;
 }
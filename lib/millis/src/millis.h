@@ -19,6 +19,11 @@
 */
 typedef unsigned int millis_t;
 
+/**
+* Microseconds data type, wraps every 71.58 minutes
+*/
+typedef unsigned long micros_t;
+
 #define MILLIS_TIMER0 0 /**< Use timer0. */
 #define MILLIS_TIMER1 1 /**< Use timer1. */
 #define MILLIS_TIMER2 2 /**< Use timer2. */
@@ -34,6 +39,13 @@ typedef unsigned int millis_t;
 * @note Not availble for Arduino since millis() is already used.
 */
 	#define millis() millis_get()
+
+/**
+* Alias of micros_get().
+*
+* @note Not availble for Arduino since micros() is already used.
+*/
+	#define micros() micros_get()
 #endif
 
 #ifdef __cplusplus
@@ -54,6 +66,19 @@ void millis_init(void);
 */
 millis_t millis_get(void);
 
+/**
+* Get microseconds, from the millisecond interrupt and the current timer count.
+*
+* The resolution is one timer count, 4 microseconds at 16MHz. Unlike the
+* milliseconds, it is not changed by millis_reset(), millis_add() and
+* millis_subtract(), so the difference of two readings is always the time
+* in between. Can be called with interrupts disabled, as long as they are
+* not disabled for over a millisecond.
+*
+* @return Microseconds.
+*/
+micros_t micros_get(void);
+
 /**
 * Turn on timer and resume time keeping.
 *
@@ -0,0 +1,360 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <util/atomic.h>
+#include <millis.h>
+#include "avr109_driver.h"
+#include "usart.h"
+#include "util.h"
+
+#define AVR109_USART USART_PORT_1
+
+#define COMMAND_ENTER_PROGRAMMING_MODE 'P'
+#define COMMAND_LEAVE_PROGRAMMING_MODE 'L'
+#define COMMAND_EXIT_BOOTLOADER 'E'
+#define COMMAND_CHIP_ERASE 'e'
+#define COMMAND_CHECK_BLOCK_SUPPORT 'b'
+#define COMMAND_SET_ADDRESS 'A'
+#define COMMAND_WRITE_BLOCK 'B'
+#define COMMAND_READ_BLOCK 'g'
+#define COMMAND_SOFTWARE_IDENTIFIER 'S'
+#define COMMAND_READ_SIGNATURE 's'
+#define COMMAND_READ_DEVICE_CODES 't'
+#define COMMAND_SYNC 0x1B
+
+#define RESPONSE_ACK '\r'
+#define RESPONSE_YES 'Y'
+
+#define MAX_ADDRESS 0xFFFF
+
+// Longest command header, 'B' followed by the size and the memory type
+#define MAX_COMMAND_HEADER_SIZE 4
+// 'Y' followed by the block size
+#define BLOCK_SUPPORT_RESPONSE_LENGTH 3
+// The target is considered idle once it stayed silent this long
+#define RESYNC_QUIET_MS 50
+
+typedef enum {
+    RESPONSE_TYPE_ACK,
+    RESPONSE_TYPE_BLOCK_SUPPORT,
+    RESPONSE_TYPE_COMPARE,
+    RESPONSE_TYPE_STORE,
+    // The signature is sent starting with its last byte
+    RESPONSE_TYPE_SIGNATURE,
+    // Zero terminated list of unknown length
+    RESPONSE_TYPE_LIST,
+    RESPONSE_TYPE_IGNORE,
+    // Finishes once nothing was received for RESYNC_QUIET_MS
+    RESPONSE_TYPE_QUIET
+} response_type_t;
+
+static struct {
+    uint8_t header[MAX_COMMAND_HEADER_SIZE];
+    uint8_t header_length;
+    uint8_t header_sent;
+    // Without a payload pointer, sync bytes are sent instead
+    const uint8_t *payload;
+    uint16_t payload_length;
+    uint16_t payload_sent;
+    response_type_t response_type;
+    uint16_t response_length;
+    uint16_t response_received;
+    const uint8_t *expected;
+    uint8_t *response;
+    uint16_t *mismatch_offset;
+    uint16_t *block_size;
+    // The quiet period of a resync is followed by the identifier request
+    bool resyncing;
+    millis_t timeout;
+    millis_t last_activity_time;
+    // Set once the whole command is queued, the response is taken from then on
+    volatile bool listening;
+    volatile bool byte_received;
+    volatile avr109_error_t result;
+} command;
+
+static void start_command(uint8_t command_byte, response_type_t response_type, uint16_t response_length, millis_t timeout) {
+    command.listening = false;
+    command.header[0] = command_byte;
+    command.header_length = 1;
+    command.header_sent = 0;
+    command.payload = NULLPTR;
+    command.payload_length = 0;
+    command.payload_sent = 0;
+    command.response_type = response_type;
+    command.response_length = response_length;
+    command.response_received = 0;
+    command.resyncing = false;
+    command.timeout = timeout;
+    command.last_activity_time = millis();
+    command.result = AVR109_ERROR_PENDING;
+}
+
+static void add_header_byte(uint8_t byte) {
+    command.header[command.header_length++] = byte;
+}
+
+static void add_header_word(uint16_t word) {
+    add_header_byte(word >> 8);
+    add_header_byte(word);
+}
+
+static void start_ack_command(uint8_t command_byte, millis_t timeout) {
+    start_command(command_byte, RESPONSE_TYPE_ACK, 1, timeout);
+}
+
+// Queues as much of the command as the TX buffer takes
+static void send_pending_bytes() {
+    while (command.header_sent < command.header_length) {
+        if (!usart_write_byte(AVR109_USART, command.header[command.header_sent])) {
+            return;
+        }
+        command.header_sent++;
+        command.last_activity_time = millis();
+    }
+
+    while (command.payload_sent < command.payload_length) {
+        uint8_t byte = command.payload != NULLPTR ? command.payload[command.payload_sent] : COMMAND_SYNC;
+        if (!usart_write_byte(AVR109_USART, byte)) {
+            return;
+        }
+        command.payload_sent++;
+        command.last_activity_time = millis();
+    }
+}
+
+static inline bool all_bytes_sent() {
+    return command.header_sent == command.header_length && command.payload_sent == command.payload_length;
+}
+
+static void finish_response() {
+    if (command.resyncing) {
+        start_command(COMMAND_SOFTWARE_IDENTIFIER, RESPONSE_TYPE_IGNORE, AVR109_PROGRAMMER_ID_LENGTH, AVR109_RESPONSE_TIMEOUT_MS);
+    } else {
+        command.result = AVR109_ERROR_OK;
+    }
+}
+
+static void receive_response_byte(uint8_t byte) {
+    uint16_t index = command.response_received++;
+
+    switch (command.response_type) {
+        case RESPONSE_TYPE_ACK:
+            if (byte != RESPONSE_ACK) {
+                command.result = AVR109_ERROR_NO_ACK;
+            }
+            break;
+        case RESPONSE_TYPE_BLOCK_SUPPORT:
+            // Bootloaders without block support answer with '?'
+            if (index == 0 && byte != RESPONSE_YES) {
+                command.result = AVR109_ERROR_NO_BLOCK_SUPPORT;
+            } else if (index == 1) {
+                *command.block_size = (uint16_t)byte << 8;
+            } else if (index == 2) {
+                *command.block_size |= byte;
+            }
+            break;
+        case RESPONSE_TYPE_COMPARE:
+            // The whole block has to be received even after a mismatch
+            if (byte != command.expected[index] && *command.mismatch_offset == command.response_length) {
+                *command.mismatch_offset = index;
+            }
+            break;
+        case RESPONSE_TYPE_STORE:
+            command.response[index] = byte;
+            break;
+        case RESPONSE_TYPE_SIGNATURE:
+            command.response[command.response_length - 1 - index] = byte;
+            break;
+        case RESPONSE_TYPE_LIST:
+            // Entries which don't fit are dropped, the terminator always fits
+            if (index < command.response_length - 1) {
+                command.response[index] = byte;
+            } else if (byte == 0) {
+                command.response[command.response_length - 1] = 0;
+            }
+
+            if (byte == 0) {
+                command.result = AVR109_ERROR_OK;
+            }
+            break;
+        case RESPONSE_TYPE_IGNORE:
+        case RESPONSE_TYPE_QUIET:
+        default:
+            break;
+    }
+}
+
+// Called from the USART RX interrupt. Block reads come in while the main loop
+// is busy with the LCD, faster than the RX buffer could hold them at high
+// baud rates, so the response is taken apart right here.
+static void receive_byte(uint8_t byte) {
+    command.byte_received = true;
+
+    if (!command.listening || command.result != AVR109_ERROR_PENDING || command.response_type == RESPONSE_TYPE_QUIET) {
+        return;
+    }
+
+    receive_response_byte(byte);
+
+    // Lists end with their terminator instead of after a fixed length
+    bool complete = command.response_type != RESPONSE_TYPE_LIST && command.response_received == command.response_length;
+    if (command.result == AVR109_ERROR_PENDING && complete) {
+        finish_response();
+    }
+}
+
+const char *avr109_error_to_string(avr109_error_t error) {
+    switch (error) {
+        case AVR109_ERROR_OK:
+            return "Target OK";
+        case AVR109_ERROR_PENDING:
+            return "Target busy";
+        case AVR109_ERROR_TIMEOUT:
+            return "Target timeout";
+        case AVR109_ERROR_NO_ACK:
+            return "Target no ACK";
+        case AVR109_ERROR_NO_BLOCK_SUPPORT:
+            return "No block mode";
+        case AVR109_ERROR_ADDRESS_RANGE:
+            return "Address too high";
+        default:
+            return "Unknown error";
+    }
+}
+
+void avr109_begin() {
+    command.listening = false;
+    usart_set_rx_handler(AVR109_USART, &receive_byte);
+    usart_clear_rx(AVR109_USART);
+    usart_start_transmit(AVR109_USART);
+    usart_start_receive(AVR109_USART);
+
+    command.result = AVR109_ERROR_OK;
+}
+
+void avr109_end() {
+    usart_stop_receive(AVR109_USART);
+    usart_stop_transmit(AVR109_USART);
+    usart_set_rx_handler(AVR109_USART, NULLPTR);
+}
+
+avr109_error_t avr109_poll() {
+    avr109_error_t result;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        result = command.result;
+    }
+    if (result != AVR109_ERROR_PENDING) {
+        return result;
+    }
+
+    send_pending_bytes();
+    if (!all_bytes_sent()) {
+        return AVR109_ERROR_PENDING;
+    }
+    command.listening = true;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (command.byte_received) {
+            command.byte_received = false;
+            command.last_activity_time = millis();
+        }
+        result = command.result;
+    }
+    if (result != AVR109_ERROR_PENDING) {
+        return result;
+    }
+
+    millis_t idle_time = millis() - command.last_activity_time;
+    if (command.response_type == RESPONSE_TYPE_QUIET && idle_time >= RESYNC_QUIET_MS) {
+        finish_response();
+    } else if (idle_time >= command.timeout) {
+        // The last byte might have just come in
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (command.result == AVR109_ERROR_PENDING) {
+                command.listening = false;
+                command.result = AVR109_ERROR_TIMEOUT;
+            }
+        }
+    }
+
+    return command.result;
+}
+
+static void start_store_command(uint8_t command_byte, response_type_t response_type, uint8_t *response, uint16_t response_length) {
+    start_command(command_byte, response_type, response_length, AVR109_RESPONSE_TIMEOUT_MS);
+    command.response = response;
+}
+
+void avr109_read_programmer_id(char *programmer_id) {
+    start_store_command(COMMAND_SOFTWARE_IDENTIFIER, RESPONSE_TYPE_STORE, (uint8_t *)programmer_id, AVR109_PROGRAMMER_ID_LENGTH);
+    programmer_id[AVR109_PROGRAMMER_ID_LENGTH] = '\0';
+}
+
+void avr109_read_device_codes(uint8_t *device_codes, uint8_t buffer_size) {
+    start_store_command(COMMAND_READ_DEVICE_CODES, RESPONSE_TYPE_LIST, device_codes, buffer_size);
+    device_codes[0] = 0;
+}
+
+void avr109_read_signature(uint8_t *signature) {
+    start_store_command(COMMAND_READ_SIGNATURE, RESPONSE_TYPE_SIGNATURE, signature, AVR109_SIGNATURE_SIZE);
+}
+
+void avr109_enter_programming_mode() {
+    start_ack_command(COMMAND_ENTER_PROGRAMMING_MODE, AVR109_RESPONSE_TIMEOUT_MS);
+}
+
+void avr109_leave_programming_mode() {
+    start_ack_command(COMMAND_LEAVE_PROGRAMMING_MODE, AVR109_RESPONSE_TIMEOUT_MS);
+}
+
+void avr109_exit_bootloader() {
+    start_ack_command(COMMAND_EXIT_BOOTLOADER, AVR109_RESPONSE_TIMEOUT_MS);
+}
+
+void avr109_chip_erase() {
+    start_ack_command(COMMAND_CHIP_ERASE, AVR109_ERASE_TIMEOUT_MS);
+}
+
+void avr109_get_block_size(uint16_t *block_size) {
+    start_command(COMMAND_CHECK_BLOCK_SUPPORT, RESPONSE_TYPE_BLOCK_SUPPORT, BLOCK_SUPPORT_RESPONSE_LENGTH, AVR109_RESPONSE_TIMEOUT_MS);
+    command.block_size = block_size;
+}
+
+void avr109_set_address(uint32_t address) {
+    start_ack_command(COMMAND_SET_ADDRESS, AVR109_RESPONSE_TIMEOUT_MS);
+    add_header_word(address);
+
+    if (address > MAX_ADDRESS) {
+        command.result = AVR109_ERROR_ADDRESS_RANGE;
+    }
+}
+
+// The bootloader erases and programs the page before it acknowledges
+void avr109_write_block(avr109_memory_t memory, const uint8_t *data, uint16_t size) {
+    start_ack_command(COMMAND_WRITE_BLOCK, AVR109_RESPONSE_TIMEOUT_MS);
+    add_header_word(size);
+    add_header_byte(memory);
+
+    command.payload = data;
+    command.payload_length = size;
+}
+
+void avr109_compare_block(avr109_memory_t memory, const uint8_t *expected, uint16_t size, uint16_t *mismatch_offset) {
+    start_command(COMMAND_READ_BLOCK, RESPONSE_TYPE_COMPARE, size, AVR109_RESPONSE_TIMEOUT_MS);
+    add_header_word(size);
+    add_header_byte(memory);
+
+    command.expected = expected;
+    command.mismatch_offset = mismatch_offset;
+    *mismatch_offset = size;
+}
+
+// A command cut short by lost bytes leaves the bootloader waiting for the rest
+// of it. ESC is not answered when received as a command, so enough of them
+// complete any unfinished block and the rest are ignored. The software
+// identifier then confirms that commands are understood again.
+void avr109_resync(uint16_t block_size) {
+    start_command(COMMAND_SYNC, RESPONSE_TYPE_QUIET, 0, AVR109_RESPONSE_TIMEOUT_MS);
+    command.payload_length = block_size + MAX_COMMAND_HEADER_SIZE;
+    command.resyncing = true;
+}
@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <string.h>
+#include "avr_parts.h"
+#include "util.h"
+
+#define KIB(size) ((uint32_t)(size) * 1024)
+
+static const avr_part_t avr_parts[] = {
+    {"ATmega8", {0x1E, 0x93, 0x07}, 0x76, KIB(8), 512},
+    {"ATmega16", {0x1E, 0x94, 0x03}, 0x74, KIB(16), 512},
+    {"ATmega16U2", {0x1E, 0x94, 0x89}, 0x00, KIB(16), 512},
+    {"ATmega168", {0x1E, 0x94, 0x06}, 0x00, KIB(16), 512},
+    {"ATmega32", {0x1E, 0x95, 0x02}, 0x72, KIB(32), 1024},
+    {"ATmega32U4", {0x1E, 0x95, 0x87}, 0x44, KIB(32), 1024},
+    {"ATmega328P", {0x1E, 0x95, 0x0F}, 0x00, KIB(32), 1024},
+    {"ATmega64", {0x1E, 0x96, 0x02}, 0x45, KIB(64), 2048},
+    {"ATmega644P", {0x1E, 0x96, 0x0A}, 0x00, KIB(64), 2048},
+    {"ATmega128", {0x1E, 0x97, 0x02}, 0x43, KIB(128), 4096},
+    {"ATmega1284P", {0x1E, 0x97, 0x05}, 0x00, KIB(128), 4096},
+    {"ATmega2560", {0x1E, 0x98, 0x01}, 0x00, KIB(256), 4096},
+};
+static const uint8_t avr_part_count = sizeof(avr_parts) / sizeof(avr_part_t);
+
+const avr_part_t *avr_parts_find_by_signature(const uint8_t *signature) {
+    for (uint8_t i = 0; i < avr_part_count; i++) {
+        if (memcmp(avr_parts[i].signature, signature, AVR_SIGNATURE_SIZE) == 0) {
+            return &avr_parts[i];
+        }
+    }
+
+    return NULLPTR;
+}
+
+const avr_part_t *avr_parts_find_by_device_codes(const uint8_t *device_codes) {
+    for (; *device_codes != 0; device_codes++) {
+        for (uint8_t i = 0; i < avr_part_count; i++) {
+            if (avr_parts[i].device_code == *device_codes) {
+                return &avr_parts[i];
+            }
+        }
+    }
+
+    return NULLPTR;
+}
+
+const avr_part_t *avr_parts_find_by_name(const char *name) {
+    for (uint8_t i = 0; i < avr_part_count; i++) {
+        if (strcasecmp(avr_parts[i].name, name) == 0) {
+            return &avr_parts[i];
+        }
+    }
+
+    return NULLPTR;
+}
@@ -0,0 +1,153 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "fatfs/ff.h"
+#include "binary_image.h"
+
+#define ELF_HEADER_SIZE 52
+#define ELF_IDENT_CLASS 4
+#define ELF_IDENT_DATA 5
+#define ELF_CLASS_32 1
+#define ELF_DATA_LITTLE_ENDIAN 1
+#define ELF_MACHINE_OFFSET 18
+#define ELF_PROGRAM_HEADER_OFFSET_OFFSET 28
+#define ELF_PROGRAM_HEADER_SIZE_OFFSET 42
+#define ELF_PROGRAM_HEADER_COUNT_OFFSET 44
+#define ELF_MACHINE_AVR 83
+
+#define PROGRAM_HEADER_SIZE 32
+#define PROGRAM_HEADER_TYPE_OFFSET 0
+#define PROGRAM_HEADER_FILE_OFFSET_OFFSET 4
+#define PROGRAM_HEADER_PHYSICAL_ADDRESS_OFFSET 12
+#define PROGRAM_HEADER_FILE_SIZE_OFFSET 16
+#define PROGRAM_TYPE_LOAD 1
+
+// avr-gcc puts RAM, EEPROM and fuses into their own address ranges above the
+// flash, a segment's physical address is where its data is stored in flash
+#define ELF_FLASH_END 0x800000UL
+
+static const uint8_t elf_magic[] = {0x7F, 'E', 'L', 'F'};
+
+static inline uint16_t get_u16(const uint8_t *bytes) {
+    return bytes[0] | ((uint16_t)bytes[1] << 8);
+}
+
+static inline uint32_t get_u32(const uint8_t *bytes) {
+    return get_u16(bytes) | ((uint32_t)get_u16(bytes + 2) << 16);
+}
+
+static binary_image_result_t read_at(binary_image_t *image, uint32_t offset, uint8_t *buffer, uint16_t length) {
+    UINT read;
+
+    // Reads within a segment follow each other, so this seeks once per segment
+    if (f_tell(image->file) != offset && f_lseek(image->file, offset) != FR_OK) {
+        return BINARY_IMAGE_ERROR_READ;
+    }
+
+    if (f_read(image->file, buffer, length, &read) != FR_OK || read != length) {
+        return BINARY_IMAGE_ERROR_READ;
+    }
+
+    return BINARY_IMAGE_OK;
+}
+
+static binary_image_result_t read_elf_header(binary_image_t *image) {
+    uint8_t header[ELF_HEADER_SIZE];
+
+    binary_image_result_t result = read_at(image, 0, header, ELF_HEADER_SIZE);
+    if (result == BINARY_IMAGE_ERROR_READ) {
+        return BINARY_IMAGE_ERROR_NOT_ELF;
+    }
+
+    if (memcmp(header, elf_magic, sizeof(elf_magic)) != 0
+        || header[ELF_IDENT_CLASS] != ELF_CLASS_32
+        || header[ELF_IDENT_DATA] != ELF_DATA_LITTLE_ENDIAN) {
+        return BINARY_IMAGE_ERROR_NOT_ELF;
+    }
+
+    if (get_u16(header + ELF_MACHINE_OFFSET) != ELF_MACHINE_AVR) {
+        return BINARY_IMAGE_ERROR_WRONG_MACHINE;
+    }
+
+    image->program_header_offset = get_u32(header + ELF_PROGRAM_HEADER_OFFSET_OFFSET);
+    image->program_header_size = get_u16(header + ELF_PROGRAM_HEADER_SIZE_OFFSET);
+    image->program_header_count = get_u16(header + ELF_PROGRAM_HEADER_COUNT_OFFSET);
+
+    if (image->program_header_size < PROGRAM_HEADER_SIZE) {
+        return BINARY_IMAGE_ERROR_NOT_ELF;
+    }
+
+    return BINARY_IMAGE_OK;
+}
+
+static binary_image_result_t next_elf_segment(binary_image_t *image) {
+    uint8_t header[PROGRAM_HEADER_SIZE];
+
+    while (image->next_program_header < image->program_header_count) {
+        uint32_t offset = image->program_header_offset + (uint32_t)image->next_program_header * image->program_header_size;
+        image->next_program_header++;
+
+        binary_image_result_t result = read_at(image, offset, header, PROGRAM_HEADER_SIZE);
+        if (result != BINARY_IMAGE_OK) {
+            return result;
+        }
+
+        uint32_t address = get_u32(header + PROGRAM_HEADER_PHYSICAL_ADDRESS_OFFSET);
+        if (get_u32(header + PROGRAM_HEADER_TYPE_OFFSET) != PROGRAM_TYPE_LOAD || address >= ELF_FLASH_END) {
+            continue;
+        }
+
+        image->file_offset = get_u32(header + PROGRAM_HEADER_FILE_OFFSET_OFFSET);
+        image->address = address;
+        image->remaining = get_u32(header + PROGRAM_HEADER_FILE_SIZE_OFFSET);
+        return BINARY_IMAGE_OK;
+    }
+
+    return BINARY_IMAGE_END;
+}
+
+void binary_image_init(binary_image_t *image, FIL *file, bool elf) {
+    image->file = file;
+    image->elf = elf;
+    image->header_read = false;
+    image->next_program_header = 0;
+    image->remaining = 0;
+}
+
+binary_image_result_t binary_image_next_segment(binary_image_t *image) {
+    bool first = !image->header_read;
+    image->header_read = true;
+
+    if (!image->elf) {
+        if (!first) {
+            return BINARY_IMAGE_END;
+        }
+
+        image->file_offset = 0;
+        image->address = 0;
+        image->remaining = f_size(image->file);
+        return BINARY_IMAGE_OK;
+    }
+
+    if (first) {
+        binary_image_result_t result = read_elf_header(image);
+        if (result != BINARY_IMAGE_OK) {
+            return result;
+        }
+    }
+
+    return next_elf_segment(image);
+}
+
+binary_image_result_t binary_image_read(binary_image_t *image, uint8_t *buffer, uint16_t length) {
+    binary_image_result_t result = read_at(image, image->file_offset, buffer, length);
+    if (result != BINARY_IMAGE_OK) {
+        return result;
+    }
+
+    image->file_offset += length;
+    image->address += length;
+    image->remaining -= length;
+
+    return BINARY_IMAGE_OK;
+}
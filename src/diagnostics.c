@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <millis.h>
+#include "diagnostics.h"
+#include "memory_usage.h"
+#include "tick_callback.h"
+#include "clcd.h"
+#include "buttons.h"
+
+#define REFRESH_INTERVAL_MS 500
+#define VALUE_COLUMN 11
+
+static struct {
+    millis_t last_refresh_time;
+} diagnostics;
+
+static void draw_value(uint8_t row, uint16_t value) {
+    char digits[6];
+
+    clcd_set_cursor_position(VALUE_COLUMN, row);
+    if (value == MEMORY_USAGE_UNKNOWN) {
+        clcd_write_string("-");
+    } else {
+        clcd_write_string(utoa(value, digits, 10));
+    }
+
+    // Clear whatever was left over from a longer previous value
+    clcd_write_string("    ");
+}
+
+// Only the numbers are redrawn, the labels stay
+static void draw_values() {
+    draw_value(0, memory_usage_get_free_ram());
+    draw_value(1, memory_usage_get_min_stack_headroom());
+}
+
+static tick_callback_result_t diagnostics_tick(millis_t current_time) {
+    if (button_was_pressed(BUTTON_BACK)) {
+        return TICK_CALLBACK_FINISHED;
+    }
+
+    if (current_time - diagnostics.last_refresh_time >= REFRESH_INTERVAL_MS) {
+        diagnostics.last_refresh_time = current_time;
+        draw_values();
+    }
+
+    return TICK_CALLBACK_CONTINUE;
+}
+
+tick_callback_t switch_to_diagnostics() {
+    clcd_cursor_off();
+    clcd_clear_display();
+    clcd_return_home();
+    clcd_write_string("Free RAM:");
+    clcd_set_cursor_position(0, 1);
+    clcd_write_string("Stack min:");
+    draw_values();
+
+    diagnostics.last_refresh_time = millis();
+
+    return &diagnostics_tick;
+}
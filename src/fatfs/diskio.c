@@ -20,6 +20,7 @@
 #include "fatfs/diskio.h"		/* Declarations of disk functions */
 #include "sd.h"
 #include "clcd.h"
+#include "trace.h"
 
 static inline DRESULT sd_error_to_result(sd_error_t err) {
 	switch (err) {
@@ -87,8 +88,11 @@ DRESULT disk_read (
 		return RES_PARERR;
 	}
 
-	sd_error_t err = sd_read_block(buff, sector);
-	return sd_error_to_result(err);
+	trace_event(TRACE_DISK_READ_START, sector);
+	DRESULT result = sd_error_to_result(sd_read_block(buff, sector));
+	trace_event(TRACE_DISK_READ_END, result);
+
+	return result;
 }
 
 /*-----------------------------------------------------------------------*/
@@ -16,56 +16,11 @@
 #define BACK_BUTTON_TEXT "- Back"
 #define BACK_BUTTON_ROW 0
 
-static const char* fresult_to_string (FRESULT result) {
-    switch (result) {
-        case FR_OK:
-            return "FS OK";
-        case FR_DISK_ERR:
-            return "Disk Error";
-        case FR_INT_ERR:
-            return "Internal Error";
-        case FR_NOT_READY:
-            return "Not Ready";
-        case FR_NO_FILE:
-            return "No File";
-        case FR_NO_PATH:
-            return "No Path";
-        case FR_INVALID_NAME:
-            return "Invalid Name";
-        case FR_DENIED:
-            return "Denied";
-        case FR_EXIST:
-            return "Exist";
-        case FR_INVALID_OBJECT:
-            return "Invalid Object";
-        case FR_WRITE_PROTECTED:
-            return "Write Protected";
-        case FR_INVALID_DRIVE:
-            return "Invalid Drive";
-        case FR_NOT_ENABLED:
-            return "Not Enabled";
-        case FR_NO_FILESYSTEM:
-            return "No Filesystem";
-        case FR_MKFS_ABORTED:
-            return "MKFS Aborted";
-        case FR_TIMEOUT:
-            return "Timed Out";
-        case FR_LOCKED:
-            return "Locked";
-        case FR_NOT_ENOUGH_CORE:
-            return "Not Enough Core";
-        case FR_TOO_MANY_OPEN_FILES:
-            return "Too Many Files";
-        case FR_INVALID_PARAMETER:
-            return "Invalid Param";
-        default:
-            return "Unknown";
-    }
-}
-
 static struct {
     DIR current_directory;
     FIL selected_file;
+    char selected_name[FF_LFN_BUF + 1];
+    uint32_t selected_timestamp;
     uint8_t current_directory_entry_count;
     uint8_t first_displayed_row;
     uint8_t selected_displayed_row;
@@ -250,7 +205,13 @@ static FRESULT select_directory(FILINFO *file_info) {
 }
 
 static FRESULT select_file(FILINFO *file_info) {
-    // TODO
+    FRESULT f_err = f_open(&state.selected_file, file_info->fname, FA_READ);
+    if (f_err != FR_OK) {
+        return f_err;
+    }
+
+    strcpy(state.selected_name, file_info->fname);
+    state.selected_timestamp = ((uint32_t)file_info->fdate << 16) | file_info->ftime;
     return FR_OK;
 }
 
@@ -265,7 +226,7 @@ static FRESULT select_back_button() {
 
 static FRESULT select_option() {
     if(get_selected_row() == BACK_BUTTON_ROW) {
-        select_back_button();
+        return select_back_button();
     }
 
     FILINFO file_info;
@@ -289,7 +250,12 @@ FRESULT file_picker_tick(tick_callback_result_t *result) {
     } else if (button_was_pressed(BUTTON_DOWN)) {
         return scroll_down();
     } else if (button_was_pressed(BUTTON_SELECT)) {
-        return select_option();
+        FRESULT f_err = select_option();
+        // The picker is done once a file was opened
+        if (file_is_valid(&state.selected_file)) {
+            *result = TICK_CALLBACK_FINISHED;
+        }
+        return f_err;
     } else if (button_was_pressed(BUTTON_BACK)) {
         *result = TICK_CALLBACK_FINISHED;
     }
@@ -300,6 +266,10 @@ FRESULT file_picker_tick(tick_callback_result_t *result) {
 FRESULT start_file_picker() {
     FRESULT f_err;
 
+    if (file_is_valid(&state.selected_file)) {
+        f_close(&state.selected_file);
+    }
+
     f_err = move_to_directory("/");
     if (f_err != FR_OK) {
         return f_err;
@@ -320,3 +290,11 @@ FIL *file_picker_get_selected_file() {
 
     return current_file;
 }
+
+const char *file_picker_get_selected_name() {
+    return state.selected_name;
+}
+
+uint32_t file_picker_get_selected_timestamp() {
+    return state.selected_timestamp;
+}
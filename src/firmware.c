@@ -0,0 +1,41 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <millis.h>
+#include "firmware.h"
+#include "clcd.h"
+#include "buttons.h"
+#include "usart.h"
+#include "main_menu.h"
+#include "usart_settings.h"
+#include "serial_monitor.h"
+#include "image_cache.h"
+#include "profiler.h"
+#include "trace.h"
+
+void firmware_setup() {
+    clcd_init(FOUR_BIT, TWO_LINE, FONT_5x8);
+    buttons_init();
+    main_menu_init();
+    usart_init();
+    serial_monitor_init();
+    usart_settings_init();
+    image_cache_init();
+    millis_init();
+    profiler_init();
+    sei();
+
+    switch_to_main_menu();
+}
+
+void firmware_tick(millis_t current_time) {
+    trace_event(TRACE_TICK_START, current_time);
+    buttons_poll();
+    main_menu_tick(current_time);
+    trace_event(TRACE_TICK_END, current_time);
+}
+
+void firmware_poll(millis_t current_time) {
+    main_menu_run_background_task(current_time);
+    profiler_poll();
+    trace_poll();
+}
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <millis.h>
+#include "fatfs/ff.h"
+#include "flash_program.h"
+#include "tick_callback.h"
+#include "file_picker.h"
+#include "storage.h"
+#include "uploader.h"
+#include "upload_files.h"
+#include "avr_parts.h"
+#include "clcd.h"
+#include "util.h"
+#include "buttons.h"
+#include "main_menu.h"
+
+typedef enum {
+    FLASH_STATE_PICKING_FILE,
+    FLASH_STATE_UPLOADING,
+    FLASH_STATE_FINISHED
+} flash_state_t;
+
+static struct {
+    flash_state_t state;
+    upload_mode_t mode;
+    upload_result_t upload_result;
+} flash;
+
+static void draw_message(const char *title, const char *message) {
+    clcd_clear_display();
+    clcd_return_home();
+    clcd_write_string(title);
+    clcd_set_cursor_position(0, 1);
+    clcd_write_string(message);
+}
+
+static void draw_number(const char *label, uint16_t number) {
+    char digits[6];
+
+    clcd_write_string(label);
+    clcd_write_string(utoa(number, digits, 10));
+}
+
+static void draw_page_counts() {
+    clcd_set_cursor_position(0, 1);
+    draw_number("W:", uploader_get_written_pages());
+    draw_number(" S:", uploader_get_skipped_pages());
+
+    uint16_t retries = uploader_get_retries();
+    if (retries != 0) {
+        draw_number(" R:", retries);
+    }
+}
+
+static void draw_progress() {
+    char digits[6];
+
+    clcd_set_cursor_position(0, 0);
+    clcd_write_string(uploader_get_activity());
+    clcd_write_char(' ');
+    clcd_write_string(utoa(uploader_get_progress(), digits, 10));
+    clcd_write_char('%');
+
+    uint16_t eta = uploader_get_eta_seconds();
+    if (eta != UPLOADER_ETA_UNKNOWN) {
+        clcd_write_char(' ');
+        clcd_write_string(utoa(eta, digits, 10));
+        clcd_write_char('s');
+    }
+    clcd_write_string("    ");
+
+    draw_page_counts();
+}
+
+static void finish_with_message(const char *title, const char *message) {
+    draw_message(title, message);
+    flash.state = FLASH_STATE_FINISHED;
+}
+
+// Runs from the main loop, so the target is served between the ticks too
+static tick_callback_result_t upload_background_task() {
+    flash.upload_result = uploader_step();
+
+    return flash.upload_result == UPLOAD_IN_PROGRESS ? TICK_CALLBACK_CONTINUE : TICK_CALLBACK_FINISHED;
+}
+
+static void start_upload(FIL *file) {
+    upload_config_t config;
+    const char *title;
+    const char *message;
+
+    clcd_cursor_off();
+
+    if (!upload_files_prepare(file, flash.mode, &config, &title, &message)) {
+        finish_with_message(title, message);
+        return;
+    }
+
+    clcd_clear_display();
+
+    uploader_start(&config);
+    flash.upload_result = UPLOAD_IN_PROGRESS;
+    main_menu_set_background_task(&upload_background_task);
+
+    flash.state = FLASH_STATE_UPLOADING;
+    draw_progress();
+}
+
+static void show_upload_result(upload_result_t result) {
+    if (result == UPLOAD_DONE) {
+        const avr_part_t *part = uploader_get_part();
+
+        clcd_clear_display();
+        clcd_return_home();
+        clcd_write_string("Done ");
+        clcd_write_string(part != NULLPTR ? part->name : uploader_get_programmer_id());
+        draw_page_counts();
+    } else {
+        draw_message("Flash failed", uploader_get_error());
+    }
+
+    upload_files_close();
+
+    flash.state = FLASH_STATE_FINISHED;
+}
+
+static tick_callback_result_t picking_file_tick() {
+    tick_callback_result_t result;
+
+    FRESULT f_err = file_picker_tick(&result);
+    if (f_err != FR_OK) {
+        clcd_cursor_off();
+        finish_with_message("File error", fresult_to_string(f_err));
+        return TICK_CALLBACK_CONTINUE;
+    }
+
+    if (result == TICK_CALLBACK_FINISHED) {
+        FIL *file = file_picker_get_selected_file();
+        if (file == NULLPTR) {
+            return TICK_CALLBACK_FINISHED;
+        }
+
+        start_upload(file);
+    }
+
+    return TICK_CALLBACK_CONTINUE;
+}
+
+static tick_callback_result_t uploading_tick() {
+    if (button_was_pressed(BUTTON_BACK)) {
+        uploader_abort();
+    }
+
+    if (flash.upload_result == UPLOAD_IN_PROGRESS) {
+        draw_progress();
+    } else {
+        show_upload_result(flash.upload_result);
+    }
+
+    return TICK_CALLBACK_CONTINUE;
+}
+
+static tick_callback_result_t flash_program_tick(millis_t current_time) {
+    switch (flash.state) {
+        case FLASH_STATE_PICKING_FILE:
+            return picking_file_tick();
+        case FLASH_STATE_UPLOADING:
+            return uploading_tick();
+        case FLASH_STATE_FINISHED:
+        default:
+            if (button_was_pressed(BUTTON_BACK) || button_was_pressed(BUTTON_SELECT)) {
+                return TICK_CALLBACK_FINISHED;
+            }
+            return TICK_CALLBACK_CONTINUE;
+    }
+}
+
+static tick_callback_t start_flash_program(upload_mode_t mode) {
+    flash.mode = mode;
+
+    FRESULT f_err = storage_mount();
+    if (f_err == FR_OK) {
+        f_err = start_file_picker();
+    }
+
+    if (f_err != FR_OK) {
+        clcd_cursor_off();
+        finish_with_message("SD card error", fresult_to_string(f_err));
+    } else {
+        flash.state = FLASH_STATE_PICKING_FILE;
+    }
+
+    return &flash_program_tick;
+}
+
+tick_callback_t switch_to_flash_program() {
+    return start_flash_program(UPLOAD_MODE_FULL);
+}
+
+tick_callback_t switch_to_flash_changes() {
+    return start_flash_program(UPLOAD_MODE_CHANGES);
+}
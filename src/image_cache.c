@@ -0,0 +1,98 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "image_cache.h"
+#include "scrollback.h"
+#include "xmem.h"
+
+#if IMAGE_CACHE_BACKEND == IMAGE_CACHE_BACKEND_XMEM
+
+#if SCROLLBACK_BACKEND == SCROLLBACK_BACKEND_XMEM
+#define IMAGE_CACHE_XMEM_START XMEM_SHARED_SPLIT
+#else
+#define IMAGE_CACHE_XMEM_START XMEM_START
+#endif
+
+#define IMAGE_CACHE_XMEM_SIZE (XMEM_END - IMAGE_CACHE_XMEM_START + 1)
+
+// Each entry is the page address followed by the page data. Only pages with
+// data are stored, blank pages are left out like the page reader does.
+typedef struct {
+    uint32_t page_address;
+    uint8_t data[];
+} cache_entry_t;
+
+static uint8_t *const cache_memory = (uint8_t *)IMAGE_CACHE_XMEM_START;
+
+static struct {
+    image_cache_key_t key;
+    uint16_t page_count;
+    // Cleared by pages which don't fit, a partial image is never committed
+    bool complete;
+    bool valid;
+} cache;
+
+static inline uint16_t get_entry_size() {
+    return sizeof(cache_entry_t) + cache.key.page_size;
+}
+
+static inline cache_entry_t *get_entry(uint16_t index) {
+    return (cache_entry_t *)(cache_memory + (uint32_t)index * get_entry_size());
+}
+
+void image_cache_init() {
+    xmem_init();
+    cache.valid = false;
+}
+
+static bool keys_match(const image_cache_key_t *a, const image_cache_key_t *b) {
+    return a->file_size == b->file_size
+        && a->start_cluster == b->start_cluster
+        && a->timestamp == b->timestamp
+        && a->page_size == b->page_size
+        && a->format == b->format
+        && a->skip_blank_pages == b->skip_blank_pages;
+}
+
+bool image_cache_lookup(const image_cache_key_t *key) {
+    return cache.valid && keys_match(&cache.key, key);
+}
+
+void image_cache_begin(const image_cache_key_t *key) {
+    cache.key = *key;
+    cache.page_count = 0;
+    cache.complete = true;
+    cache.valid = false;
+}
+
+void image_cache_append(uint32_t page_address, const uint8_t *page) {
+    if (!cache.complete) {
+        return;
+    }
+
+    if ((uint32_t)(cache.page_count + 1) * get_entry_size() > IMAGE_CACHE_XMEM_SIZE) {
+        cache.complete = false;
+        return;
+    }
+
+    cache_entry_t *entry = get_entry(cache.page_count++);
+    entry->page_address = page_address;
+    memcpy(entry->data, page, cache.key.page_size);
+}
+
+void image_cache_commit() {
+    cache.valid = cache.complete;
+}
+
+uint16_t image_cache_get_page_count() {
+    return cache.page_count;
+}
+
+void image_cache_get_page(uint16_t index, uint32_t *page_address, uint8_t *page) {
+    const cache_entry_t *entry = get_entry(index);
+
+    *page_address = entry->page_address;
+    memcpy(page, entry->data, cache.key.page_size);
+}
+
+#endif
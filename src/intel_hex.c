@@ -0,0 +1,311 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "fatfs/ff.h"
+#include "intel_hex.h"
+
+#define RECORD_START ':'
+
+#define RECORD_DATA 0x00
+#define RECORD_END_OF_FILE 0x01
+#define RECORD_EXTENDED_SEGMENT_ADDRESS 0x02
+#define RECORD_START_SEGMENT_ADDRESS 0x03
+#define RECORD_EXTENDED_LINEAR_ADDRESS 0x04
+#define RECORD_START_LINEAR_ADDRESS 0x05
+
+#define INVALID_NIBBLE 0xFF
+
+const char *intel_hex_result_to_string(intel_hex_result_t result) {
+    switch (result) {
+        case INTEL_HEX_OK:
+            return "HEX OK";
+        case INTEL_HEX_END:
+            return "HEX End";
+        case INTEL_HEX_ERROR_READ:
+            return "HEX Read Error";
+        case INTEL_HEX_ERROR_SYNTAX:
+            return "HEX Syntax Error";
+        case INTEL_HEX_ERROR_CHECKSUM:
+            return "HEX Bad Checksum";
+        case INTEL_HEX_ERROR_RECORD_TYPE:
+            return "HEX Bad Record";
+        default:
+            return "HEX Unknown";
+    }
+}
+
+void intel_hex_init(intel_hex_decoder_t *decoder, FIL *file) {
+    decoder->file = file;
+    decoder->buffer_length = 0;
+    decoder->buffer_position = 0;
+    decoder->base_address = 0;
+    decoder->address = 0;
+    decoder->remaining_data_bytes = 0;
+    decoder->checksum = 0;
+}
+
+static intel_hex_result_t read_char(intel_hex_decoder_t *decoder, char *c) {
+    if (decoder->buffer_position == decoder->buffer_length) {
+        FRESULT f_err = f_read(decoder->file, decoder->buffer, INTEL_HEX_READ_BUFFER_SIZE, &decoder->buffer_length);
+        if (f_err != FR_OK) {
+            return INTEL_HEX_ERROR_READ;
+        }
+
+        // File ended before the end of file record
+        if (decoder->buffer_length == 0) {
+            return INTEL_HEX_ERROR_SYNTAX;
+        }
+
+        decoder->buffer_position = 0;
+    }
+
+    *c = decoder->buffer[decoder->buffer_position++];
+    return INTEL_HEX_OK;
+}
+
+static inline uint8_t nibble_from_char(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    return INVALID_NIBBLE;
+}
+
+// Every byte read through here is added to the record checksum
+static intel_hex_result_t read_byte(intel_hex_decoder_t *decoder, uint8_t *byte) {
+    uint8_t value = 0;
+
+    for (uint8_t i = 0; i < 2; i++) {
+        char c;
+        intel_hex_result_t err = read_char(decoder, &c);
+        if (err != INTEL_HEX_OK) {
+            return err;
+        }
+
+        uint8_t nibble = nibble_from_char(c);
+        if (nibble == INVALID_NIBBLE) {
+            return INTEL_HEX_ERROR_SYNTAX;
+        }
+
+        value = (value << 4) | nibble;
+    }
+
+    decoder->checksum += value;
+    *byte = value;
+    return INTEL_HEX_OK;
+}
+
+static intel_hex_result_t read_word(intel_hex_decoder_t *decoder, uint16_t *word) {
+    uint8_t high;
+    uint8_t low;
+
+    intel_hex_result_t err = read_byte(decoder, &high);
+    if (err != INTEL_HEX_OK) {
+        return err;
+    }
+
+    err = read_byte(decoder, &low);
+    if (err != INTEL_HEX_OK) {
+        return err;
+    }
+
+    *word = ((uint16_t)high << 8) | low;
+    return INTEL_HEX_OK;
+}
+
+// All bytes of a record including the checksum byte itself add up to zero
+static intel_hex_result_t finish_record(intel_hex_decoder_t *decoder) {
+    uint8_t checksum;
+    intel_hex_result_t err = read_byte(decoder, &checksum);
+    if (err != INTEL_HEX_OK) {
+        return err;
+    }
+
+    return decoder->checksum == 0 ? INTEL_HEX_OK : INTEL_HEX_ERROR_CHECKSUM;
+}
+
+static intel_hex_result_t skip_record_data(intel_hex_decoder_t *decoder, uint8_t length) {
+    for (uint8_t i = 0; i < length; i++) {
+        uint8_t ignored;
+        intel_hex_result_t err = read_byte(decoder, &ignored);
+        if (err != INTEL_HEX_OK) {
+            return err;
+        }
+    }
+
+    return finish_record(decoder);
+}
+
+// File position of the next char which read_char returns
+static FSIZE_t get_position(const intel_hex_decoder_t *decoder) {
+    return f_tell(decoder->file) - (decoder->buffer_length - decoder->buffer_position);
+}
+
+static intel_hex_result_t set_position(intel_hex_decoder_t *decoder, FSIZE_t position) {
+    FSIZE_t buffer_start = f_tell(decoder->file) - decoder->buffer_length;
+
+    // Records are short, so the data usually is still in the buffer
+    if (position >= buffer_start) {
+        decoder->buffer_position = position - buffer_start;
+        return INTEL_HEX_OK;
+    }
+
+    decoder->buffer_length = 0;
+    decoder->buffer_position = 0;
+    return f_lseek(decoder->file, position) == FR_OK ? INTEL_HEX_OK : INTEL_HEX_ERROR_READ;
+}
+
+// Moves the unread chars to the front of the buffer and fills the rest
+static intel_hex_result_t refill_buffer(intel_hex_decoder_t *decoder) {
+    UINT unread = decoder->buffer_length - decoder->buffer_position;
+    UINT bytes_read;
+
+    memmove(decoder->buffer, decoder->buffer + decoder->buffer_position, unread);
+    decoder->buffer_position = 0;
+    decoder->buffer_length = unread;
+
+    FRESULT f_err = f_read(decoder->file, decoder->buffer + unread, INTEL_HEX_READ_BUFFER_SIZE - unread, &bytes_read);
+    if (f_err != FR_OK) {
+        return INTEL_HEX_ERROR_READ;
+    }
+
+    decoder->buffer_length += bytes_read;
+    return INTEL_HEX_OK;
+}
+
+// Reads the data and the checksum of a record ahead and goes back to its
+// first data byte, so no byte of a damaged record is ever handed out. Going
+// back only needs a seek for records which don't fit into the buffer.
+static intel_hex_result_t check_record_ahead(intel_hex_decoder_t *decoder, uint8_t length) {
+    UINT record_rest_length = ((UINT)length + 1) * 2;
+    if (record_rest_length <= INTEL_HEX_READ_BUFFER_SIZE
+        && decoder->buffer_length - decoder->buffer_position < record_rest_length) {
+        intel_hex_result_t err = refill_buffer(decoder);
+        if (err != INTEL_HEX_OK) {
+            return err;
+        }
+    }
+
+    FSIZE_t data_start = get_position(decoder);
+    uint8_t checksum = decoder->checksum;
+
+    intel_hex_result_t err = skip_record_data(decoder, length);
+    if (err != INTEL_HEX_OK) {
+        return err;
+    }
+
+    decoder->checksum = checksum;
+    return set_position(decoder, data_start);
+}
+
+static intel_hex_result_t read_record_start(intel_hex_decoder_t *decoder) {
+    char c;
+
+    // Skip line endings and anything else between records
+    do {
+        intel_hex_result_t err = read_char(decoder, &c);
+        if (err != INTEL_HEX_OK) {
+            return err;
+        }
+    } while (c != RECORD_START);
+
+    decoder->checksum = 0;
+    return INTEL_HEX_OK;
+}
+
+// Reads records until one with data is found
+static intel_hex_result_t start_next_data_record(intel_hex_decoder_t *decoder) {
+    while (true) {
+        uint8_t length;
+        uint16_t offset;
+        uint8_t type;
+        uint16_t extended_address;
+
+        intel_hex_result_t err = read_record_start(decoder);
+        if (err == INTEL_HEX_OK) {
+            err = read_byte(decoder, &length);
+        }
+        if (err == INTEL_HEX_OK) {
+            err = read_word(decoder, &offset);
+        }
+        if (err == INTEL_HEX_OK) {
+            err = read_byte(decoder, &type);
+        }
+        if (err != INTEL_HEX_OK) {
+            return err;
+        }
+
+        switch (type) {
+            case RECORD_DATA:
+                decoder->address = decoder->base_address + offset;
+                decoder->remaining_data_bytes = length;
+
+                if (length == 0) {
+                    err = finish_record(decoder);
+                    break;
+                }
+                return check_record_ahead(decoder, length);
+            case RECORD_END_OF_FILE:
+                err = finish_record(decoder);
+                return err == INTEL_HEX_OK ? INTEL_HEX_END : err;
+            case RECORD_EXTENDED_SEGMENT_ADDRESS:
+            case RECORD_EXTENDED_LINEAR_ADDRESS:
+                if (length != 2) {
+                    return INTEL_HEX_ERROR_SYNTAX;
+                }
+
+                err = read_word(decoder, &extended_address);
+                if (err != INTEL_HEX_OK) {
+                    return err;
+                }
+
+                if (type == RECORD_EXTENDED_SEGMENT_ADDRESS) {
+                    decoder->base_address = (uint32_t)extended_address << 4;
+                } else {
+                    decoder->base_address = (uint32_t)extended_address << 16;
+                }
+                err = finish_record(decoder);
+                break;
+            case RECORD_START_SEGMENT_ADDRESS:
+            case RECORD_START_LINEAR_ADDRESS:
+                // Entry point doesn't matter for an AVR
+                err = skip_record_data(decoder, length);
+                break;
+            default:
+                return INTEL_HEX_ERROR_RECORD_TYPE;
+        }
+
+        if (err != INTEL_HEX_OK) {
+            return err;
+        }
+    }
+}
+
+intel_hex_result_t intel_hex_next_byte(intel_hex_decoder_t *decoder, uint32_t *address, uint8_t *byte) {
+    intel_hex_result_t err;
+
+    if (decoder->remaining_data_bytes == 0) {
+        err = start_next_data_record(decoder);
+        if (err != INTEL_HEX_OK) {
+            return err;
+        }
+    }
+
+    err = read_byte(decoder, byte);
+    if (err != INTEL_HEX_OK) {
+        return err;
+    }
+
+    *address = decoder->address++;
+    decoder->remaining_data_bytes--;
+
+    if (decoder->remaining_data_bytes == 0) {
+        return finish_record(decoder);
+    }
+
+    return INTEL_HEX_OK;
+}
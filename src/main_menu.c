@@ -7,6 +7,10 @@
 #include "main_menu.h"
 #include "usart_settings.h"
 #include "serial_monitor.h"
+#include "serial_bridge.h"
+#include "flash_program.h"
+#include "production.h"
+#include "diagnostics.h"
 #include "tick_callback.h"
 
 typedef struct {
@@ -16,6 +20,7 @@ typedef struct {
 
 static struct {
     tick_callback_t current_tick_callback;
+    tick_callback_t background_task;
     uint8_t selected_displayed_row;
     uint8_t first_displayed_row;
 } main_menu;
@@ -29,10 +34,13 @@ static void set_cursor_to_selected_row() {
 }
 
 static const main_menu_option_t main_menu_options[] = {
-    // TODO
-    {"Flash Program", NULLPTR},
+    {"Flash Program", &switch_to_flash_program},
+    {"Flash Changes", &switch_to_flash_changes},
+    {"Production", &switch_to_production},
     {"Serial Monitor", &switch_to_serial_monitor},
+    {"Serial Bridge", &switch_to_serial_bridge},
     {"USART Settings", &switch_to_usart_settings},
+    {"Diagnostics", &switch_to_diagnostics},
 };
 static const uint8_t main_menu_option_count = sizeof(main_menu_options) / sizeof(main_menu_option_t);
 
@@ -99,6 +107,7 @@ static const tick_callback_t default_tick_callback  = &selection_tick;
 
 void main_menu_init() {
     main_menu.current_tick_callback = default_tick_callback;
+    main_menu.background_task = NULLPTR;
     main_menu.selected_displayed_row = 0;
     main_menu.first_displayed_row = 0;
 }
@@ -110,10 +119,26 @@ void switch_to_main_menu() {
     clcd_return_home();
 
     main_menu.current_tick_callback = default_tick_callback;
+    // Background tasks belong to the mode which started them
+    main_menu.background_task = NULLPTR;
 
     draw();
 }
 
+void main_menu_set_background_task(tick_callback_t task) {
+    main_menu.background_task = task;
+}
+
+void main_menu_run_background_task(millis_t current_time) {
+    if (main_menu.background_task == NULLPTR) {
+        return;
+    }
+
+    if (main_menu.background_task(current_time) == TICK_CALLBACK_FINISHED) {
+        main_menu.background_task = NULLPTR;
+    }
+}
+
 void main_menu_tick(millis_t current_time) {
     tick_callback_result_t result;
     result = main_menu.current_tick_callback(current_time);
@@ -0,0 +1,60 @@
+#include <stdint.h>
+#include <avr/io.h>
+#include "memory_usage.h"
+
+#define STACK_CANARY 0xC5
+
+#ifdef __AVR__
+
+// From the linker script, the firmware doesn't use malloc so the heap is empty
+extern uint8_t __heap_start;
+extern uint8_t __stack;
+
+// Runs from .init1, before the stack pointer and the zero register are set
+// up, so it can't be C
+void memory_usage_paint_stack(void) __attribute__((naked, used, section(".init1")));
+void memory_usage_paint_stack() {
+    __asm__ volatile (
+        "    ldi r30, lo8(__heap_start)\n"
+        "    ldi r31, hi8(__heap_start)\n"
+        "    ldi r24, %0\n"
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:\n"
+        "    st Z+, r24\n"
+        "2:\n"
+        "    cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n"
+        :
+        : "M" (STACK_CANARY)
+        : "r24", "r25", "r30", "r31", "memory"
+    );
+}
+
+uint16_t memory_usage_get_free_ram() {
+    return SP - (uint16_t)&__heap_start;
+}
+
+uint16_t memory_usage_get_min_stack_headroom() {
+    const uint8_t *position = &__heap_start;
+
+    while (position <= &__stack && *position == STACK_CANARY) {
+        position++;
+    }
+
+    return position - &__heap_start;
+}
+
+#else
+
+uint16_t memory_usage_get_free_ram() {
+    return MEMORY_USAGE_UNKNOWN;
+}
+
+uint16_t memory_usage_get_min_stack_headroom() {
+    return MEMORY_USAGE_UNKNOWN;
+}
+
+#endif
@@ -0,0 +1,197 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "fatfs/ff.h"
+#include "intel_hex.h"
+#include "binary_image.h"
+#include "page_reader.h"
+
+#define BLANK_BYTE 0xFF
+
+void page_reader_init(page_reader_t *reader, FIL *file, image_format_t format, uint16_t page_size, bool skip_blank_pages) {
+    if (format == IMAGE_FORMAT_INTEL_HEX) {
+        intel_hex_init(&reader->decoder, file);
+    } else {
+        binary_image_init(&reader->image, file, format == IMAGE_FORMAT_ELF);
+    }
+
+    reader->format = format;
+    reader->decode_result = INTEL_HEX_OK;
+    reader->image_result = BINARY_IMAGE_OK;
+    reader->page_size = page_size;
+    reader->next_page_address = 0;
+    reader->has_pending_byte = false;
+    reader->finished = false;
+    reader->skip_blank_pages = skip_blank_pages;
+}
+
+static page_reader_result_t fetch_byte(page_reader_t *reader) {
+    reader->has_pending_byte = false;
+
+    if (reader->finished) {
+        return PAGE_READER_END;
+    }
+
+    intel_hex_result_t result = intel_hex_next_byte(&reader->decoder, &reader->pending_address, &reader->pending_byte);
+    if (result == INTEL_HEX_END) {
+        reader->finished = true;
+        return PAGE_READER_END;
+    } else if (result != INTEL_HEX_OK) {
+        reader->decode_result = result;
+        return PAGE_READER_ERROR_DECODE;
+    }
+
+    reader->has_pending_byte = true;
+    return PAGE_READER_OK;
+}
+
+static inline uint32_t page_start(const page_reader_t *reader, uint32_t address) {
+    return address & ~(uint32_t)(reader->page_size - 1);
+}
+
+static bool page_is_blank(const page_reader_t *reader, const uint8_t *page) {
+    for (uint16_t i = 0; i < reader->page_size; i++) {
+        if (page[i] != BLANK_BYTE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static page_reader_result_t next_hex_page(page_reader_t *reader, uint32_t *page_address, uint8_t *page) {
+    page_reader_result_t result;
+
+    while (true) {
+        if (!reader->has_pending_byte) {
+            result = fetch_byte(reader);
+            if (result != PAGE_READER_OK) {
+                return result;
+            }
+        }
+
+        uint32_t address = page_start(reader, reader->pending_address);
+
+        // Pages before this one were already returned
+        if (address < reader->next_page_address) {
+            return PAGE_READER_ERROR_UNSORTED;
+        }
+
+        memset(page, BLANK_BYTE, reader->page_size);
+        bool blank = true;
+
+        do {
+            page[reader->pending_address - address] = reader->pending_byte;
+            blank = blank && reader->pending_byte == BLANK_BYTE;
+
+            result = fetch_byte(reader);
+            if (result == PAGE_READER_END) {
+                break;
+            } else if (result != PAGE_READER_OK) {
+                return result;
+            }
+        } while (page_start(reader, reader->pending_address) == address);
+
+        reader->next_page_address = address + reader->page_size;
+
+        if (!blank || !reader->skip_blank_pages) {
+            *page_address = address;
+            return PAGE_READER_OK;
+        }
+    }
+}
+
+// Moves on to the next segment once the current one is used up
+static page_reader_result_t fetch_segment(page_reader_t *reader) {
+    while (reader->image.remaining == 0) {
+        if (reader->finished) {
+            return PAGE_READER_END;
+        }
+
+        binary_image_result_t result = binary_image_next_segment(&reader->image);
+        if (result == BINARY_IMAGE_END) {
+            reader->finished = true;
+            return PAGE_READER_END;
+        } else if (result != BINARY_IMAGE_OK) {
+            reader->image_result = result;
+            return PAGE_READER_ERROR_DECODE;
+        }
+    }
+
+    return PAGE_READER_OK;
+}
+
+static page_reader_result_t next_binary_page(page_reader_t *reader, uint32_t *page_address, uint8_t *page) {
+    page_reader_result_t result;
+
+    while (true) {
+        result = fetch_segment(reader);
+        if (result != PAGE_READER_OK) {
+            return result;
+        }
+
+        uint32_t address = page_start(reader, reader->image.address);
+
+        // Pages before this one were already returned
+        if (address < reader->next_page_address) {
+            return PAGE_READER_ERROR_UNSORTED;
+        }
+
+        memset(page, BLANK_BYTE, reader->page_size);
+
+        // Segments can end and start within the same page
+        do {
+            uint16_t offset = reader->image.address - address;
+            uint16_t length = reader->page_size - offset;
+            if (length > reader->image.remaining) {
+                length = reader->image.remaining;
+            }
+
+            binary_image_result_t read_result = binary_image_read(&reader->image, page + offset, length);
+            if (read_result != BINARY_IMAGE_OK) {
+                reader->image_result = read_result;
+                return PAGE_READER_ERROR_DECODE;
+            }
+
+            result = fetch_segment(reader);
+            if (result == PAGE_READER_END) {
+                break;
+            } else if (result != PAGE_READER_OK) {
+                return result;
+            }
+        } while (page_start(reader, reader->image.address) == address);
+
+        reader->next_page_address = address + reader->page_size;
+
+        if (!reader->skip_blank_pages || !page_is_blank(reader, page)) {
+            *page_address = address;
+            return PAGE_READER_OK;
+        }
+    }
+}
+
+page_reader_result_t page_reader_next_page(page_reader_t *reader, uint32_t *page_address, uint8_t *page) {
+    if (reader->format == IMAGE_FORMAT_INTEL_HEX) {
+        return next_hex_page(reader, page_address, page);
+    }
+
+    return next_binary_page(reader, page_address, page);
+}
+
+const char *page_reader_error_to_string(const page_reader_t *reader, page_reader_result_t result) {
+    switch (result) {
+        case PAGE_READER_OK:
+            return "Image OK";
+        case PAGE_READER_END:
+            return "Image End";
+        case PAGE_READER_ERROR_DECODE:
+            if (reader->format != IMAGE_FORMAT_INTEL_HEX) {
+                return binary_image_result_to_string(reader->image_result);
+            }
+            return intel_hex_result_to_string(reader->decode_result);
+        case PAGE_READER_ERROR_UNSORTED:
+            return "Image unsorted";
+        default:
+            return "Image Unknown";
+    }
+}
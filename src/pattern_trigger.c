@@ -0,0 +1,111 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "fatfs/ff.h"
+#include "pattern_trigger.h"
+
+static struct {
+    char pattern[PATTERN_TRIGGER_MAX_LENGTH + 1];
+    // failure[i] is the length of the longest proper prefix of pattern[0..i]
+    // which is also its suffix
+    uint8_t failure[PATTERN_TRIGGER_MAX_LENGTH];
+    uint8_t length;
+    uint8_t matched;
+} trigger;
+
+static void build_failure_table() {
+    uint8_t prefix_length = 0;
+
+    trigger.failure[0] = 0;
+
+    for (uint8_t i = 1; i < trigger.length; i++) {
+        while (prefix_length > 0 && trigger.pattern[i] != trigger.pattern[prefix_length]) {
+            prefix_length = trigger.failure[prefix_length - 1];
+        }
+
+        if (trigger.pattern[i] == trigger.pattern[prefix_length]) {
+            prefix_length++;
+        }
+
+        trigger.failure[i] = prefix_length;
+    }
+}
+
+void pattern_trigger_arm(const char *pattern) {
+    uint8_t length = 0;
+
+    while (length < PATTERN_TRIGGER_MAX_LENGTH && pattern[length] != '\0') {
+        trigger.pattern[length] = pattern[length];
+        length++;
+    }
+
+    trigger.pattern[length] = '\0';
+    trigger.length = length;
+    trigger.matched = 0;
+
+    if (length > 0) {
+        build_failure_table();
+    }
+}
+
+void pattern_trigger_disarm() {
+    pattern_trigger_arm("");
+}
+
+bool pattern_trigger_is_armed() {
+    return trigger.length > 0;
+}
+
+const char *pattern_trigger_get_pattern() {
+    return trigger.pattern;
+}
+
+void pattern_trigger_restart() {
+    trigger.matched = 0;
+}
+
+bool pattern_trigger_feed(char c) {
+    if (!pattern_trigger_is_armed()) {
+        return false;
+    }
+
+    while (trigger.matched > 0 && trigger.pattern[trigger.matched] != c) {
+        trigger.matched = trigger.failure[trigger.matched - 1];
+    }
+
+    if (trigger.pattern[trigger.matched] == c) {
+        trigger.matched++;
+    }
+
+    if (trigger.matched == trigger.length) {
+        // Allow overlapping matches
+        trigger.matched = trigger.failure[trigger.length - 1];
+        return true;
+    }
+
+    return false;
+}
+
+FRESULT pattern_trigger_read_file(const char *path, char *buffer) {
+    FIL file;
+    UINT bytes_read;
+
+    FRESULT f_err = f_open(&file, path, FA_READ);
+    if (f_err != FR_OK) {
+        return f_err;
+    }
+
+    f_err = f_read(&file, buffer, PATTERN_TRIGGER_MAX_LENGTH, &bytes_read);
+    f_close(&file);
+    if (f_err != FR_OK) {
+        return f_err;
+    }
+
+    // Only the first line is used, so the file may end with a newline
+    uint8_t length = 0;
+    while (length < bytes_read && buffer[length] != '\r' && buffer[length] != '\n') {
+        length++;
+    }
+    buffer[length] = '\0';
+
+    return FR_OK;
+}
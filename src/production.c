@@ -0,0 +1,335 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <millis.h>
+#include "fatfs/ff.h"
+#include "production.h"
+#include "tick_callback.h"
+#include "file_picker.h"
+#include "storage.h"
+#include "uploader.h"
+#include "upload_files.h"
+#include "avr109_driver.h"
+#include "clcd.h"
+#include "util.h"
+#include "buttons.h"
+#include "main_menu.h"
+
+#define START_BUTTON BUTTON_CUSTOM_ACTION_0
+#define AUTO_START_BUTTON BUTTON_CUSTOM_ACTION_1
+
+// How often auto start asks for the bootloader while no board answers
+#define PROBE_INTERVAL_MS 1000
+
+#define MS_PER_HOUR 3600000UL
+// Longest cycle time which still fits the display
+#define MAX_CYCLE_TENTHS 9999
+
+typedef enum {
+    PRODUCTION_STATE_PICKING_FILE,
+    PRODUCTION_STATE_IDLE,
+    PRODUCTION_STATE_RUNNING,
+    PRODUCTION_STATE_FINISHED
+} production_state_t;
+
+typedef enum {
+    PROBE_STATE_OFF,
+    PROBE_STATE_WAITING,
+    PROBE_STATE_ASKING
+} probe_state_t;
+
+static struct {
+    production_state_t state;
+    upload_config_t config;
+    upload_result_t upload_result;
+    // millis_t is 16-bit on the AVR and wraps after 65.5 s, the 32-bit
+    // microseconds last 71 minutes
+    micros_t cycle_start_time;
+    // In milliseconds
+    uint32_t cycle_time;
+    uint16_t passed;
+    uint16_t failed;
+    // Error of the last board, NULL if it passed
+    const char *last_error;
+    bool has_result;
+    bool auto_start;
+    probe_state_t probe_state;
+    millis_t last_probe_time;
+    // A flashed board keeps running its application while connected, so
+    // auto start waits for it to stop answering before the next one
+    bool target_removed;
+    char programmer_id[AVR109_PROGRAMMER_ID_LENGTH + 1];
+} production;
+
+static void draw_number(const char *label, uint16_t number) {
+    char digits[6];
+
+    clcd_write_string(label);
+    clcd_write_string(utoa(number, digits, 10));
+}
+
+static void draw_cycle_time() {
+    uint32_t tenths = production.cycle_time / 100;
+    if (tenths > MAX_CYCLE_TENTHS) {
+        tenths = MAX_CYCLE_TENTHS;
+    }
+
+    draw_number("", tenths / 10);
+    draw_number(".", tenths % 10);
+    clcd_write_char('s');
+
+    if (production.cycle_time != 0) {
+        uint32_t boards_per_hour = MS_PER_HOUR / production.cycle_time;
+        draw_number(" ", boards_per_hour > UINT16_MAX ? UINT16_MAX : boards_per_hour);
+        clcd_write_string("/h");
+    }
+}
+
+// Row 0 holds the counters, row 1 how the last board went
+static void draw_idle() {
+    clcd_clear_display();
+    clcd_return_home();
+    draw_number("OK:", production.passed);
+    draw_number(" NG:", production.failed);
+    if (production.auto_start) {
+        clcd_write_string(" A");
+    }
+
+    clcd_set_cursor_position(0, 1);
+    if (!production.has_result) {
+        clcd_write_string("Ready");
+    } else if (production.last_error != NULLPTR) {
+        clcd_write_string(production.last_error);
+    } else {
+        draw_cycle_time();
+    }
+}
+
+static void draw_progress() {
+    char digits[6];
+
+    clcd_set_cursor_position(0, 0);
+    clcd_write_string(uploader_get_activity());
+    clcd_write_char(' ');
+    clcd_write_string(utoa(uploader_get_progress(), digits, 10));
+    clcd_write_string("%    ");
+
+    clcd_set_cursor_position(0, 1);
+    draw_number("W:", uploader_get_written_pages());
+    uint16_t retries = uploader_get_retries();
+    if (retries != 0) {
+        draw_number(" R:", retries);
+    }
+}
+
+static void finish_with_message(const char *title, const char *message) {
+    clcd_clear_display();
+    clcd_return_home();
+    clcd_write_string(title);
+    clcd_set_cursor_position(0, 1);
+    clcd_write_string(message);
+
+    production.state = PRODUCTION_STATE_FINISHED;
+}
+
+static void schedule_probe(millis_t current_time) {
+    production.probe_state = production.auto_start ? PROBE_STATE_WAITING : PROBE_STATE_OFF;
+    production.last_probe_time = current_time;
+}
+
+static void stop_probe() {
+    if (production.probe_state == PROBE_STATE_ASKING) {
+        avr109_end();
+    }
+    production.probe_state = PROBE_STATE_OFF;
+}
+
+static void start_cycle() {
+    stop_probe();
+
+    clcd_clear_display();
+
+    uploader_start(&production.config);
+    production.upload_result = UPLOAD_IN_PROGRESS;
+    production.cycle_start_time = micros();
+    production.target_removed = false;
+    production.state = PRODUCTION_STATE_RUNNING;
+    draw_progress();
+}
+
+static void finish_cycle(millis_t current_time) {
+    production.cycle_time = (micros() - production.cycle_start_time) / 1000;
+    production.has_result = true;
+
+    if (production.upload_result == UPLOAD_DONE) {
+        production.passed++;
+        production.last_error = NULLPTR;
+    } else {
+        production.failed++;
+        production.last_error = uploader_get_error();
+    }
+
+    production.state = PRODUCTION_STATE_IDLE;
+    schedule_probe(current_time);
+    draw_idle();
+}
+
+// Asks for the programmer id until a bootloader answers
+static void probe_target(millis_t current_time) {
+    if (production.probe_state == PROBE_STATE_WAITING) {
+        if (current_time - production.last_probe_time >= PROBE_INTERVAL_MS) {
+            avr109_begin();
+            avr109_read_programmer_id(production.programmer_id);
+            production.probe_state = PROBE_STATE_ASKING;
+        }
+        return;
+    }
+
+    avr109_error_t err = avr109_poll();
+    if (err == AVR109_ERROR_PENDING) {
+        return;
+    }
+
+    avr109_end();
+    if (err == AVR109_ERROR_OK && production.target_removed) {
+        production.probe_state = PROBE_STATE_OFF;
+        start_cycle();
+        return;
+    }
+
+    if (err != AVR109_ERROR_OK) {
+        production.target_removed = true;
+    }
+    schedule_probe(current_time);
+}
+
+// Runs from the main loop for as long as production mode is active
+static tick_callback_result_t production_background_task(millis_t current_time) {
+    if (production.state == PRODUCTION_STATE_RUNNING) {
+        if (production.upload_result == UPLOAD_IN_PROGRESS) {
+            production.upload_result = uploader_step();
+        }
+    } else if (production.state == PRODUCTION_STATE_IDLE && production.probe_state != PROBE_STATE_OFF) {
+        probe_target(current_time);
+    }
+
+    return TICK_CALLBACK_CONTINUE;
+}
+
+static void start_production(FIL *file) {
+    const char *title;
+    const char *message;
+
+    clcd_cursor_off();
+
+    if (!upload_files_prepare(file, UPLOAD_MODE_FULL, &production.config, &title, &message)) {
+        finish_with_message(title, message);
+        return;
+    }
+
+    production.passed = 0;
+    production.failed = 0;
+    production.has_result = false;
+    production.auto_start = false;
+    production.probe_state = PROBE_STATE_OFF;
+    production.target_removed = true;
+
+    production.state = PRODUCTION_STATE_IDLE;
+    main_menu_set_background_task(&production_background_task);
+    draw_idle();
+}
+
+static void stop_production() {
+    stop_probe();
+    upload_files_close();
+}
+
+static tick_callback_result_t picking_file_tick() {
+    tick_callback_result_t result;
+
+    FRESULT f_err = file_picker_tick(&result);
+    if (f_err != FR_OK) {
+        clcd_cursor_off();
+        finish_with_message("File error", fresult_to_string(f_err));
+        return TICK_CALLBACK_CONTINUE;
+    }
+
+    if (result == TICK_CALLBACK_FINISHED) {
+        FIL *file = file_picker_get_selected_file();
+        if (file == NULLPTR) {
+            return TICK_CALLBACK_FINISHED;
+        }
+
+        start_production(file);
+    }
+
+    return TICK_CALLBACK_CONTINUE;
+}
+
+static tick_callback_result_t idle_tick(millis_t current_time) {
+    if (button_was_pressed(BUTTON_BACK)) {
+        stop_production();
+        return TICK_CALLBACK_FINISHED;
+    }
+
+    if (button_was_pressed(START_BUTTON)) {
+        start_cycle();
+    } else if (button_was_pressed(AUTO_START_BUTTON)) {
+        stop_probe();
+        production.auto_start = !production.auto_start;
+        // The board which is connected right now is flashed as well
+        production.target_removed = true;
+        schedule_probe(current_time);
+        draw_idle();
+    }
+
+    return TICK_CALLBACK_CONTINUE;
+}
+
+static tick_callback_result_t running_tick(millis_t current_time) {
+    if (button_was_pressed(BUTTON_BACK)) {
+        uploader_abort();
+    }
+
+    if (production.upload_result == UPLOAD_IN_PROGRESS) {
+        draw_progress();
+    } else {
+        finish_cycle(current_time);
+    }
+
+    return TICK_CALLBACK_CONTINUE;
+}
+
+static tick_callback_result_t production_tick(millis_t current_time) {
+    switch (production.state) {
+        case PRODUCTION_STATE_PICKING_FILE:
+            return picking_file_tick();
+        case PRODUCTION_STATE_IDLE:
+            return idle_tick(current_time);
+        case PRODUCTION_STATE_RUNNING:
+            return running_tick(current_time);
+        case PRODUCTION_STATE_FINISHED:
+        default:
+            if (button_was_pressed(BUTTON_BACK) || button_was_pressed(BUTTON_SELECT)) {
+                upload_files_close();
+                return TICK_CALLBACK_FINISHED;
+            }
+            return TICK_CALLBACK_CONTINUE;
+    }
+}
+
+tick_callback_t switch_to_production() {
+    FRESULT f_err = storage_mount();
+    if (f_err == FR_OK) {
+        f_err = start_file_picker();
+    }
+
+    if (f_err != FR_OK) {
+        clcd_cursor_off();
+        finish_with_message("SD card error", fresult_to_string(f_err));
+    } else {
+        production.state = PRODUCTION_STATE_PICKING_FILE;
+    }
+
+    return &production_tick;
+}
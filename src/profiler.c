@@ -0,0 +1,297 @@
+#include "profiler.h"
+
+#if PROFILER_ENABLED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "usart.h"
+#include "util.h"
+
+#define PROFILER_USART USART_PORT_0
+
+#define TIMER_PRESCALER 32
+#define TIMER_CLOCK_SELECT (_BV(CS01) | _BV(CS00))
+#define TIMER_COMPARE_VALUE (F_CPU / TIMER_PRESCALER / PROFILER_RATE - 1)
+
+#define COMMAND_START 's'
+#define COMMAND_PAUSE 'p'
+#define COMMAND_DUMP 'd'
+#define COMMAND_WINDOW 'w'
+#define WINDOW_DIGITS 8
+
+// Longest line of the histogram, the header
+#define MAX_LINE_LENGTH 80
+
+typedef enum {
+    DUMP_IDLE,
+    DUMP_HEADER,
+    DUMP_BINS,
+    DUMP_END
+} dump_state_t;
+
+// Written by the sampling interrupt before it jumps to the counting
+volatile uint16_t profiler_sampled_pc;
+
+static struct {
+    uint16_t bins[PROFILER_BINS];
+    uint16_t window_start;
+    uint16_t window_end;
+    uint8_t shift;
+    uint32_t samples;
+    uint32_t outside;
+    bool running;
+
+    dump_state_t dump_state;
+    uint8_t dump_bin;
+    bool resume_after_dump;
+
+    bool reading_window;
+    uint8_t window_digits;
+    uint32_t window_value;
+} profiler;
+
+static inline void enable_sampling() {
+    set_bit_inplace(TIMSK, OCIE0);
+}
+
+static inline void disable_sampling() {
+    clear_bit_inplace(TIMSK, OCIE0);
+}
+
+#ifdef __AVR__
+// Entered with a jump from the interrupt below, so it saves every register
+// it uses and returns with reti like an interrupt handler
+#pragma GCC diagnostic ignored "-Wmisspelled-isr"
+void profiler_record_sample(void) __attribute__((signal, used, externally_visible));
+#else
+void profiler_record_sample(void);
+#endif
+
+void profiler_record_sample() {
+    uint16_t pc = profiler_sampled_pc;
+    profiler.samples++;
+
+    if (pc >= profiler.window_start && pc <= profiler.window_end) {
+        uint16_t *bin = &profiler.bins[(pc - profiler.window_start) >> profiler.shift];
+        if (*bin != UINT16_MAX) {
+            (*bin)++;
+        }
+    } else {
+        profiler.outside++;
+    }
+}
+
+#ifdef __AVR__
+
+#include <avr/pgmspace.h>
+
+// The return address sits on the stack high byte first, below the two
+// registers saved here. Nothing in here touches SREG, and the counting
+// function saves everything else and returns from the interrupt.
+ISR(TIMER0_COMP_vect, ISR_NAKED) {
+    __asm__ volatile (
+        "push r30\n"
+        "push r31\n"
+        "in r30, __SP_L__\n"
+        "in r31, __SP_H__\n"
+        "push r24\n"
+        "ldd r24, Z+3\n"
+        "sts profiler_sampled_pc+1, r24\n"
+        "ldd r24, Z+4\n"
+        "sts profiler_sampled_pc, r24\n"
+        "pop r24\n"
+        "pop r31\n"
+        "pop r30\n"
+        "jmp profiler_record_sample\n"
+    );
+}
+
+// End of the code, from the linker
+extern char _etext;
+
+static uint16_t get_code_end() {
+    return pgm_get_far_address(_etext) / 2;
+}
+
+#else
+
+// The host build has no program counter to sample, profile it with perf or
+// gprof instead
+ISR(TIMER0_COMP_vect) {
+    profiler_record_sample();
+}
+
+static uint16_t get_code_end() {
+    return UINT16_MAX;
+}
+
+#endif
+
+static void set_window(uint16_t start, uint16_t end) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        profiler.window_start = start;
+        profiler.window_end = end;
+
+        profiler.shift = 0;
+        while (((uint32_t)(end - start) >> profiler.shift) >= PROFILER_BINS) {
+            profiler.shift++;
+        }
+    }
+}
+
+static void clear_histogram() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        memset(profiler.bins, 0, sizeof(profiler.bins));
+        profiler.samples = 0;
+        profiler.outside = 0;
+    }
+}
+
+static void write_string(const char *string) {
+    while (*string != '\0') {
+        usart_write_byte(PROFILER_USART, *string++);
+    }
+}
+
+static void write_number(const char *label, uint32_t number, uint8_t radix) {
+    char digits[11];
+
+    write_string(label);
+    write_string(ultoa(number, digits, radix));
+}
+
+static void start_dump() {
+    profiler.resume_after_dump = profiler.running;
+    profiler.running = false;
+    disable_sampling();
+
+    profiler.dump_state = DUMP_HEADER;
+    profiler.dump_bin = 0;
+}
+
+// Sends a line whenever there is room for it, so the main loop never waits
+static void continue_dump() {
+    while (profiler.dump_state != DUMP_IDLE && USART_TX_BUFFER_SIZE - 1 - usart_tx_buffered(PROFILER_USART) >= MAX_LINE_LENGTH) {
+        switch (profiler.dump_state) {
+            case DUMP_HEADER:
+                write_number("profile start=", profiler.window_start, 16);
+                write_number(" shift=", profiler.shift, 10);
+                write_number(" rate=", PROFILER_RATE, 10);
+                write_number(" samples=", profiler.samples, 10);
+                write_number(" outside=", profiler.outside, 10);
+                write_string("\n");
+                profiler.dump_state = DUMP_BINS;
+                break;
+            case DUMP_BINS:
+                if (profiler.bins[profiler.dump_bin] != 0) {
+                    write_number("", profiler.window_start + ((uint16_t)profiler.dump_bin << profiler.shift), 16);
+                    write_number(" ", profiler.bins[profiler.dump_bin], 10);
+                    write_string("\n");
+                }
+                if (++profiler.dump_bin == PROFILER_BINS) {
+                    profiler.dump_state = DUMP_END;
+                }
+                break;
+            case DUMP_END:
+            default:
+                write_string("end\n");
+                profiler.dump_state = DUMP_IDLE;
+                if (profiler.resume_after_dump) {
+                    profiler.running = true;
+                    enable_sampling();
+                }
+                break;
+        }
+    }
+}
+
+static bool read_hex_digit(uint8_t byte) {
+    uint8_t value;
+    if (byte >= '0' && byte <= '9') {
+        value = byte - '0';
+    } else if (byte >= 'a' && byte <= 'f') {
+        value = byte - 'a' + 10;
+    } else if (byte >= 'A' && byte <= 'F') {
+        value = byte - 'A' + 10;
+    } else {
+        return false;
+    }
+
+    profiler.window_value = (profiler.window_value << 4) | value;
+    profiler.window_digits++;
+    return true;
+}
+
+static void read_window_byte(uint8_t byte) {
+    if (profiler.window_digits < WINDOW_DIGITS && read_hex_digit(byte)) {
+        return;
+    }
+
+    profiler.reading_window = false;
+
+    uint16_t start = profiler.window_value >> 16;
+    uint16_t end = profiler.window_value;
+    if ((byte == '\n' || byte == '\r') && profiler.window_digits == WINDOW_DIGITS && start <= end) {
+        set_window(start, end);
+        clear_histogram();
+    }
+}
+
+static void handle_command(uint8_t byte) {
+    if (profiler.reading_window) {
+        read_window_byte(byte);
+        return;
+    }
+
+    switch (byte) {
+        case COMMAND_START:
+            clear_histogram();
+            profiler.running = true;
+            enable_sampling();
+            break;
+        case COMMAND_PAUSE:
+            profiler.running = false;
+            disable_sampling();
+            break;
+        case COMMAND_DUMP:
+            if (profiler.dump_state == DUMP_IDLE) {
+                start_dump();
+            }
+            break;
+        case COMMAND_WINDOW:
+            profiler.reading_window = true;
+            profiler.window_digits = 0;
+            profiler.window_value = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+void profiler_init() {
+    set_window(0, get_code_end());
+
+    TCCR0 = _BV(WGM01) | TIMER_CLOCK_SELECT;
+    OCR0 = TIMER_COMPARE_VALUE;
+    TCNT0 = 0;
+}
+
+void profiler_poll() {
+    // The serial bridge turns USART0 off when it is left
+    usart_start_receive(PROFILER_USART);
+    usart_start_transmit(PROFILER_USART);
+
+    uint8_t byte;
+    while (usart_read_byte(PROFILER_USART, &byte)) {
+        handle_command(byte);
+    }
+
+    continue_dump();
+}
+
+#endif
@@ -0,0 +1,20 @@
+#include "scrollback.h"
+#include "xmem.h"
+
+#if SCROLLBACK_BACKEND == SCROLLBACK_BACKEND_XMEM
+
+scrollback_row_t *const scrollback_rows = (scrollback_row_t *)SCROLLBACK_XMEM_START;
+
+void scrollback_init() {
+    xmem_init();
+}
+
+#else
+
+static scrollback_row_t internal_rows[SCROLLBACK_ROWS];
+scrollback_row_t *const scrollback_rows = internal_rows;
+
+void scrollback_init() {
+}
+
+#endif
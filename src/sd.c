@@ -4,6 +4,7 @@
 #include <util.h>
 #include "sd.h"
 #include "spi.h"
+#include "trace.h"
 #include "util.h"
 
 #define CS_PORT PORTB
@@ -165,10 +166,12 @@ static inline void sd_send_command_crc(sd_command_t command, uint32_t argument,
 
 static inline sd_error_t sd_send_command_crc_with_response(sd_command_t command, uint32_t argument, uint8_t crc, sd_response_t *response) {
     bool cs_res = sd_cs_select();
+    trace_event(TRACE_SD_COMMAND_START, command);
 
     sd_send_command_crc(command, argument, crc);
     sd_error_t err = sd_receive_response(response, response_get_extra_size(command));
 
+    trace_event(TRACE_SD_COMMAND_END, err);
     sd_cs_restore(cs_res);
 
     return err;
@@ -236,7 +239,7 @@ sd_error_t sd_init() {
     bool sdv2 = false;
 
     err = check_for_sdv2(&sdv2);
-    if (err != SD_ERROR_IDLE) {
+    if (err != SD_ERROR_OK) {
         return err;
     }
 
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <util/atomic.h>
+#include "serial_bridge.h"
+#include "tick_callback.h"
+#include "millis.h"
+#include "usart.h"
+#include "clcd.h"
+#include "util.h"
+#include "buttons.h"
+#include "common.h"
+
+#define HOST_USART USART_PORT_0
+#define TARGET_USART USART_PORT_1
+
+#define XON 0x11
+#define XOFF 0x13
+
+// The sender is paused once the other side's TX buffer gets this full. The
+// remaining space absorbs bytes which are already on their way.
+#define PAUSE_LEVEL (USART_TX_BUFFER_SIZE / 2)
+
+#define THROUGHPUT_INTERVAL_MS 1000
+
+#define FLOW_CONTROL_BUTTON BUTTON_CUSTOM_ACTION_0
+
+// A row is the label, the rate and either the drop count or XOFF
+#define LABEL_COLS 4
+#define RATE_DIGITS 5
+#define MAX_SHOWN_RATE 99999
+#define RATE_UNIT "B/s"
+#define RATE_UNIT_COLS 3
+#define STATUS_COLS 4
+#define DROPS_DIGITS (STATUS_COLS - 1)
+#define MAX_SHOWN_DROPS 999
+
+_Static_assert(LABEL_COLS + RATE_DIGITS + RATE_UNIT_COLS + STATUS_COLS == DISPLAY_VISIBLE_COLS, "A row has to fit the display");
+
+// XON/XOFF adds bytes to the stream, so it is off for binary pass-through.
+// The board has no RTS/CTS lines to offer hardware flow control instead.
+typedef enum {
+    FLOW_CONTROL_OFF = 0,
+    FLOW_CONTROL_XON_XOFF,
+    FLOW_CONTROL_COUNT
+} flow_control_t;
+
+static const char *const flow_control_names[FLOW_CONTROL_COUNT] = {
+    [FLOW_CONTROL_OFF] = "off",
+    [FLOW_CONTROL_XON_XOFF] = "XON/XOFF",
+};
+
+typedef enum {
+    HOST_TO_TARGET = 0,
+    TARGET_TO_HOST,
+    DIRECTION_COUNT
+} direction_t;
+
+typedef struct {
+    usart_port_t source;
+    usart_port_t sink;
+    const char *label;
+} direction_ports_t;
+
+static const direction_ports_t direction_ports[DIRECTION_COUNT] = {
+    [HOST_TO_TARGET] = {HOST_USART, TARGET_USART, "H>T "},
+    [TARGET_TO_HOST] = {TARGET_USART, HOST_USART, "T>H "},
+};
+
+static struct {
+    // Kept between sessions
+    volatile flow_control_t flow_control;
+    volatile uint32_t forwarded_bytes[DIRECTION_COUNT];
+    // Bytes which didn't fit into the sink's TX buffer
+    volatile uint16_t dropped_bytes[DIRECTION_COUNT];
+    volatile bool source_paused[DIRECTION_COUNT];
+    uint32_t last_forwarded_bytes[DIRECTION_COUNT];
+    millis_t last_throughput_time;
+} bridge;
+
+// XON/XOFF sent by the host or target are forwarded unchanged, flow control
+// only adds its own bytes when one side can't keep up with the other
+static inline void forward_byte(direction_t direction, uint8_t byte) {
+    const direction_ports_t *ports = &direction_ports[direction];
+
+    // With flow control, the buffer only overflows if the sender ignores XOFF
+    if (!usart_write_byte(ports->sink, byte)) {
+        if (bridge.dropped_bytes[direction] != UINT16_MAX) {
+            bridge.dropped_bytes[direction]++;
+        }
+        return;
+    }
+
+    bridge.forwarded_bytes[direction]++;
+
+    if (bridge.flow_control == FLOW_CONTROL_XON_XOFF && !bridge.source_paused[direction]
+        && usart_tx_buffered(ports->sink) >= PAUSE_LEVEL) {
+        bridge.source_paused[direction] = true;
+        usart_write_control_byte(ports->source, XOFF);
+    }
+}
+
+static inline void resume_source(direction_t direction) {
+    if (bridge.source_paused[direction]) {
+        bridge.source_paused[direction] = false;
+        usart_write_control_byte(direction_ports[direction].source, XON);
+    }
+}
+
+// Called from the USART interrupts
+static void receive_from_host(uint8_t byte) {
+    forward_byte(HOST_TO_TARGET, byte);
+}
+
+static void receive_from_target(uint8_t byte) {
+    forward_byte(TARGET_TO_HOST, byte);
+}
+
+static void target_drained() {
+    resume_source(HOST_TO_TARGET);
+}
+
+static void host_drained() {
+    resume_source(TARGET_TO_HOST);
+}
+
+static uint32_t get_forwarded_bytes(direction_t direction) {
+    uint32_t forwarded_bytes;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        forwarded_bytes = bridge.forwarded_bytes[direction];
+    }
+
+    return forwarded_bytes;
+}
+
+static uint16_t get_dropped_bytes(direction_t direction) {
+    uint16_t dropped_bytes;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        dropped_bytes = bridge.dropped_bytes[direction];
+    }
+
+    return dropped_bytes;
+}
+
+static void put_right_aligned(char *destination, uint32_t value, uint8_t width) {
+    char digits[11];
+    uint8_t length = strlen(ultoa(value, digits, 10));
+
+    memcpy(destination + width - length, digits, length);
+}
+
+static void draw_throughput(direction_t direction, uint32_t bytes_per_second) {
+    char row[DISPLAY_VISIBLE_COLS];
+    char *rate = row + LABEL_COLS;
+    char *status = rate + RATE_DIGITS + RATE_UNIT_COLS;
+    uint16_t dropped_bytes = get_dropped_bytes(direction);
+
+    memset(row, ' ', sizeof(row));
+    memcpy(row, direction_ports[direction].label, LABEL_COLS);
+    put_right_aligned(rate, u32min(bytes_per_second, MAX_SHOWN_RATE), RATE_DIGITS);
+    memcpy(rate + RATE_DIGITS, RATE_UNIT, RATE_UNIT_COLS);
+
+    // Lost data matters more than a paused sender
+    if (dropped_bytes > 0) {
+        status[0] = '!';
+        put_right_aligned(status + 1, u32min(dropped_bytes, MAX_SHOWN_DROPS), DROPS_DIGITS);
+    } else if (bridge.source_paused[direction]) {
+        memcpy(status, "XOFF", STATUS_COLS);
+    }
+
+    clcd_set_cursor_position(0, direction);
+    clcd_write_chars(row, sizeof(row));
+}
+
+static void update_throughput(millis_t current_time) {
+    millis_t elapsed = current_time - bridge.last_throughput_time;
+    if (elapsed < THROUGHPUT_INTERVAL_MS) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < DIRECTION_COUNT; i++) {
+        uint32_t forwarded_bytes = get_forwarded_bytes(i);
+        uint32_t bytes = forwarded_bytes - bridge.last_forwarded_bytes[i];
+
+        draw_throughput(i, bytes * 1000 / elapsed);
+        bridge.last_forwarded_bytes[i] = forwarded_bytes;
+    }
+
+    bridge.last_throughput_time = current_time;
+}
+
+static void start_port(usart_port_t port, usart_rx_handler_t rx_handler, usart_tx_drain_handler_t tx_drain_handler) {
+    usart_set_rx_handler(port, rx_handler);
+    usart_set_tx_drain_handler(port, tx_drain_handler);
+    usart_start_transmit(port);
+    usart_start_receive(port);
+}
+
+static void stop_port(usart_port_t port) {
+    usart_stop_receive(port);
+    usart_stop_transmit(port);
+    usart_set_rx_handler(port, NULLPTR);
+    usart_set_tx_drain_handler(port, NULLPTR);
+}
+
+static void cleanup_bridge() {
+    stop_port(HOST_USART);
+    stop_port(TARGET_USART);
+}
+
+// Shown on the first row until the next throughput update
+static void next_flow_control(millis_t current_time) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        bridge.flow_control = (bridge.flow_control + 1) % FLOW_CONTROL_COUNT;
+
+        // Nothing would resume a paused sender any more
+        for (uint8_t i = 0; i < DIRECTION_COUNT; i++) {
+            resume_source(i);
+        }
+    }
+
+    clcd_clear_row(0);
+    clcd_set_cursor_position(0, 0);
+    clcd_write_string("Flow: ");
+    clcd_write_string(flow_control_names[bridge.flow_control]);
+
+    bridge.last_throughput_time = current_time;
+}
+
+static tick_callback_result_t serial_bridge_tick(millis_t current_time) {
+    if (button_was_pressed(BUTTON_BACK)) {
+        cleanup_bridge();
+        return TICK_CALLBACK_FINISHED;
+    }
+
+    if (button_was_pressed(FLOW_CONTROL_BUTTON)) {
+        next_flow_control(current_time);
+    }
+
+    update_throughput(current_time);
+    return TICK_CALLBACK_CONTINUE;
+}
+
+tick_callback_t switch_to_serial_bridge() {
+    for (uint8_t i = 0; i < DIRECTION_COUNT; i++) {
+        bridge.forwarded_bytes[i] = 0;
+        bridge.dropped_bytes[i] = 0;
+        bridge.last_forwarded_bytes[i] = 0;
+        bridge.source_paused[i] = false;
+    }
+    bridge.last_throughput_time = millis();
+
+    clcd_cursor_off();
+    clcd_clear_display();
+    for (uint8_t i = 0; i < DIRECTION_COUNT; i++) {
+        draw_throughput(i, 0);
+    }
+
+    start_port(HOST_USART, &receive_from_host, &host_drained);
+    start_port(TARGET_USART, &receive_from_target, &target_drained);
+
+    return &serial_bridge_tick;
+}
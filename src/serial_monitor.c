@@ -1,5 +1,5 @@
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include <stdlib.h>
+#include <string.h>
 #include "serial_monitor.h"
 #include "tick_callback.h"
 #include "millis.h"
@@ -7,48 +7,100 @@
 #include "util.h"
 #include "buttons.h"
 #include "common.h"
+#include "usart.h"
+#include "scrollback.h"
+#include "storage.h"
+#include "pattern_trigger.h"
+#include "trace.h"
 
-#define ROWS 16
-#define COLS DISPLAY_VISIBLE_COLS
+#define MONITOR_USART USART_PORT_1
+
+#define ROWS SCROLLBACK_ROWS
+#define COLS SCROLLBACK_COLS
 #define EMPTY_CHAR ' '
 
+// Timestamps take up the first columns of each row when they are shown
+#define TIMESTAMP_DIGITS 5
+#define TIMESTAMP_COLS (TIMESTAMP_DIGITS + 1)
+#define TIMESTAMP_MAX_DELTA 9999
+// Absolute timestamps keep their last digits. millis_t wraps at 65535 on the
+// AVR, but it is 32-bit on the host.
+#define TIMESTAMP_ABSOLUTE_WRAP 100000UL
+
+#define STATUS_DURATION_MS 1000
+
+#define TRIGGER_FILE_PATH "/trigger.txt"
+
+static const char *const trigger_presets[] = {
+    "assert",
+    "panic",
+    "ERROR",
+    "FAIL",
+};
+
+#define TRIGGER_PRESET_COUNT (sizeof(trigger_presets) / sizeof(trigger_presets[0]))
+
+// Trigger sources are cycled through in order: off, presets, file
+#define TRIGGER_SOURCE_OFF 0
+#define TRIGGER_SOURCE_FILE (TRIGGER_PRESET_COUNT + 1)
+#define TRIGGER_SOURCE_COUNT (TRIGGER_PRESET_COUNT + 2)
+
+typedef enum {
+    TIMESTAMP_HIDDEN = 0,
+    TIMESTAMP_ABSOLUTE,
+    TIMESTAMP_DELTA,
+    TIMESTAMP_MODE_COUNT
+} timestamp_mode_t;
+
 static inline void enable_usart_rx_interrupt() {
-    set_bit_inplace(UCSR1B, RXCIE1);
+    usart_enable_rx_interrupt(MONITOR_USART);
 }
 
 static inline void disable_usart_rx_interrupt() {
-    clear_bit_inplace(UCSR1B, RXCIE1);
+    usart_disable_rx_interrupt(MONITOR_USART);
 }
 
 static inline void start_usart_receive() {
-    enable_usart_rx_interrupt();
-    set_bit_inplace(UCSR1B, RXEN1);
+    usart_start_receive(MONITOR_USART);
 }
 
 static inline void stop_usart_receive() {
-    clear_bit_inplace(UCSR1B, RXEN1);
-    disable_usart_rx_interrupt();
+    usart_stop_receive(MONITOR_USART);
 }
 
 static struct {
-    char buffer[ROWS][COLS];
-    uint8_t buffer_start_row;
-    uint8_t buffer_end_row;
+    timestamp_mode_t timestamp_mode;
+    uint8_t trigger_source;
+    bool stop_on_trigger;
+    // Display doesn't follow new data after a trigger match until resumed,
+    // and the rows it shows aren't overwritten meanwhile
+    volatile bool frozen;
+    volatile bool trigger_matched;
+    const char *status_label;
+    const char *status_value;
+    millis_t status_shown_at;
+    scrollback_index_t buffer_start_row;
+    scrollback_index_t buffer_end_row;
     uint8_t col_to_add;
-    uint8_t first_displayed_row;
-    uint8_t used_rows;
+    scrollback_index_t first_displayed_row;
+    scrollback_index_t used_rows;
 } monitor;
 
-static void flush_row(uint8_t row) {
+static void flush_row(scrollback_index_t row) {
+    scrollback_row_t *buffer_row = scrollback_get_row(row);
+
+    buffer_row->timestamp = 0;
     for (uint8_t i = 0; i < COLS; i++) {
-        monitor.buffer[row][i] = EMPTY_CHAR;
+        buffer_row->chars[i] = EMPTY_CHAR;
     }
 }
 
 static void flush_buffer() {
     disable_usart_rx_interrupt();
 
-    for (uint8_t i = 0; i < ROWS; i++) {
+    // Every other row is flushed once the buffer end reaches it, so only the
+    // rows which are visible before that have to be cleared
+    for (uint8_t i = 0; i < DISPLAY_ROWS; i++) {
         flush_row(i);
     }
 
@@ -59,24 +111,28 @@ static void flush_buffer() {
 
     monitor.col_to_add = 0;
 
+    monitor.frozen = false;
+    pattern_trigger_restart();
+
     enable_usart_rx_interrupt();
 }
 
-static inline uint8_t next_row(uint8_t row) {
-    return (row + 1) % ROWS;
+// ROWS doesn't have to be a power of two, so the ring indexing uses compares
+// instead of a modulo. Addends and subtrahends always have to be below ROWS.
+static inline scrollback_index_t next_row(scrollback_index_t row) {
+    return row == ROWS - 1 ? 0 : row + 1;
 }
 
-static inline uint8_t prev_row(uint8_t row) {
-    return (row + ROWS - 1) % ROWS;
+static inline scrollback_index_t prev_row(scrollback_index_t row) {
+    return row == 0 ? ROWS - 1 : row - 1;
 }
 
-static inline uint8_t add_rows(uint8_t row, uint8_t addend) {
-    return (row + addend) % ROWS;
+static inline scrollback_index_t add_rows(scrollback_index_t row, scrollback_index_t addend) {
+    return row >= ROWS - addend ? row - (ROWS - addend) : row + addend;
 }
 
-static inline uint8_t sub_rows(uint8_t row, uint8_t subtrahend) {
-    uint8_t modulus_subtrahend = subtrahend % ROWS;
-    return (row + ROWS - modulus_subtrahend) % ROWS;
+static inline scrollback_index_t sub_rows(scrollback_index_t row, scrollback_index_t subtrahend) {
+    return row >= subtrahend ? row - subtrahend : row + (ROWS - subtrahend);
 }
 
 static inline void increment_used_row_counter() {
@@ -89,15 +145,27 @@ static inline bool display_can_scroll() {
     return monitor.used_rows > DISPLAY_ROWS;
 }
 
+// Rows past the buffer end and an empty last row don't have a valid timestamp
+static inline bool row_has_data(scrollback_index_t row) {
+    scrollback_index_t row_offset = sub_rows(row, monitor.buffer_start_row);
+    scrollback_index_t end_offset = sub_rows(monitor.buffer_end_row, monitor.buffer_start_row);
+
+    if (row_offset == end_offset) {
+        return monitor.col_to_add > 0;
+    }
+
+    return row_offset < end_offset;
+}
+
 static inline bool buffer_full() {
     return monitor.buffer_start_row == next_row(monitor.buffer_end_row);
 }
 
-static inline uint8_t get_first_displayed_row() {
+static inline scrollback_index_t get_first_displayed_row() {
     return monitor.first_displayed_row;
 }
 
-static inline uint8_t get_last_displayed_row() {
+static inline scrollback_index_t get_last_displayed_row() {
     return add_rows(get_first_displayed_row(), DISPLAY_ROWS - 1);
 }
 
@@ -127,6 +195,12 @@ static inline void move_buffer_end() {
     monitor.buffer_end_row = next_row(monitor.buffer_end_row);
 }
 
+// A frozen display keeps the matched row, so new data stops once the next
+// line would push out a row that is on screen
+static inline bool buffer_end_is_pinned() {
+    return monitor.frozen && buffer_full() && buffer_start_is_displayed_on_first_row();
+}
+
 static void start_new_buffer_line() {
     if (buffer_full()) {
         // If we are looking at the buffer start and we are about to overwrite it,
@@ -135,16 +209,16 @@ static void start_new_buffer_line() {
             shift_display_down();
         }
 
-        flush_row(monitor.buffer_start_row);
         move_buffer_start();
     }
 
     // Autoscroll if we are looking at the last row
-    if (buffer_end_is_displayed_on_last_row()) {
+    if (!monitor.frozen && buffer_end_is_displayed_on_last_row()) {
         shift_display_down();
     }
 
     move_buffer_end();
+    flush_row(monitor.buffer_end_row);
     monitor.col_to_add = 0;
 
     increment_used_row_counter();
@@ -156,24 +230,150 @@ static void add_char_to_buffer(char c) {
     }
 
     if (monitor.col_to_add == COLS) {
+        if (buffer_end_is_pinned()) {
+            return;
+        }
         start_new_buffer_line();
     }
 
+    if (monitor.col_to_add == 0) {
+        scrollback_get_row(monitor.buffer_end_row)->timestamp = millis();
+    }
+
     if (c == '\n') {
         monitor.col_to_add = COLS;
         return;
     }
 
-    monitor.buffer[monitor.buffer_end_row][monitor.col_to_add] = c;
+    scrollback_get_row(monitor.buffer_end_row)->chars[monitor.col_to_add] = c;
     monitor.col_to_add++;
 }
 
-static void draw() {
-    for (uint8_t i = 0; i < DISPLAY_ROWS; i++) {
-        uint8_t current_row = add_rows(monitor.first_displayed_row, i);
+// Called from the RX interrupt, the matching row is always the buffer end
+static void handle_trigger_match() {
+    monitor.frozen = true;
+    monitor.first_displayed_row = sub_rows(monitor.buffer_end_row, DISPLAY_ROWS - 1);
+    monitor.trigger_matched = true;
+
+    if (monitor.stop_on_trigger) {
+        stop_usart_receive();
+    }
+}
+
+static void show_status(const char *label, const char *value, millis_t current_time) {
+    monitor.status_label = label;
+    monitor.status_value = value;
+    monitor.status_shown_at = current_time;
+}
+
+static bool status_is_visible(millis_t current_time) {
+    if (monitor.status_label == NULLPTR) {
+        return false;
+    }
+
+    if (current_time - monitor.status_shown_at >= STATUS_DURATION_MS) {
+        monitor.status_label = NULLPTR;
+        return false;
+    }
+
+    return true;
+}
+
+static void draw_status() {
+    uint8_t label_length = u8min(strlen(monitor.status_label), COLS);
+    uint8_t value_length = u8min(strlen(monitor.status_value), COLS - label_length);
+
+    clcd_set_cursor_position(0, 0);
+    clcd_write_chars(monitor.status_label, label_length);
+    clcd_write_chars(monitor.status_value, value_length);
+
+    for (uint8_t i = label_length + value_length; i < COLS; i++) {
+        clcd_write_char(EMPTY_CHAR);
+    }
+}
+
+static millis_t get_row_timestamp(scrollback_index_t row) {
+    disable_usart_rx_interrupt();
+    millis_t timestamp = scrollback_get_row(row)->timestamp;
+    enable_usart_rx_interrupt();
+
+    return timestamp;
+}
+
+static void draw_right_aligned(const char *text, uint8_t width) {
+    uint8_t length = strlen(text);
+
+    for (uint8_t i = length; i < width; i++) {
+        clcd_write_char(EMPTY_CHAR);
+    }
+    clcd_write_string(text);
+}
+
+static void draw_timestamp(scrollback_index_t row) {
+    char digits[TIMESTAMP_DIGITS + 1];
+
+    // The buffer ends move in the RX interrupt
+    disable_usart_rx_interrupt();
+    bool has_data = row_has_data(row);
+    bool is_buffer_start = row == monitor.buffer_start_row;
+    enable_usart_rx_interrupt();
+
+    if (!has_data) {
+        draw_right_aligned("", TIMESTAMP_COLS);
+        return;
+    }
+
+    millis_t timestamp = get_row_timestamp(row);
+
+    if (monitor.timestamp_mode == TIMESTAMP_ABSOLUTE) {
+        draw_right_aligned(utoa(timestamp % TIMESTAMP_ABSOLUTE_WRAP, digits, 10), TIMESTAMP_DIGITS);
+    } else if (is_buffer_start) {
+        // Nothing to compare the first row against
+        draw_right_aligned("-", TIMESTAMP_DIGITS);
+    } else {
+        millis_t delta = timestamp - get_row_timestamp(prev_row(row));
+
+        if (delta > TIMESTAMP_MAX_DELTA) {
+            clcd_write_char('>');
+            delta = TIMESTAMP_MAX_DELTA;
+        } else {
+            clcd_write_char('+');
+        }
+        draw_right_aligned(utoa(delta, digits, 10), TIMESTAMP_DIGITS - 1);
+    }
+
+    clcd_write_char(EMPTY_CHAR);
+}
+
+static void draw(millis_t current_time) {
+    uint8_t first_row_to_draw = 0;
+    trace_event(TRACE_LCD_FLUSH_START, 0);
+
+    if (status_is_visible(current_time)) {
+        draw_status();
+        first_row_to_draw = 1;
+    }
+
+    // The RX interrupt scrolls the display, and the row index is 16-bit with
+    // the external memory
+    disable_usart_rx_interrupt();
+    scrollback_index_t first_displayed_row = monitor.first_displayed_row;
+    enable_usart_rx_interrupt();
+
+    for (uint8_t i = first_row_to_draw; i < DISPLAY_ROWS; i++) {
+        scrollback_index_t current_row = add_rows(first_displayed_row, i);
+        const char *row_chars = scrollback_get_row(current_row)->chars;
         clcd_set_cursor_position(0, i);
-        clcd_write_chars(monitor.buffer[current_row], COLS);
+
+        if (monitor.timestamp_mode == TIMESTAMP_HIDDEN) {
+            clcd_write_chars(row_chars, COLS);
+        } else {
+            draw_timestamp(current_row);
+            clcd_write_chars(row_chars, COLS - TIMESTAMP_COLS);
+        }
     }
+
+    trace_event(TRACE_LCD_FLUSH_END, 0);
 }
 
 static void scroll_down() {
@@ -198,17 +398,94 @@ static void jump_display_to_buffer_end() {
     enable_usart_rx_interrupt();
 }
 
+// Unfreezes the display and restarts capture if a trigger stopped it
+static void resume_after_trigger() {
+    disable_usart_rx_interrupt();
+    monitor.frozen = false;
+    pattern_trigger_restart();
+    enable_usart_rx_interrupt();
+
+    start_usart_receive();
+}
+
+static void arm_trigger(const char *pattern, millis_t current_time) {
+    disable_usart_rx_interrupt();
+    pattern_trigger_arm(pattern);
+    enable_usart_rx_interrupt();
+
+    show_status("Trigger: ", pattern_trigger_get_pattern(), current_time);
+}
+
+static void arm_trigger_from_file(millis_t current_time) {
+    char pattern[PATTERN_TRIGGER_MAX_LENGTH + 1];
+
+    // Keep receiving while the card is being read, only arming is atomic
+    FRESULT f_err = storage_mount();
+    if (f_err == FR_OK) {
+        f_err = pattern_trigger_read_file(TRIGGER_FILE_PATH, pattern);
+    }
+
+    if (f_err != FR_OK) {
+        disable_usart_rx_interrupt();
+        pattern_trigger_disarm();
+        enable_usart_rx_interrupt();
+
+        show_status("Trigger: ", fresult_to_string(f_err), current_time);
+        return;
+    }
+
+    arm_trigger(pattern, current_time);
+}
+
+static void next_trigger_source(millis_t current_time) {
+    monitor.trigger_source = (monitor.trigger_source + 1) % TRIGGER_SOURCE_COUNT;
+
+    if (monitor.trigger_source == TRIGGER_SOURCE_OFF) {
+        disable_usart_rx_interrupt();
+        pattern_trigger_disarm();
+        enable_usart_rx_interrupt();
+
+        show_status("Trigger: ", "off", current_time);
+    } else if (monitor.trigger_source == TRIGGER_SOURCE_FILE) {
+        arm_trigger_from_file(current_time);
+    } else {
+        arm_trigger(trigger_presets[monitor.trigger_source - 1], current_time);
+    }
+}
+
+static void toggle_stop_on_trigger(millis_t current_time) {
+    monitor.stop_on_trigger = !monitor.stop_on_trigger;
+    show_status("Match stops: ", monitor.stop_on_trigger ? "yes" : "no", current_time);
+}
+
+static void next_timestamp_mode() {
+    monitor.timestamp_mode = (monitor.timestamp_mode + 1) % TIMESTAMP_MODE_COUNT;
+}
+
 static void cleanup_monitor() {
     stop_usart_receive();
+    usart_set_rx_handler(MONITOR_USART, NULLPTR);
 }
 
-static tick_callback_result_t serial_monitor_tick(millis_t _) {
+static tick_callback_result_t serial_monitor_tick(millis_t current_time) {
+    if (monitor.trigger_matched) {
+        monitor.trigger_matched = false;
+        show_status("Trigger matched", "", current_time);
+    }
+
     if (button_was_pressed(BUTTON_UP)) {
         scroll_up();
     } else if (button_was_pressed(BUTTON_SELECT)) {
+        resume_after_trigger();
         jump_display_to_buffer_end();
     } else if (button_was_pressed(BUTTON_DOWN)) {
         scroll_down();
+    } else if (button_was_pressed(BUTTON_CUSTOM_ACTION_0)) {
+        next_timestamp_mode();
+    } else if (button_was_pressed(BUTTON_CUSTOM_ACTION_1)) {
+        next_trigger_source(current_time);
+    } else if (button_was_pressed(BUTTON_CUSTOM_ACTION_2)) {
+        toggle_stop_on_trigger(current_time);
     } else if (button_was_pressed(BUTTON_CUSTOM_ACTION_3)) {
         flush_buffer();
     } else if (button_was_pressed(BUTTON_BACK)) {
@@ -216,25 +493,29 @@ static tick_callback_result_t serial_monitor_tick(millis_t _) {
         return TICK_CALLBACK_FINISHED;
     }
 
-    draw();
+    draw(current_time);
     return TICK_CALLBACK_CONTINUE;
 }
 
+// Called from the USART RX interrupt
+static void receive_byte(uint8_t byte) {
+    char c = byte;
+    add_char_to_buffer(c);
+
+    if (!monitor.frozen && pattern_trigger_feed(c)) {
+        handle_trigger_match();
+    }
+}
+
 tick_callback_t switch_to_serial_monitor() {
     clcd_cursor_off();
+    usart_set_rx_handler(MONITOR_USART, &receive_byte);
     start_usart_receive();
 
     return &serial_monitor_tick;
 }
 
 void serial_monitor_init() {
+    scrollback_init();
     flush_buffer();
 }
-
-ISR(USART1_RX_vect) {
-    uint8_t status = UCSR1A;
-    char c = UDR1;
-    if (bit_is_clear(status, FE) && bit_is_clear(status, DOR) && bit_is_clear(status, UPE)) {
-        add_char_to_buffer(c);
-    }
-}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include <string.h>
+#include "fatfs/ff.h"
+#include "storage.h"
+
+static FATFS file_system;
+
+const char *fresult_to_string(FRESULT result) {
+    switch (result) {
+        case FR_OK:
+            return "FS OK";
+        case FR_DISK_ERR:
+            return "Disk Error";
+        case FR_INT_ERR:
+            return "Internal Error";
+        case FR_NOT_READY:
+            return "Not Ready";
+        case FR_NO_FILE:
+            return "No File";
+        case FR_NO_PATH:
+            return "No Path";
+        case FR_INVALID_NAME:
+            return "Invalid Name";
+        case FR_DENIED:
+            return "Denied";
+        case FR_EXIST:
+            return "Exist";
+        case FR_INVALID_OBJECT:
+            return "Invalid Object";
+        case FR_WRITE_PROTECTED:
+            return "Write Protected";
+        case FR_INVALID_DRIVE:
+            return "Invalid Drive";
+        case FR_NOT_ENABLED:
+            return "Not Enabled";
+        case FR_NO_FILESYSTEM:
+            return "No Filesystem";
+        case FR_MKFS_ABORTED:
+            return "MKFS Aborted";
+        case FR_TIMEOUT:
+            return "Timed Out";
+        case FR_LOCKED:
+            return "Locked";
+        case FR_NOT_ENOUGH_CORE:
+            return "Not Enough Core";
+        case FR_TOO_MANY_OPEN_FILES:
+            return "Too Many Files";
+        case FR_INVALID_PARAMETER:
+            return "Invalid Param";
+        default:
+            return "Unknown";
+    }
+}
+
+FRESULT storage_mount() {
+    return f_mount(&file_system, "", 1);
+}
+
+FRESULT storage_open_sibling(FIL *file, const char *name, const char *extension) {
+    char path[FF_LFN_BUF + 1];
+
+    const char *dot = strrchr(name, '.');
+    size_t base_length = dot != NULL ? (size_t)(dot - name) : strlen(name);
+    if (base_length + strlen(extension) >= sizeof(path)) {
+        return FR_INVALID_NAME;
+    }
+
+    memcpy(path, name, base_length);
+    strcpy(path + base_length, extension);
+
+    return f_open(file, path, FA_READ);
+}
@@ -0,0 +1,140 @@
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <util/atomic.h>
+#include <millis.h>
+#include "profiler.h"
+#include "usart.h"
+#include "util.h"
+
+#if PROFILER_ENABLED
+#error "The profiler and the trace both take commands on USART0, enable only one of them"
+#endif
+
+#define TRACE_USART USART_PORT_0
+
+#define COMMAND_DUMP 't'
+#define COMMAND_CLEAR 'c'
+
+#define HEADER_SIZE 8
+#define ARGUMENT_SIZE 3
+
+typedef struct {
+    uint16_t time;
+    uint8_t event;
+    uint8_t argument[ARGUMENT_SIZE];
+} trace_record_t;
+
+_Static_assert(sizeof(trace_record_t) == 6, "Trace records are sent as they are");
+_Static_assert(TRACE_RECORDS <= UINT8_MAX, "Ring positions are 8-bit");
+
+static struct {
+    trace_record_t records[TRACE_RECORDS];
+    uint8_t next;
+    uint8_t count;
+    uint16_t dropped;
+
+    bool dumping;
+    uint8_t header[HEADER_SIZE];
+    uint16_t dump_position;
+    uint16_t dump_size;
+    uint16_t dump_dropped;
+} trace;
+
+void trace_event(trace_event_t event, uint32_t argument) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        // The ring is sent as it is, so nothing may change it meanwhile
+        if (trace.dumping) {
+            if (trace.dropped != UINT16_MAX) {
+                trace.dropped++;
+            }
+        } else {
+            trace_record_t *record = &trace.records[trace.next];
+            record->time = micros();
+            record->event = event;
+            record->argument[0] = argument;
+            record->argument[1] = argument >> 8;
+            record->argument[2] = argument >> 16;
+
+            trace.next = (trace.next + 1) % TRACE_RECORDS;
+            if (trace.count < TRACE_RECORDS) {
+                trace.count++;
+            }
+        }
+    }
+}
+
+static void clear() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        trace.next = 0;
+        trace.count = 0;
+    }
+}
+
+static void start_dump() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        trace.dumping = true;
+        trace.dump_dropped = trace.dropped;
+        trace.dropped = 0;
+    }
+
+    trace.header[0] = 'T';
+    trace.header[1] = 'R';
+    trace.header[2] = 'C';
+    trace.header[3] = '1';
+    trace.header[4] = trace.count;
+    trace.header[5] = 0;
+    trace.header[6] = trace.dump_dropped;
+    trace.header[7] = trace.dump_dropped >> 8;
+
+    trace.dump_position = 0;
+    trace.dump_size = HEADER_SIZE + trace.count * sizeof(trace_record_t);
+}
+
+static uint8_t get_dump_byte(uint16_t position) {
+    if (position < HEADER_SIZE) {
+        return trace.header[position];
+    }
+
+    position -= HEADER_SIZE;
+    // The oldest record is the next one to be overwritten once the ring is full
+    uint8_t first = trace.count < TRACE_RECORDS ? 0 : trace.next;
+    uint8_t index = (first + position / sizeof(trace_record_t)) % TRACE_RECORDS;
+    return ((const uint8_t *)&trace.records[index])[position % sizeof(trace_record_t)];
+}
+
+// Sends as much as fits into the TX buffer, so the main loop never waits
+static void continue_dump() {
+    while (trace.dump_position < trace.dump_size && usart_tx_buffered(TRACE_USART) < USART_TX_BUFFER_SIZE - 1) {
+        usart_write_byte(TRACE_USART, get_dump_byte(trace.dump_position++));
+    }
+
+    if (trace.dump_position == trace.dump_size) {
+        clear();
+        trace.dumping = false;
+    }
+}
+
+void trace_poll() {
+    // The serial bridge turns USART0 off when it is left
+    usart_start_receive(TRACE_USART);
+    usart_start_transmit(TRACE_USART);
+
+    uint8_t byte;
+    while (usart_read_byte(TRACE_USART, &byte)) {
+        if (byte == COMMAND_DUMP && !trace.dumping) {
+            start_dump();
+        } else if (byte == COMMAND_CLEAR && !trace.dumping) {
+            clear();
+        }
+    }
+
+    if (trace.dumping) {
+        continue_dump();
+    }
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include <stdbool.h>
+#include <string.h>
+#include "fatfs/ff.h"
+#include "upload_files.h"
+#include "file_picker.h"
+#include "storage.h"
+#include "uploader.h"
+#include "avr_parts.h"
+#include "util.h"
+
+// Optional file next to the image which names the part it was built for
+#define PART_FILE_EXTENSION ".part"
+// EEPROM image which avr-objcopy writes next to the flash image
+#define EEPROM_FILE_EXTENSION ".eep"
+
+#define BINARY_FILE_EXTENSION ".bin"
+#define ELF_FILE_EXTENSION ".elf"
+
+static struct {
+    FIL eeprom_file;
+    bool has_eeprom_file;
+    // Kept for the error message
+    char part_name[AVR_PART_NAME_MAX_LENGTH + 2];
+} files;
+
+// Without a part file, any part which the image fits into is accepted
+static FRESULT read_expected_part(const avr_part_t **part) {
+    FIL part_file;
+    UINT read;
+
+    *part = NULLPTR;
+    files.part_name[0] = '\0';
+
+    FRESULT f_err = storage_open_sibling(&part_file, file_picker_get_selected_name(), PART_FILE_EXTENSION);
+    if (f_err == FR_NO_FILE) {
+        return FR_OK;
+    } else if (f_err != FR_OK) {
+        return f_err;
+    }
+
+    f_err = f_read(&part_file, files.part_name, AVR_PART_NAME_MAX_LENGTH + 1, &read);
+    f_close(&part_file);
+    if (f_err != FR_OK) {
+        return f_err;
+    }
+
+    files.part_name[read] = '\0';
+    files.part_name[strcspn(files.part_name, " \t\r\n")] = '\0';
+
+    *part = avr_parts_find_by_name(files.part_name);
+    return FR_OK;
+}
+
+// Production images come with their EEPROM contents, which are uploaded in
+// the same session when they are there
+static FRESULT open_eeprom_file() {
+    upload_files_close();
+
+    FRESULT f_err = storage_open_sibling(&files.eeprom_file, file_picker_get_selected_name(), EEPROM_FILE_EXTENSION);
+    if (f_err == FR_NO_FILE) {
+        return FR_OK;
+    } else if (f_err != FR_OK) {
+        return f_err;
+    }
+
+    files.has_eeprom_file = true;
+    return FR_OK;
+}
+
+// Anything which isn't a raw binary or an ELF file is read as Intel HEX
+static image_format_t get_image_format(const char *name) {
+    const char *extension = strrchr(name, '.');
+    if (extension == NULLPTR) {
+        return IMAGE_FORMAT_INTEL_HEX;
+    }
+
+    if (strcasecmp(extension, BINARY_FILE_EXTENSION) == 0) {
+        return IMAGE_FORMAT_BINARY;
+    } else if (strcasecmp(extension, ELF_FILE_EXTENSION) == 0) {
+        return IMAGE_FORMAT_ELF;
+    }
+
+    return IMAGE_FORMAT_INTEL_HEX;
+}
+
+bool upload_files_prepare(FIL *file, upload_mode_t mode, upload_config_t *config, const char **title, const char **message) {
+    const avr_part_t *expected_part;
+
+    FRESULT f_err = read_expected_part(&expected_part);
+    if (f_err != FR_OK) {
+        *title = "Part file error";
+        *message = fresult_to_string(f_err);
+        return false;
+    } else if (files.part_name[0] != '\0' && expected_part == NULLPTR) {
+        *title = "Unknown part";
+        *message = files.part_name;
+        return false;
+    }
+
+    f_err = open_eeprom_file();
+    if (f_err != FR_OK) {
+        *title = "EEP file error";
+        *message = fresult_to_string(f_err);
+        return false;
+    }
+
+    config->flash_file = file;
+    config->flash_format = get_image_format(file_picker_get_selected_name());
+    config->flash_timestamp = file_picker_get_selected_timestamp();
+    config->eeprom_file = files.has_eeprom_file ? &files.eeprom_file : NULLPTR;
+    config->mode = mode;
+    config->expected_part = expected_part;
+
+    return true;
+}
+
+void upload_files_close() {
+    if (files.has_eeprom_file) {
+        f_close(&files.eeprom_file);
+        files.has_eeprom_file = false;
+    }
+}
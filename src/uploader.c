@@ -0,0 +1,682 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <millis.h>
+#include "fatfs/ff.h"
+#include "avr109_driver.h"
+#include "avr_parts.h"
+#include "image_cache.h"
+#include "page_reader.h"
+#include "trace.h"
+#include "uploader.h"
+#include "util.h"
+
+// Forces an address command before the first page
+#define NO_ADDRESS UINT32_MAX
+
+// Attempts per page before a communication error fails the upload
+#define MAX_PAGE_ATTEMPTS 4
+
+// Below 1% of the file the estimate is too rough to show
+#define ETA_MIN_PROGRESS_DIVIDER 100
+#define ETA_RATIO_SCALE 256
+
+// avr-objcopy writes 16 data bytes per 45 character record, images with
+// longer records hold even more data per file byte
+#define HEX_RECORD_DATA_SIZE 16
+#define HEX_RECORD_LENGTH 45
+
+#define DEVICE_CODE_BUFFER_SIZE 8
+
+#define VERIFY_ERROR_PREFIX "Verify @0x"
+#define EEPROM_VERIFY_ERROR_PREFIX "EE verify @0x"
+#define PART_ERROR_PREFIX "Part "
+#define ERROR_TEXT_SIZE 17
+
+// Steps which talk to the target start a command and wait for it in the
+// following calls, the others finish immediately
+typedef enum {
+    STEP_READ_PROGRAMMER_ID = 0,
+    STEP_READ_DEVICE_CODES,
+    STEP_ENTER_PROGRAMMING_MODE,
+    STEP_READ_SIGNATURE,
+    STEP_GET_BLOCK_SIZE,
+    STEP_MEASURE_IMAGE,
+    STEP_ERASE,
+    STEP_NEXT_PAGE,
+    STEP_SET_ADDRESS,
+    STEP_READ_BACK_PAGE,
+    STEP_WRITE_PAGE,
+    STEP_VERIFY_PAGE,
+    STEP_RESYNC,
+    STEP_LEAVE_PROGRAMMING_MODE,
+    STEP_EXIT_BOOTLOADER,
+    STEP_ABORT,
+    STEP_DONE,
+    STEP_FAILED
+} upload_step_t;
+
+static struct {
+    upload_step_t step;
+    // Page command which is sent once the address command went through
+    upload_step_t step_after_address;
+    bool command_started;
+    bool verifying;
+    upload_config_t config;
+    // Flash is uploaded first, EEPROM afterwards if there is an image for it
+    avr109_memory_t memory;
+    bool abort_requested;
+    page_reader_t reader;
+    // Pages come from the image cache instead of the reader
+    bool reading_cache;
+    bool filling_cache;
+    uint16_t cache_index;
+    // Image of the memory which is being uploaded
+    FIL *file;
+    uint8_t page[PAGE_READER_MAX_PAGE_SIZE];
+    uint16_t page_size;
+    const avr_part_t *part;
+    char programmer_id[AVR109_PROGRAMMER_ID_LENGTH + 1];
+    uint8_t device_codes[DEVICE_CODE_BUFFER_SIZE];
+    uint8_t signature[AVR109_SIGNATURE_SIZE];
+    uint16_t block_size;
+    uint16_t mismatch_offset;
+    // Where the bootloader's address counter points after the last block
+    uint32_t target_address;
+    // End of the last page taken from the image, used to count skipped pages
+    uint32_t image_address;
+    // millis_t wraps after 65.5 s on the AVR, a pass of a large image at a
+    // low baud rate takes longer
+    micros_t image_start_time;
+    // Page taken from the image which has not been acknowledged yet
+    uint32_t page_address;
+    // In UPLOAD_MODE_CHANGES a written page is verified right away, there
+    // is no verify pass over the pages which already matched
+    bool page_written;
+    uint8_t page_attempts;
+    uint16_t written_pages;
+    uint16_t skipped_pages;
+    uint16_t retries;
+    const char *error;
+    char error_text[ERROR_TEXT_SIZE];
+} upload;
+
+static void go_to_step(upload_step_t step) {
+    upload.step = step;
+    upload.command_started = false;
+}
+
+static upload_result_t fail(const char *error) {
+    upload.error = error;
+    go_to_step(STEP_FAILED);
+    avr109_end();
+
+    return UPLOAD_FAILED;
+}
+
+static upload_result_t fail_avr109(avr109_error_t err) {
+    return fail(avr109_error_to_string(err));
+}
+
+static upload_result_t fail_verify(uint32_t address) {
+    char digits[9];
+
+    strcpy(upload.error_text, upload.memory == AVR109_MEMORY_FLASH ? VERIFY_ERROR_PREFIX : EEPROM_VERIFY_ERROR_PREFIX);
+    strcat(upload.error_text, ultoa(address, digits, 16));
+
+    return fail(upload.error_text);
+}
+
+static upload_result_t fail_part(const avr_part_t *part) {
+    strcpy(upload.error_text, PART_ERROR_PREFIX);
+    strcat(upload.error_text, part->name);
+
+    return fail(upload.error_text);
+}
+
+static inline bool is_power_of_two(uint16_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static inline bool is_retryable(avr109_error_t err) {
+    return err == AVR109_ERROR_TIMEOUT || err == AVR109_ERROR_NO_ACK;
+}
+
+// Starts decoding the image file from its beginning
+static void start_image() {
+    // Without a chip erase, blank pages might still have to be written. The
+    // EEPROM is kept by chip erases when the EESAVE fuse is programmed.
+    bool skip_blank_pages = upload.config.mode == UPLOAD_MODE_FULL && upload.memory == AVR109_MEMORY_FLASH;
+
+    // EEPROM images always come as HEX files
+    image_format_t format = upload.memory == AVR109_MEMORY_FLASH ? upload.config.flash_format : IMAGE_FORMAT_INTEL_HEX;
+
+    upload.image_start_time = micros();
+    upload.cache_index = 0;
+    upload.filling_cache = false;
+    upload.reading_cache = false;
+
+    // Only the flash image is cached, the EEPROM image is small
+    if (upload.memory == AVR109_MEMORY_FLASH) {
+        image_cache_key_t key = {
+            .file_size = f_size(upload.file),
+            .start_cluster = upload.file->obj.sclust,
+            .timestamp = upload.config.flash_timestamp,
+            .page_size = upload.page_size,
+            .format = format,
+            .skip_blank_pages = skip_blank_pages
+        };
+
+        if (image_cache_lookup(&key)) {
+            upload.reading_cache = true;
+            return;
+        }
+
+        if (!upload.verifying) {
+            image_cache_begin(&key);
+            upload.filling_cache = true;
+        }
+    }
+
+    f_rewind(upload.file);
+    page_reader_init(&upload.reader, upload.file, format, upload.page_size, skip_blank_pages);
+}
+
+// Pages left out by the reader are jumped over with an address command,
+// consecutive pages rely on the bootloader's auto increment
+static void go_to_page_step(upload_step_t step) {
+    if (upload.page_address == upload.target_address) {
+        go_to_step(step);
+    } else {
+        upload.step_after_address = step;
+        go_to_step(STEP_SET_ADDRESS);
+    }
+}
+
+static upload_step_t first_flash_step() {
+    return upload.config.mode == UPLOAD_MODE_FULL ? STEP_ERASE : STEP_NEXT_PAGE;
+}
+
+static upload_step_t first_page_step() {
+    if (upload.verifying || upload.page_written) {
+        return STEP_VERIFY_PAGE;
+    }
+
+    return upload.config.mode == UPLOAD_MODE_CHANGES ? STEP_READ_BACK_PAGE : STEP_WRITE_PAGE;
+}
+
+// Only the page in flight is sent again, everything before it was acknowledged
+static upload_result_t retry_page(avr109_error_t err) {
+    if (!is_retryable(err) || ++upload.page_attempts >= MAX_PAGE_ATTEMPTS) {
+        return fail_avr109(err);
+    }
+
+    upload.retries++;
+    go_to_step(STEP_RESYNC);
+
+    return UPLOAD_IN_PROGRESS;
+}
+
+static void start_memory(avr109_memory_t memory, FIL *file) {
+    upload.memory = memory;
+    upload.file = file;
+    upload.verifying = false;
+    upload.target_address = NO_ADDRESS;
+    upload.image_address = NO_ADDRESS;
+
+    start_image();
+}
+
+static uint32_t get_memory_size() {
+    return upload.memory == AVR109_MEMORY_FLASH ? upload.part->flash_size : upload.part->eeprom_size;
+}
+
+static void finish_pass() {
+    if (upload.filling_cache) {
+        image_cache_commit();
+    }
+
+    if (!upload.verifying && upload.config.mode == UPLOAD_MODE_FULL) {
+        // The image is decoded a second time and compared against the
+        // target as the block read arrives, so no copy has to be kept
+        upload.verifying = true;
+        start_image();
+    } else if (upload.memory == AVR109_MEMORY_FLASH && upload.config.eeprom_file != NULLPTR) {
+        start_memory(AVR109_MEMORY_EEPROM, upload.config.eeprom_file);
+    } else {
+        go_to_step(STEP_LEAVE_PROGRAMMING_MODE);
+    }
+}
+
+static page_reader_result_t read_next_page() {
+    if (upload.reading_cache) {
+        if (upload.cache_index == image_cache_get_page_count()) {
+            return PAGE_READER_END;
+        }
+
+        image_cache_get_page(upload.cache_index++, &upload.page_address, upload.page);
+        return PAGE_READER_OK;
+    }
+
+    page_reader_result_t result = page_reader_next_page(&upload.reader, &upload.page_address, upload.page);
+    if (result == PAGE_READER_OK && upload.filling_cache) {
+        image_cache_append(upload.page_address, upload.page);
+    }
+
+    return result;
+}
+
+static upload_result_t take_next_page() {
+    page_reader_result_t result = read_next_page();
+    if (result == PAGE_READER_END) {
+        finish_pass();
+        return UPLOAD_IN_PROGRESS;
+    } else if (result != PAGE_READER_OK) {
+        return fail(page_reader_error_to_string(&upload.reader, result));
+    }
+
+    if (upload.part != NULLPTR && upload.page_address + upload.page_size > get_memory_size()) {
+        return fail("Image too large");
+    }
+
+    if (!upload.verifying) {
+        if (upload.image_address != NO_ADDRESS) {
+            upload.skipped_pages += (upload.page_address - upload.image_address) / upload.page_size;
+        }
+        upload.image_address = upload.page_address + upload.page_size;
+    }
+
+    upload.page_written = false;
+    upload.page_attempts = 0;
+    go_to_page_step(first_page_step());
+
+    return UPLOAD_IN_PROGRESS;
+}
+
+static void start_step_command() {
+    switch (upload.step) {
+        case STEP_READ_PROGRAMMER_ID:
+            avr109_read_programmer_id(upload.programmer_id);
+            break;
+        case STEP_READ_DEVICE_CODES:
+            avr109_read_device_codes(upload.device_codes, DEVICE_CODE_BUFFER_SIZE);
+            break;
+        case STEP_ENTER_PROGRAMMING_MODE:
+            avr109_enter_programming_mode();
+            break;
+        case STEP_READ_SIGNATURE:
+            avr109_read_signature(upload.signature);
+            break;
+        case STEP_GET_BLOCK_SIZE:
+            avr109_get_block_size(&upload.block_size);
+            break;
+        case STEP_ERASE:
+            avr109_chip_erase();
+            break;
+        case STEP_SET_ADDRESS:
+            // Flash is addressed in words, EEPROM in bytes
+            avr109_set_address(upload.memory == AVR109_MEMORY_FLASH ? upload.page_address / 2 : upload.page_address);
+            break;
+        case STEP_READ_BACK_PAGE:
+        case STEP_VERIFY_PAGE:
+            avr109_compare_block(upload.memory, upload.page, upload.page_size, &upload.mismatch_offset);
+            break;
+        case STEP_WRITE_PAGE:
+            trace_event(TRACE_UPLOAD_PAGE_SENT, upload.page_address);
+            avr109_write_block(upload.memory, upload.page, upload.page_size);
+            break;
+        case STEP_RESYNC:
+            avr109_resync(upload.page_size);
+            break;
+        case STEP_LEAVE_PROGRAMMING_MODE:
+        case STEP_ABORT:
+            avr109_leave_programming_mode();
+            break;
+        case STEP_EXIT_BOOTLOADER:
+            avr109_exit_bootloader();
+            break;
+        default:
+            break;
+    }
+}
+
+// Only a hint, record lengths, line ends and address records all change it.
+// ELF files also carry symbols and debug information, their pages are only
+// checked against the flash size one by one.
+static uint32_t estimate_image_size() {
+    switch (upload.config.flash_format) {
+        case IMAGE_FORMAT_INTEL_HEX:
+            return f_size(upload.config.flash_file) / HEX_RECORD_LENGTH * HEX_RECORD_DATA_SIZE;
+        case IMAGE_FORMAT_BINARY:
+            return f_size(upload.config.flash_file);
+        case IMAGE_FORMAT_ELF:
+        default:
+            return 0;
+    }
+}
+
+// Runs before anything is written, so a wrong board fails right away
+static upload_result_t identify_part() {
+    upload.part = avr_parts_find_by_signature(upload.signature);
+    if (upload.part == NULLPTR) {
+        // Some bootloaders don't know the signature of their own part
+        upload.part = avr_parts_find_by_device_codes(upload.device_codes);
+    }
+
+    if (upload.config.expected_part != NULLPTR) {
+        if (upload.part == NULLPTR) {
+            return fail("Unknown part");
+        } else if (upload.part != upload.config.expected_part) {
+            return fail_part(upload.part);
+        }
+    }
+
+    go_to_step(STEP_GET_BLOCK_SIZE);
+    return UPLOAD_IN_PROGRESS;
+}
+
+static upload_result_t finish_block_size() {
+    // The block size reported by AVR109 bootloaders is the flash page size
+    if (upload.block_size > PAGE_READER_MAX_PAGE_SIZE || !is_power_of_two(upload.block_size)) {
+        return fail("Bad page size");
+    }
+
+    upload.page_size = upload.block_size;
+    start_memory(AVR109_MEMORY_FLASH, upload.config.flash_file);
+
+    if (upload.part != NULLPTR && estimate_image_size() > upload.part->flash_size) {
+        go_to_step(STEP_MEASURE_IMAGE);
+    } else {
+        go_to_step(first_flash_step());
+    }
+    return UPLOAD_IN_PROGRESS;
+}
+
+// Runs when the file looks too large for the part. The image is decoded
+// once before anything is erased and only fails on a page past the end of
+// the flash. The pass fills the image cache, so the upload reads it from
+// there afterwards.
+static upload_result_t measure_next_page() {
+    page_reader_result_t result = read_next_page();
+    if (result == PAGE_READER_OK) {
+        if (upload.page_address + upload.page_size > upload.part->flash_size) {
+            return fail("Image too large");
+        }
+        return UPLOAD_IN_PROGRESS;
+    } else if (result != PAGE_READER_END) {
+        return fail(page_reader_error_to_string(&upload.reader, result));
+    }
+
+    if (upload.filling_cache) {
+        image_cache_commit();
+    }
+    start_image();
+
+    go_to_step(first_flash_step());
+    return UPLOAD_IN_PROGRESS;
+}
+
+static upload_result_t finish_page_command() {
+    upload.target_address = upload.page_address + upload.page_size;
+    bool matches = upload.mismatch_offset == upload.page_size;
+
+    switch (upload.step) {
+        case STEP_READ_BACK_PAGE:
+            if (!matches) {
+                // The read moved the bootloader's address past the page
+                go_to_page_step(STEP_WRITE_PAGE);
+                return UPLOAD_IN_PROGRESS;
+            }
+            upload.skipped_pages++;
+            break;
+        case STEP_WRITE_PAGE:
+            trace_event(TRACE_UPLOAD_PAGE_ACKED, upload.page_address);
+            upload.written_pages++;
+            if (upload.config.mode == UPLOAD_MODE_CHANGES) {
+                upload.page_written = true;
+                go_to_page_step(STEP_VERIFY_PAGE);
+                return UPLOAD_IN_PROGRESS;
+            }
+            break;
+        case STEP_VERIFY_PAGE:
+        default:
+            if (!matches) {
+                return fail_verify(upload.page_address + upload.mismatch_offset);
+            }
+            break;
+    }
+
+    go_to_step(STEP_NEXT_PAGE);
+    return UPLOAD_IN_PROGRESS;
+}
+
+static upload_result_t finish_step_command(avr109_error_t err) {
+    switch (upload.step) {
+        case STEP_SET_ADDRESS:
+        case STEP_READ_BACK_PAGE:
+        case STEP_WRITE_PAGE:
+        case STEP_VERIFY_PAGE:
+            if (err != AVR109_ERROR_OK) {
+                return retry_page(err);
+            }
+            break;
+        case STEP_RESYNC:
+            // A failed resync shows up as another failed attempt
+            upload.target_address = NO_ADDRESS;
+            go_to_page_step(first_page_step());
+            return UPLOAD_IN_PROGRESS;
+        case STEP_ABORT:
+            // Best effort, the target might not be listening anymore
+            return fail("Aborted");
+        default:
+            if (err != AVR109_ERROR_OK) {
+                return fail_avr109(err);
+            }
+            break;
+    }
+
+    switch (upload.step) {
+        case STEP_READ_PROGRAMMER_ID:
+            go_to_step(STEP_READ_DEVICE_CODES);
+            return UPLOAD_IN_PROGRESS;
+        case STEP_READ_DEVICE_CODES:
+            go_to_step(STEP_ENTER_PROGRAMMING_MODE);
+            return UPLOAD_IN_PROGRESS;
+        case STEP_ENTER_PROGRAMMING_MODE:
+            go_to_step(STEP_READ_SIGNATURE);
+            return UPLOAD_IN_PROGRESS;
+        case STEP_READ_SIGNATURE:
+            return identify_part();
+        case STEP_GET_BLOCK_SIZE:
+            return finish_block_size();
+        case STEP_ERASE:
+            go_to_step(STEP_NEXT_PAGE);
+            return UPLOAD_IN_PROGRESS;
+        case STEP_SET_ADDRESS:
+            upload.target_address = upload.page_address;
+            go_to_step(upload.step_after_address);
+            return UPLOAD_IN_PROGRESS;
+        case STEP_LEAVE_PROGRAMMING_MODE:
+            go_to_step(STEP_EXIT_BOOTLOADER);
+            return UPLOAD_IN_PROGRESS;
+        case STEP_EXIT_BOOTLOADER:
+            avr109_end();
+            go_to_step(STEP_DONE);
+            return UPLOAD_DONE;
+        default:
+            return finish_page_command();
+    }
+}
+
+// Returns false once the step has to wait for the target
+static bool run_step(upload_result_t *result) {
+    if (upload.step == STEP_DONE) {
+        *result = UPLOAD_DONE;
+        return false;
+    } else if (upload.step == STEP_FAILED) {
+        *result = UPLOAD_FAILED;
+        return false;
+    }
+
+    *result = UPLOAD_IN_PROGRESS;
+
+    if (!upload.command_started) {
+        // Aborting waits for the running command, so the target never gets
+        // a command in the middle of a block
+        if (upload.abort_requested && upload.step != STEP_ABORT) {
+            go_to_step(STEP_ABORT);
+        }
+
+        if (upload.step == STEP_NEXT_PAGE) {
+            *result = take_next_page();
+            return true;
+        } else if (upload.step == STEP_MEASURE_IMAGE) {
+            // A page per call, so the main loop keeps going meanwhile
+            *result = measure_next_page();
+            return false;
+        }
+
+        start_step_command();
+        upload.command_started = true;
+    }
+
+    avr109_error_t err = avr109_poll();
+    if (err == AVR109_ERROR_PENDING) {
+        return false;
+    }
+
+    upload.command_started = false;
+    *result = finish_step_command(err);
+    return true;
+}
+
+void uploader_start(const upload_config_t *config) {
+    upload.config = *config;
+    upload.file = config->flash_file;
+    upload.memory = AVR109_MEMORY_FLASH;
+    upload.part = NULLPTR;
+    upload.verifying = false;
+    upload.abort_requested = false;
+    upload.target_address = NO_ADDRESS;
+    upload.image_address = NO_ADDRESS;
+    upload.written_pages = 0;
+    upload.skipped_pages = 0;
+    upload.retries = 0;
+    upload.error = NULLPTR;
+
+    go_to_step(STEP_READ_PROGRAMMER_ID);
+    avr109_begin();
+}
+
+upload_result_t uploader_step() {
+    upload_result_t result;
+    while (run_step(&result)) {
+        // Keep going until the target has to be waited for
+    }
+
+    return result;
+}
+
+void uploader_abort() {
+    upload.abort_requested = true;
+}
+
+const char *uploader_get_activity() {
+    if (upload.abort_requested) {
+        return "Abort";
+    }
+
+    switch (upload.step) {
+        case STEP_READ_PROGRAMMER_ID:
+        case STEP_READ_DEVICE_CODES:
+        case STEP_ENTER_PROGRAMMING_MODE:
+        case STEP_READ_SIGNATURE:
+        case STEP_GET_BLOCK_SIZE:
+            return "Connect";
+        case STEP_MEASURE_IMAGE:
+            return "Size";
+        case STEP_ERASE:
+            return "Erase";
+        case STEP_LEAVE_PROGRAMMING_MODE:
+        case STEP_EXIT_BOOTLOADER:
+        case STEP_DONE:
+        case STEP_FAILED:
+            return "Finish";
+        default:
+            if (upload.memory == AVR109_MEMORY_EEPROM) {
+                return upload.verifying ? "EE verify" : "EEPROM";
+            }
+            return upload.verifying ? "Verify" : "Write";
+    }
+}
+
+const avr_part_t *uploader_get_part() {
+    return upload.part;
+}
+
+const char *uploader_get_programmer_id() {
+    return upload.programmer_id;
+}
+
+const char *uploader_get_error() {
+    return upload.error;
+}
+
+uint16_t uploader_get_written_pages() {
+    return upload.written_pages;
+}
+
+uint16_t uploader_get_skipped_pages() {
+    return upload.skipped_pages;
+}
+
+uint16_t uploader_get_retries() {
+    return upload.retries;
+}
+
+// In file bytes, or in pages when they come from the cache
+static void get_pass_position(uint32_t *position, uint32_t *size) {
+    if (upload.reading_cache) {
+        *position = upload.cache_index;
+        *size = image_cache_get_page_count();
+    } else {
+        *position = f_tell(upload.file);
+        *size = f_size(upload.file);
+    }
+}
+
+uint8_t uploader_get_progress() {
+    uint32_t position;
+    uint32_t size;
+
+    get_pass_position(&position, &size);
+    if (size == 0) {
+        return 100;
+    }
+
+    return (uint8_t)(position * 100UL / size);
+}
+
+// Extrapolated from how long the processed part of the image took
+uint16_t uploader_get_eta_seconds() {
+    uint32_t position;
+    uint32_t size;
+
+    get_pass_position(&position, &size);
+    bool decoding = upload.step >= STEP_NEXT_PAGE && upload.step <= STEP_RESYNC;
+
+    if (!decoding || position == 0 || position < size / ETA_MIN_PROGRESS_DIVIDER) {
+        return UPLOADER_ETA_UNKNOWN;
+    }
+
+    // Remaining bytes per processed byte, in 1/ETA_RATIO_SCALE
+    uint32_t ratio = (size - position) * ETA_RATIO_SCALE / position;
+    uint32_t elapsed = (micros() - upload.image_start_time) / 1000;
+    if (ratio != 0 && elapsed > UINT32_MAX / ratio) {
+        return UPLOADER_ETA_MAX_SECONDS;
+    }
+
+    uint32_t seconds = elapsed * ratio / ETA_RATIO_SCALE / 1000;
+    return seconds > UPLOADER_ETA_MAX_SECONDS ? UPLOADER_ETA_MAX_SECONDS : seconds;
+}
@@ -0,0 +1,208 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "usart.h"
+#include "ring_buffer.h"
+#include "util.h"
+
+// Bit positions are the same for both USARTs, the USART0 names are used for both
+
+typedef struct {
+    volatile uint8_t *ucsra;
+    volatile uint8_t *ucsrb;
+    volatile uint8_t *ucsrc;
+    volatile uint8_t *ubrrh;
+    volatile uint8_t *ubrrl;
+    volatile uint8_t *udr;
+} usart_registers_t;
+
+static const usart_registers_t usart_registers[USART_PORT_COUNT] = {
+    [USART_PORT_0] = {&UCSR0A, &UCSR0B, &UCSR0C, &UBRR0H, &UBRR0L, &UDR0},
+    [USART_PORT_1] = {&UCSR1A, &UCSR1B, &UCSR1C, &UBRR1H, &UBRR1L, &UDR1},
+};
+
+static uint8_t rx_storage[USART_PORT_COUNT][USART_RX_BUFFER_SIZE];
+static uint8_t tx_storage[USART_PORT_COUNT][USART_TX_BUFFER_SIZE];
+
+static struct {
+    ring_buffer_t rx_buffer;
+    ring_buffer_t tx_buffer;
+    usart_rx_handler_t rx_handler;
+    usart_tx_drain_handler_t tx_drain_handler;
+    volatile bool control_byte_pending;
+    uint8_t control_byte;
+} usarts[USART_PORT_COUNT] = {
+    [USART_PORT_0] = {
+        .rx_buffer = RING_BUFFER_INIT(rx_storage[USART_PORT_0]),
+        .tx_buffer = RING_BUFFER_INIT(tx_storage[USART_PORT_0]),
+    },
+    [USART_PORT_1] = {
+        .rx_buffer = RING_BUFFER_INIT(rx_storage[USART_PORT_1]),
+        .tx_buffer = RING_BUFFER_INIT(tx_storage[USART_PORT_1]),
+    },
+};
+
+static inline const usart_registers_t *get_registers(usart_port_t port) {
+    return &usart_registers[port];
+}
+
+static inline void enable_udre_interrupt(usart_port_t port) {
+    set_bit_inplace(*get_registers(port)->ucsrb, UDRIE0);
+}
+
+static inline void disable_udre_interrupt(usart_port_t port) {
+    clear_bit_inplace(*get_registers(port)->ucsrb, UDRIE0);
+}
+
+void usart_init() {
+    for (uint8_t port = 0; port < USART_PORT_COUNT; port++) {
+        usarts[port].rx_handler = NULLPTR;
+        usarts[port].tx_drain_handler = NULLPTR;
+        usarts[port].control_byte_pending = false;
+    }
+}
+
+void usart_configure(usart_port_t port, uint16_t ubrr, bool double_speed, uint8_t character_size, uint8_t stop_bits, uint8_t parity) {
+    const usart_registers_t *registers = get_registers(port);
+
+    cli();
+
+    *registers->ubrrh = (uint8_t)(ubrr >> 8);
+    *registers->ubrrl = (uint8_t)(ubrr);
+    change_bit_inplace(*registers->ucsra, U2X0, double_speed);
+
+    change_bit_inplace(*registers->ucsrc, UCSZ00, get_bit(character_size, 0));
+    change_bit_inplace(*registers->ucsrc, UCSZ01, get_bit(character_size, 1));
+    change_bit_inplace(*registers->ucsrb, UCSZ02, get_bit(character_size, 2));
+
+    change_bit_inplace(*registers->ucsrc, USBS0, stop_bits);
+    change_bit_inplace(*registers->ucsrc, UPM00, get_bit(parity, 0));
+    change_bit_inplace(*registers->ucsrc, UPM01, get_bit(parity, 1));
+
+    sei();
+}
+
+void usart_enable_rx_interrupt(usart_port_t port) {
+    set_bit_inplace(*get_registers(port)->ucsrb, RXCIE0);
+}
+
+void usart_disable_rx_interrupt(usart_port_t port) {
+    clear_bit_inplace(*get_registers(port)->ucsrb, RXCIE0);
+}
+
+void usart_start_receive(usart_port_t port) {
+    usart_enable_rx_interrupt(port);
+    set_bit_inplace(*get_registers(port)->ucsrb, RXEN0);
+}
+
+void usart_stop_receive(usart_port_t port) {
+    clear_bit_inplace(*get_registers(port)->ucsrb, RXEN0);
+    usart_disable_rx_interrupt(port);
+}
+
+void usart_start_transmit(usart_port_t port) {
+    set_bit_inplace(*get_registers(port)->ucsrb, TXEN0);
+}
+
+// Drops anything still waiting in the TX buffer
+void usart_stop_transmit(usart_port_t port) {
+    disable_udre_interrupt(port);
+    usarts[port].control_byte_pending = false;
+    ring_buffer_clear(&usarts[port].tx_buffer);
+    clear_bit_inplace(*get_registers(port)->ucsrb, TXEN0);
+}
+
+void usart_set_rx_handler(usart_port_t port, usart_rx_handler_t handler) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        usarts[port].rx_handler = handler;
+    }
+}
+
+void usart_set_tx_drain_handler(usart_port_t port, usart_tx_drain_handler_t handler) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        usarts[port].tx_drain_handler = handler;
+    }
+}
+
+bool usart_read_byte(usart_port_t port, uint8_t *byte) {
+    return ring_buffer_pop(&usarts[port].rx_buffer, byte);
+}
+
+void usart_clear_rx(usart_port_t port) {
+    ring_buffer_clear(&usarts[port].rx_buffer);
+}
+
+bool usart_write_byte(usart_port_t port, uint8_t byte) {
+    if (!ring_buffer_push(&usarts[port].tx_buffer, byte)) {
+        return false;
+    }
+
+    enable_udre_interrupt(port);
+    return true;
+}
+
+// Can be called from an ISR. A control byte which wasn't sent yet is replaced.
+void usart_write_control_byte(usart_port_t port, uint8_t byte) {
+    usarts[port].control_byte = byte;
+    usarts[port].control_byte_pending = true;
+    enable_udre_interrupt(port);
+}
+
+uint8_t usart_tx_buffered(usart_port_t port) {
+    return ring_buffer_count(&usarts[port].tx_buffer);
+}
+
+static inline void handle_receive_complete(usart_port_t port) {
+    const usart_registers_t *registers = get_registers(port);
+
+    uint8_t status = *registers->ucsra;
+    uint8_t byte = *registers->udr;
+    if (bit_is_set(status, FE) || bit_is_set(status, DOR) || bit_is_set(status, UPE)) {
+        return;
+    }
+
+    if (usarts[port].rx_handler != NULLPTR) {
+        usarts[port].rx_handler(byte);
+    } else {
+        // Bytes are dropped when the buffer is full
+        ring_buffer_push(&usarts[port].rx_buffer, byte);
+    }
+}
+
+static inline void handle_data_register_empty(usart_port_t port) {
+    const usart_registers_t *registers = get_registers(port);
+
+    if (usarts[port].control_byte_pending) {
+        *registers->udr = usarts[port].control_byte;
+        usarts[port].control_byte_pending = false;
+        return;
+    }
+
+    uint8_t byte;
+    if (!ring_buffer_pop(&usarts[port].tx_buffer, &byte)) {
+        disable_udre_interrupt(port);
+        return;
+    }
+
+    *registers->udr = byte;
+
+    if (usart_tx_buffered(port) == USART_TX_DRAIN_LEVEL && usarts[port].tx_drain_handler != NULLPTR) {
+        usarts[port].tx_drain_handler();
+    }
+}
+
+ISR(USART0_RX_vect) {
+    handle_receive_complete(USART_PORT_0);
+}
+
+ISR(USART1_RX_vect) {
+    handle_receive_complete(USART_PORT_1);
+}
+
+ISR(USART0_UDRE_vect) {
+    handle_data_register_empty(USART_PORT_0);
+}
+
+ISR(USART1_UDRE_vect) {
+    handle_data_register_empty(USART_PORT_1);
+}
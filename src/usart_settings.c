@@ -1,9 +1,11 @@
 #include "usart_settings.h"
 
+#include <stdlib.h>
 #include <avr/io.h>
 #include <avr/eeprom.h>
 #include <avr/interrupt.h>
 #include "tick_callback.h"
+#include "usart.h"
 #include "clcd.h"
 #include "buttons.h"
 #include "util.h"
@@ -12,14 +14,75 @@ typedef enum {
     SETTING_BAUD_RATE = 0,
     SETTING_DATA_BITS,
     SETTING_STOP_BITS,
-    SETTING_PARITY
+    SETTING_PARITY,
+    SETTING_HOST_BAUD_RATE
 } button_t;
 
-// For our values, using U2X = 1 is always more accurate
-#define UBBR_VALUE(baud) ((F_CPU / (8UL * baud)) - 1)
+#ifndef F_CPU
+#error "F_CPU not defined!"
+#endif
+
+// Largest baud rate error we still accept. 115200 baud ends up at +2.1 % on a
+// 16 MHz clock, which every target we have seen still receives correctly.
+#define BAUD_MAX_ERROR_PERMILLE 25
+
+// Clock divider (UBRR + 1) for the given prescaler, rounded to the nearest
+// integer. Prescaler is 16 in normal mode and 8 in double speed (U2X) mode.
+#define BAUD_DIVIDER(baud, prescaler) ((F_CPU + (prescaler) / 2 * (baud)) / ((prescaler) * (baud)))
+#define BAUD_DIVIDER_VALID(baud, prescaler) (BAUD_DIVIDER(baud, prescaler) >= 1 && BAUD_DIVIDER(baud, prescaler) <= 4096)
+
+// Real baud rate for the given prescaler, times 1000
+#define BAUD_ACTUAL_1000(baud, prescaler) (F_CPU * 1000ULL / ((prescaler) * BAUD_DIVIDER(baud, prescaler)))
+
+// Error of the real baud rate against the requested one. This is used in #if
+// as well, where everything is computed as uintmax_t, so the sign is taken
+// from a comparison instead of a subtraction which could go below zero.
+#define BAUD_ABS_ERROR(baud, prescaler) (!BAUD_DIVIDER_VALID(baud, prescaler) ? 1000 \
+    : BAUD_ACTUAL_1000(baud, prescaler) >= (baud) * 1000ULL \
+        ? (BAUD_ACTUAL_1000(baud, prescaler) - (baud) * 1000ULL) / (baud) \
+        : ((baud) * 1000ULL - BAUD_ACTUAL_1000(baud, prescaler)) / (baud))
+#define BAUD_ERROR(baud, prescaler) (!BAUD_DIVIDER_VALID(baud, prescaler) || BAUD_ACTUAL_1000(baud, prescaler) >= (baud) * 1000ULL \
+    ? (int16_t)BAUD_ABS_ERROR(baud, prescaler) \
+    : -(int16_t)BAUD_ABS_ERROR(baud, prescaler))
+
+// Normal speed mode samples each bit more times, so prefer it on a tie
+#define BAUD_PRESCALER(baud) (BAUD_ABS_ERROR(baud, 8) < BAUD_ABS_ERROR(baud, 16) ? 8 : 16)
+#define BAUD_USE_DOUBLE_SPEED(baud) (BAUD_PRESCALER(baud) == 8)
+#define BAUD_UBRR(baud) (BAUD_DIVIDER(baud, BAUD_PRESCALER(baud)) - 1)
+#define BAUD_ERROR_PERMILLE(baud) BAUD_ERROR(baud, BAUD_PRESCALER(baud))
+#define BAUD_ACHIEVABLE(baud) (BAUD_ABS_ERROR(baud, BAUD_PRESCALER(baud)) <= BAUD_MAX_ERROR_PERMILLE)
+
+// UBRR is only 12 bits wide, so the U2X selection is stored in the top bit
+#define BAUD_DOUBLE_SPEED_FLAG_POS 15
+#define BAUD_UBRR_MASK 0x0FFF
+#define BAUD_SETTING(baud) {BAUD_UBRR(baud) | (BAUD_USE_DOUBLE_SPEED(baud) << BAUD_DOUBLE_SPEED_FLAG_POS), #baud, BAUD_ERROR_PERMILLE(baud)}
+
+// These rates must always be available, the build fails if one of them is not
+// achievable with the configured F_CPU
+#define REQUIRED_BAUD_RATES(X) \
+    X(2400) \
+    X(4800) \
+    X(9600) \
+    X(14400) \
+    X(19200) \
+    X(28800) \
+    X(38400) \
+    X(57600) \
+    X(76800) \
+    X(115200)
+
+#define ASSERT_BAUD_ACHIEVABLE(baud) _Static_assert(BAUD_ACHIEVABLE(baud), "Baud rate " #baud " is not achievable with this F_CPU");
+#define REQUIRED_BAUD_SETTING(baud) BAUD_SETTING(baud),
+
+REQUIRED_BAUD_RATES(ASSERT_BAUD_ACHIEVABLE)
+
+#if F_CPU == 16000000UL
+// Double speed gets 57600 baud to -0.8 %, normal speed only to +2.1 %
+_Static_assert(BAUD_USE_DOUBLE_SPEED(57600) && BAUD_ERROR_PERMILLE(57600) == -7, "Baud rate errors must keep their sign");
+#endif
 
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
-#define SETTING_GROUPS_COUNT 4
+#define SETTING_GROUPS_COUNT 5
 
 #define EEPROM_SAVE_ADDR ((void*)0x1000)
 
@@ -29,6 +92,7 @@ static const magic_t MAGIC = 0xBEEF;
 typedef struct {
     uint16_t value;
     const char *label;
+    int16_t error_permille;
 } usart_setting_t;
 
 typedef struct {
@@ -42,17 +106,21 @@ typedef struct {
     uint8_t group_indices[SETTING_GROUPS_COUNT];
 } selected_settings_t;
 
+// Higher rates are only offered when the clock can actually produce them
 static const usart_setting_t usart_baud_settings[] = {
-    {UBBR_VALUE(2400), "2400"},
-    {UBBR_VALUE(4800), "4800"},
-    {UBBR_VALUE(9600), "9600"},
-    {UBBR_VALUE(14400), "14400"},
-    {UBBR_VALUE(19200), "19200"},
-    {UBBR_VALUE(28800), "28800"},
-    {UBBR_VALUE(38400), "38400"},
-    {UBBR_VALUE(57600), "57600"},
-    {UBBR_VALUE(76800), "76800"},
-    {UBBR_VALUE(115200), "115200"},
+    REQUIRED_BAUD_RATES(REQUIRED_BAUD_SETTING)
+#if BAUD_ACHIEVABLE(230400)
+    BAUD_SETTING(230400),
+#endif
+#if BAUD_ACHIEVABLE(250000)
+    BAUD_SETTING(250000),
+#endif
+#if BAUD_ACHIEVABLE(500000)
+    BAUD_SETTING(500000),
+#endif
+#if BAUD_ACHIEVABLE(1000000)
+    BAUD_SETTING(1000000),
+#endif
 };
 
 static const usart_setting_t usart_data_bits_settings[] = {
@@ -77,7 +145,9 @@ static const usart_settings_group_t usart_settings_groups[SETTING_GROUPS_COUNT]
     [SETTING_BAUD_RATE] = {"Baud Rate", usart_baud_settings, ARRAY_SIZE(usart_baud_settings)},
     [SETTING_DATA_BITS] = {"Data Bits", usart_data_bits_settings, ARRAY_SIZE(usart_data_bits_settings)},
     [SETTING_STOP_BITS] = {"Stop Bits", usart_stop_bits_settings, ARRAY_SIZE(usart_stop_bits_settings)},
-    [SETTING_PARITY] = {"Parity", usart_parity_settings, ARRAY_SIZE(usart_parity_settings)}
+    [SETTING_PARITY] = {"Parity", usart_parity_settings, ARRAY_SIZE(usart_parity_settings)},
+    // USART0 only differs in its baud rate, it is used by the serial bridge
+    [SETTING_HOST_BAUD_RATE] = {"Host Baud", usart_baud_settings, ARRAY_SIZE(usart_baud_settings)}
 };
 
 static struct {
@@ -98,9 +168,18 @@ static void try_load_settings_from_eeprom() {
     eeprom_read_block(&loaded_settings, EEPROM_SAVE_ADDR, sizeof(loaded_settings));
     sei();
 
-    if (loaded_settings.magic == MAGIC) {
-        settings_state.selected_settings = loaded_settings;
+    if (loaded_settings.magic != MAGIC) {
+        return;
     }
+
+    // The baud table depends on F_CPU, so a stored index may not exist anymore
+    for (uint8_t i = 0; i < SETTING_GROUPS_COUNT; i++) {
+        if (loaded_settings.group_indices[i] >= usart_settings_groups[i].count) {
+            return;
+        }
+    }
+
+    settings_state.selected_settings = loaded_settings;
 }
 
 static const uint8_t get_current_group_index() {
@@ -147,6 +226,18 @@ static inline const usart_setting_t *get_selected_setting() {
     return get_selected_setting_for_group(get_current_group_index());
 }
 
+static void draw_baud_error(int16_t error_permille) {
+    char digits[6];
+    uint16_t magnitude = error_permille < 0 ? -error_permille : error_permille;
+
+    clcd_write_char(' ');
+    clcd_write_char(error_permille < 0 ? '-' : '+');
+    clcd_write_string(utoa(magnitude / 10, digits, 10));
+    clcd_write_char('.');
+    clcd_write_char('0' + magnitude % 10);
+    clcd_write_char('%');
+}
+
 static void draw() {
     const usart_settings_group_t *group = get_current_settings_group();
     const usart_setting_t *setting = get_selected_setting();
@@ -160,6 +251,10 @@ static void draw() {
     clcd_set_cursor_position(0, 1);
     clcd_write_string("> ");
     clcd_write_string(setting->label);
+
+    if (get_current_settings_group()->settings == usart_baud_settings) {
+        draw_baud_error(setting->error_permille);
+    }
 }
 
 static void selection_up() {
@@ -178,28 +273,25 @@ static void selection_down() {
     set_selected_setting_index_for_current_group(new_index);
 }
 
-static void commit_settings() {
-    const usart_setting_t *baud_setting = get_selected_setting_for_group(SETTING_BAUD_RATE);
+static void commit_settings_for_port(usart_port_t port, uint8_t baud_group_index) {
+    const usart_setting_t *baud_setting = get_selected_setting_for_group(baud_group_index);
     const usart_setting_t *data_bits_setting = get_selected_setting_for_group(SETTING_DATA_BITS);
     const usart_setting_t *stop_bits_setting = get_selected_setting_for_group(SETTING_STOP_BITS);
     const usart_setting_t *parity_setting = get_selected_setting_for_group(SETTING_PARITY);
 
-    cli();
-
-    UBRR1H = (uint8_t)(baud_setting->value >> 8);
-    UBRR1L = (uint8_t)(baud_setting->value);
-
-    change_bit_inplace(UCSR1C, UCSZ10, get_bit(data_bits_setting->value, 0));
-    change_bit_inplace(UCSR1C, UCSZ11, get_bit(data_bits_setting->value, 1));
-
-    change_bit_inplace(UCSR1B, UCSZ12, get_bit(data_bits_setting->value, 2));
-
-    change_bit_inplace(UCSR1C, USBS1, stop_bits_setting->value);
-    change_bit_inplace(UCSR1C, UPM10, get_bit(parity_setting->value, 0));
-    change_bit_inplace(UCSR1C, UPM11, get_bit(parity_setting->value, 1));
-
-    sei();
+    usart_configure(
+        port,
+        baud_setting->value & BAUD_UBRR_MASK,
+        get_bit(baud_setting->value, BAUD_DOUBLE_SPEED_FLAG_POS),
+        data_bits_setting->value,
+        stop_bits_setting->value,
+        parity_setting->value
+    );
+}
 
+static void commit_settings() {
+    commit_settings_for_port(USART_PORT_1, SETTING_BAUD_RATE);
+    commit_settings_for_port(USART_PORT_0, SETTING_HOST_BAUD_RATE);
 }
 
 static void cleanup_settings() {
@@ -240,10 +332,6 @@ tick_callback_t switch_to_usart_settings() {
 }
 
 void usart_settings_init() {
-    // We always use double speed asynchronous mode
-    set_bit_inplace(UCSR0A, U2X0);
-    set_bit_inplace(UCSR1A, U2X1);
-
     settings_state.selected_settings.magic = MAGIC;
     try_load_settings_from_eeprom();
     commit_settings();
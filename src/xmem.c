@@ -0,0 +1,11 @@
+#include <avr/io.h>
+#include "xmem.h"
+#include "util.h"
+
+void xmem_init() {
+    // Full 60 KB address space with all PORTC pins used for the upper address
+    // byte and no wait states
+    XMCRA = 0;
+    XMCRB = 0;
+    set_bit_inplace(MCUCR, SRE);
+}
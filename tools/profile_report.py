@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""Where the firmware spends its time, from the sampling profiler.
+
+Needs a firmware built with -D PROFILER_ENABLED=1. Starts the profiler over
+the host serial port, lets it sample for a while, reads the histogram back
+and attributes the samples to the functions of the ELF file with avr-nm.
+
+    profile_report.py --port /dev/ttyUSB0 [--baud 9600] [--seconds 10]
+                      [--window START END | --zoom SYMBOL] [--nm avr-nm] elf
+    profile_report.py --input dump.txt [--nm avr-nm] elf
+
+A bin covers several words, so its samples are split between the functions
+in it by how much of the bin each one covers. --zoom narrows the window to
+one function for a bin per word, which also shows the hot loop inside it.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import termios
+import time
+
+HEADER_LINE = re.compile(r"^profile start=([0-9a-fA-F]+) shift=(\d+) rate=(\d+) samples=(\d+) outside=(\d+)$")
+BIN_LINE = re.compile(r"^([0-9a-fA-F]+) (\d+)$")
+NM_LINE = re.compile(r"^([0-9a-fA-F]+) ([0-9a-fA-F]+) ([tTwW]) (\S+)$")
+# Addresses of the protocol are 16-bit word addresses
+MAX_WORD = 0xFFFF
+# Longest histogram the board sends, 128 bins and the header, in bits
+MAX_DUMP_BITS = (128 * 12 + 80) * 10
+
+
+def read_functions(tool, elf):
+    output = subprocess.run([tool, "-n", "-S", "--defined-only", elf], check=True, capture_output=True, text=True).stdout
+    functions = []
+    for line in output.splitlines():
+        match = NM_LINE.match(line)
+        if match:
+            start = int(match.group(1), 16) // 2
+            words = (int(match.group(2), 16) + 1) // 2
+            functions.append((start, start + words, match.group(4)))
+    return functions
+
+
+def open_port(path, baud):
+    speed = getattr(termios, "B%d" % baud, None)
+    if speed is None:
+        sys.exit("Unsupported baud rate %d" % baud)
+
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    attributes = termios.tcgetattr(fd)
+    attributes[0] = 0
+    attributes[1] = 0
+    attributes[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+    attributes[3] = 0
+    attributes[4] = attributes[5] = speed
+    attributes[6][termios.VMIN] = 0
+    attributes[6][termios.VTIME] = 1
+    termios.tcsetattr(fd, termios.TCSANOW, attributes)
+    termios.tcflush(fd, termios.TCIOFLUSH)
+    return fd
+
+
+def read_dump(fd, baud):
+    lines = []
+    pending = b""
+    deadline = time.monotonic() + 1 + MAX_DUMP_BITS / baud
+    while time.monotonic() < deadline:
+        pending += os.read(fd, 256)
+        *complete, pending = pending.split(b"\n")
+        lines += [line.decode("ascii", "replace").strip() for line in complete]
+        if "end" in lines:
+            return lines
+    sys.exit("No complete histogram from the board, is the profiler built in?")
+
+
+def capture(args, window):
+    fd = open_port(args.port, args.baud)
+    try:
+        if window:
+            os.write(fd, b"w%04x%04x\n" % window)
+        os.write(fd, b"s")
+        time.sleep(args.seconds)
+        os.write(fd, b"pd")
+        return read_dump(fd, args.baud)
+    finally:
+        os.close(fd)
+
+
+def parse_dump(lines):
+    header = None
+    bins = []
+    for line in lines:
+        match = HEADER_LINE.match(line)
+        if match:
+            header = [int(match.group(1), 16)] + [int(value) for value in match.groups()[1:]]
+            bins = []
+            continue
+        match = BIN_LINE.match(line)
+        if header and match:
+            bins.append((int(match.group(1), 16), int(match.group(2))))
+    if header is None:
+        sys.exit("No histogram found")
+    return header, bins
+
+
+def attribute(functions, bins, shift):
+    totals = {}
+    for start, count in bins:
+        end = start + (1 << shift)
+        covered = 0
+        for function_start, function_end, name in functions:
+            overlap = min(end, function_end) - max(start, function_start)
+            if overlap > 0:
+                totals[name] = totals.get(name, 0) + count * overlap / (1 << shift)
+                covered += overlap
+        if covered < 1 << shift:
+            name = "?%04x" % start
+            totals[name] = totals.get(name, 0) + count * (1 - covered / (1 << shift))
+    return totals
+
+
+def find_window(functions, name):
+    for start, end, function in functions:
+        if function == name:
+            return start, min(end - 1, MAX_WORD)
+    sys.exit("No function %s in the ELF file" % name)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("elf")
+    parser.add_argument("--nm", default="avr-nm")
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", help="serial port of the host link, USART0")
+    source.add_argument("--input", help="histogram captured before")
+    parser.add_argument("--baud", type=int, default=9600, help="host baud rate set on the board")
+    parser.add_argument("--seconds", type=float, default=10)
+    zoom = parser.add_mutually_exclusive_group()
+    zoom.add_argument("--window", nargs=2, metavar=("START", "END"), help="word addresses in hex")
+    zoom.add_argument("--zoom", metavar="SYMBOL", help="only sample this function")
+    parser.add_argument("--bins", action="store_true", help="also list the raw bins")
+    args = parser.parse_args()
+
+    functions = read_functions(args.nm, args.elf)
+
+    if args.input:
+        with open(args.input) as dump_file:
+            lines = dump_file.read().splitlines()
+    else:
+        window = None
+        if args.window:
+            window = tuple(int(address, 16) for address in args.window)
+        elif args.zoom:
+            window = find_window(functions, args.zoom)
+        lines = capture(args, window)
+
+    (start, shift, rate, samples, outside), bins = parse_dump(lines)
+    print("%d samples at %d Hz, %.1f s, %d outside the window from %04x, %d words per bin"
+          % (samples, rate, samples / rate, outside, start, 1 << shift))
+    if samples == 0:
+        return 1
+
+    totals = attribute(functions, bins, shift)
+    print("\n%9s %7s  %s" % ("Samples", "%", "Function"))
+    for name, count in sorted(totals.items(), key=lambda item: -item[1]):
+        print("%9.1f %6.2f%%  %s" % (count, 100 * count / samples, name))
+    if outside:
+        print("%9d %6.2f%%  (outside the window)" % (outside, 100 * outside / samples))
+
+    if args.bins:
+        print("\n%6s %9s" % ("Word", "Samples"))
+        for address, count in bins:
+            print("%06x %9d" % (address, count))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+"""Flash and RAM use of the firmware per object file and per symbol.
+
+Reads the section and symbol tables of every object file in a PlatformIO
+build directory with avr-objdump, sums .text, .data and .bss per object and
+compares them with the checked-in budgets. Exits with 1 when an object grew
+past its budget, so a growing feature is a conscious decision. Objects
+without a budget are only listed, until budgets are recorded for them.
+
+    size_report.py [--objdump avr-objdump] [--budgets FILE] [--update]
+                   [--symbols N] [--object NAME] build_dir
+
+Flash is .text plus .data, whose initial values are stored there. RAM is
+.data plus .bss. Constant data without PROGMEM ends up in .data on the AVR,
+so string tables which should live in flash show up there.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+SECTION_CLASSES = (
+    ("text", (".text", ".progmem", ".init", ".fini", ".vectors", ".trampolines", ".jumptables", ".lowtext")),
+    ("data", (".data", ".rodata")),
+    ("bss", (".bss", ".noinit", "*COM*")),
+)
+COLUMNS = ("text", "data", "bss")
+ELF_KEY = "firmware.elf"
+
+SECTION_LINE = re.compile(r"^\s*\d+\s+(\S+)\s+([0-9a-fA-F]+)\s")
+SYMBOL_LINE = re.compile(r"^[0-9a-fA-F]+\s(.{7})\s(\S+)\s+([0-9a-fA-F]+)\s+(.+)$")
+# PlatformIO builds each library in a directory with a generated name
+LIBRARY_DIRECTORY = re.compile(r"^lib[0-9a-f]+/")
+
+
+def classify(section):
+    for name, prefixes in SECTION_CLASSES:
+        if any(section == prefix or section.startswith(prefix + ".") for prefix in prefixes):
+            return name
+    return None
+
+
+def objdump(tool, flag, path):
+    return subprocess.run([tool, flag, path], check=True, capture_output=True, text=True).stdout
+
+
+def read_sizes(tool, path):
+    sizes = dict.fromkeys(COLUMNS, 0)
+    for line in objdump(tool, "-h", path).splitlines():
+        match = SECTION_LINE.match(line)
+        if match and classify(match.group(1)):
+            sizes[classify(match.group(1))] += int(match.group(2), 16)
+    return sizes
+
+
+def read_symbols(tool, path, key):
+    symbols = []
+    for line in objdump(tool, "-t", path).splitlines():
+        match = SYMBOL_LINE.match(line)
+        if not match:
+            continue
+        flags, section, size, name = match.groups()
+        size = int(size, 16)
+        # Section and file symbols carry no size of their own
+        if size == 0 or "d" in flags or "f" in flags or not classify(section):
+            continue
+        symbols.append((size, classify(section), name.split()[-1], key))
+    return symbols
+
+
+def find_objects(build_dir):
+    objects = {}
+    for root, _, files in os.walk(build_dir):
+        for name in files:
+            if name.endswith(".o"):
+                path = os.path.join(root, name)
+                key = LIBRARY_DIRECTORY.sub("", os.path.relpath(path, build_dir))
+                objects[key] = path
+    return dict(sorted(objects.items()))
+
+
+def read_budgets(path):
+    budgets = {}
+    if not os.path.exists(path):
+        return budgets
+    with open(path) as budget_file:
+        for line in budget_file:
+            fields = line.split("#", 1)[0].split()
+            if len(fields) == len(COLUMNS) + 1:
+                budgets[fields[0]] = dict(zip(COLUMNS, map(int, fields[1:])))
+    return budgets
+
+
+def write_budgets(path, sizes):
+    header = []
+    if os.path.exists(path):
+        with open(path) as budget_file:
+            header = [line for line in budget_file if line.startswith("#") and not line.startswith("# object")]
+    width = max(len(key) for key in sizes)
+    with open(path, "w") as budget_file:
+        budget_file.writelines(header)
+        budget_file.write("%-*s %7s %7s %7s\n" % (width, "# object", *COLUMNS))
+        for key, values in sizes.items():
+            budget_file.write("%-*s %7d %7d %7d\n" % (width, key, *(values[column] for column in COLUMNS)))
+
+
+def compare(key, values, budget):
+    if budget is None:
+        return "no budget", False
+    growth = ["%s +%d" % (column, values[column] - budget[column]) for column in COLUMNS if values[column] > budget[column]]
+    if growth:
+        return "OVER " + ", ".join(growth), True
+    if any(values[column] < budget[column] for column in COLUMNS):
+        return "under budget", False
+    return "", False
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("build_dir")
+    parser.add_argument("--objdump", default="avr-objdump")
+    parser.add_argument("--budgets", default=os.path.join(os.path.dirname(__file__), "size_budgets.txt"))
+    parser.add_argument("--update", action="store_true", help="write the current sizes as the new budgets")
+    parser.add_argument("--symbols", type=int, default=25, help="how many of the largest symbols to list")
+    parser.add_argument("--object", help="list every symbol of this object instead")
+    args = parser.parse_args()
+
+    objects = find_objects(args.build_dir)
+    if not objects:
+        sys.exit("No object files in %s, build the firmware first" % args.build_dir)
+
+    sizes = {}
+    symbols = []
+    for key, path in objects.items():
+        sizes[key] = read_sizes(args.objdump, path)
+        symbols += read_symbols(args.objdump, path, key)
+
+    # The linked image also holds the C library and the startup code, and
+    # whatever the linker dropped as unused is missing from it
+    elves = [name for name in os.listdir(args.build_dir) if name.endswith(".elf")]
+    if elves:
+        sizes[ELF_KEY] = read_sizes(args.objdump, os.path.join(args.build_dir, elves[0]))
+
+    if args.update:
+        write_budgets(args.budgets, sizes)
+        print("Budgets written to %s" % args.budgets)
+        return 0
+
+    budgets = read_budgets(args.budgets)
+    failed = False
+    unbudgeted = [key for key in sizes if key not in budgets]
+    width = max(len(key) for key in sizes)
+
+    print("%-*s %7s %7s %7s %7s %7s" % (width, "Object", *COLUMNS, "flash", "ram"))
+    for key, values in sorted(sizes.items(), key=lambda item: (item[0] == ELF_KEY, -item[1]["text"] - item[1]["data"])):
+        note, over = compare(key, values, budgets.get(key))
+        failed = failed or over
+        flash = values["text"] + values["data"]
+        ram = values["data"] + values["bss"]
+        print("%-*s %7d %7d %7d %7d %7d  %s" % (width, key, *(values[column] for column in COLUMNS), flash, ram, note))
+
+    for key in budgets.keys() - sizes.keys():
+        print("%-*s  gone, its budget can be removed" % (width, key))
+
+    if args.object:
+        listed = [symbol for symbol in symbols if symbol[3] == args.object]
+    else:
+        listed = symbols[:]
+    listed.sort(reverse=True)
+    if not args.object:
+        listed = listed[:args.symbols]
+
+    print("\n%7s %-5s %-32s %s" % ("Size", "Class", "Symbol", "Object"))
+    for size, section_class, name, key in listed:
+        print("%7d %-5s %-32s %s" % (size, section_class, name, key))
+
+    if unbudgeted:
+        print("\nWarning: %d of %d objects have no budget, record them with --update" % (len(unbudgeted), len(sizes)))
+    if failed:
+        print("\nSize budget exceeded, shrink the change or raise the budget with --update")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,31 @@
+# PlatformIO extra script with the size targets, see tools/size_report.py:
+#   pio run -t size_report    sizes per object and symbol against the budgets
+#   pio run -t size_budgets   records the current sizes as the budgets
+import os
+import re
+
+Import("env")
+
+# Toolchains without $OBJDUMP have it next to the size tool, only the suffix
+# of the file name differs, e.g. avr-size and avr-objdump
+objdump = env.subst("$OBJDUMP")
+if not objdump:
+    directory, name = os.path.split(env.subst("$SIZETOOL"))
+    objdump = os.path.join(directory, re.sub(r"size(\.exe)?$", r"objdump\1", name))
+report = '"$PYTHONEXE" "$PROJECT_DIR/tools/size_report.py" --objdump "%s" "$BUILD_DIR"' % objdump
+
+env.AddCustomTarget(
+    name="size_report",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=report,
+    title="Size report",
+    description="Flash and RAM use per object and symbol, checked against tools/size_budgets.txt",
+)
+
+env.AddCustomTarget(
+    name="size_budgets",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=report + " --update",
+    title="Size budgets",
+    description="Write the current sizes to tools/size_budgets.txt",
+)
@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+"""Timeline of the firmware's trace points, to find where the time goes.
+
+Needs a firmware built with -D TRACE_ENABLED=1. Asks the board for the
+records in its trace ring over the host serial port, or reads a dump saved
+with --save before, and lists them with the time since the previous event
+and how long every start and end pair took.
+
+    trace_view.py --port /dev/ttyUSB0 [--baud 9600] [--wait 5] [--save FILE]
+                  [--stall US] [--chrome FILE]
+    trace_view.py --input FILE [--stall US] [--chrome FILE]
+
+--stall marks gaps without any event longer than the given time, --chrome
+writes the timeline in the Trace Event Format, which chrome://tracing and
+Perfetto open. The record format is described in include/trace.h.
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import termios
+import time
+
+MAGIC = b"TRC1"
+HEADER = struct.Struct("<4sHH")
+RECORD = struct.Struct("<HB3s")
+TIME_WRAP = 1 << 16
+
+# Same order as trace_event_t, with the start event of every end event
+EVENTS = {
+    1: ("tick", "start"),
+    2: ("tick", "end"),
+    3: ("sd command", "start"),
+    4: ("sd command", "end"),
+    5: ("disk read", "start"),
+    6: ("disk read", "end"),
+    7: ("lcd flush", "start"),
+    8: ("lcd flush", "end"),
+    9: ("upload page", "start"),
+    10: ("upload page", "end"),
+}
+ARGUMENT_NAMES = {
+    "sd command": ("CMD", "error"),
+    "disk read": ("LBA", "result"),
+    "upload page": ("sent", "acked"),
+}
+
+
+def open_port(path, baud):
+    speed = getattr(termios, "B%d" % baud, None)
+    if speed is None:
+        sys.exit("Unsupported baud rate %d" % baud)
+
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    attributes = termios.tcgetattr(fd)
+    attributes[0] = 0
+    attributes[1] = 0
+    attributes[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+    attributes[3] = 0
+    attributes[4] = attributes[5] = speed
+    attributes[6][termios.VMIN] = 0
+    attributes[6][termios.VTIME] = 1
+    termios.tcsetattr(fd, termios.TCSANOW, attributes)
+    termios.tcflush(fd, termios.TCIOFLUSH)
+    return fd
+
+
+def read_exactly(fd, size, deadline):
+    data = b""
+    while len(data) < size:
+        if time.monotonic() > deadline:
+            sys.exit("The board sent %d of %d bytes, is the trace built in?" % (len(data), size))
+        data += os.read(fd, size - len(data))
+    return data
+
+
+def capture(args):
+    fd = open_port(args.port, args.baud)
+    try:
+        # Start with a clean ring, so the records cover the wait
+        os.write(fd, b"c")
+        time.sleep(args.wait)
+        os.write(fd, b"t")
+
+        deadline = time.monotonic() + 1 + (HEADER.size + 255 * RECORD.size) * 10 / args.baud
+        header = read_exactly(fd, HEADER.size, deadline)
+        magic, count, _ = HEADER.unpack(header)
+        if magic != MAGIC:
+            sys.exit("Not a trace dump: %r" % header)
+        return header + read_exactly(fd, count * RECORD.size, deadline)
+    finally:
+        os.close(fd)
+
+
+def parse(dump):
+    magic, count, dropped = HEADER.unpack_from(dump)
+    if magic != MAGIC or len(dump) < HEADER.size + count * RECORD.size:
+        sys.exit("Not a complete trace dump")
+
+    records = []
+    now = None
+    for i in range(count):
+        stamp, event, argument = RECORD.unpack_from(dump, HEADER.size + i * RECORD.size)
+        # Nothing is more than one wrap apart as long as the main loop ticks
+        now = stamp if now is None else now + (stamp - now) % TIME_WRAP
+        records.append((now, event, int.from_bytes(argument, "little")))
+    return records, dropped
+
+
+def describe(event, argument):
+    name, kind = EVENTS.get(event, ("event %d" % event, "instant"))
+    if name in ARGUMENT_NAMES:
+        label = ARGUMENT_NAMES[name][0 if kind == "start" else 1]
+        if name == "upload page" or label == "LBA":
+            return "%s %s %s 0x%x" % (name, kind, label, argument)
+        return "%s %s %s %d" % (name, kind, label, argument)
+    return "%s %s" % (name, kind)
+
+
+def print_timeline(records, stall):
+    open_events = {}
+    durations = {}
+    previous = None
+
+    print("%12s %10s %10s  %s" % ("Time us", "Delta us", "Took us", "Event"))
+    for now, event, argument in records:
+        delta = 0 if previous is None else now - previous
+        if stall and delta > stall:
+            print("%12s %10d %10s  ---- stall ----" % ("", delta, ""))
+        previous = now
+
+        name, kind = EVENTS.get(event, (None, None))
+        took = ""
+        if kind == "start":
+            open_events[name] = now
+        elif kind == "end" and name in open_events:
+            duration = now - open_events.pop(name)
+            durations.setdefault(name, []).append(duration)
+            took = str(duration)
+        print("%12d %10d %10s  %s" % (now - records[0][0], delta, took, describe(event, argument)))
+
+    if durations:
+        print("\n%-12s %6s %8s %8s %8s" % ("Span", "Count", "Min us", "Avg us", "Max us"))
+        for name, values in durations.items():
+            print("%-12s %6d %8d %8.0f %8d" % (name, len(values), min(values), sum(values) / len(values), max(values)))
+
+
+def write_chrome(path, records):
+    events = []
+    started = set()
+    for now, event, argument in records:
+        name, kind = EVENTS.get(event, ("event %d" % event, "instant"))
+        # The ring may begin in the middle of a span
+        if kind == "end" and name not in started:
+            continue
+        started.add(name)
+        phase = {"start": "B", "end": "E"}.get(kind, "i")
+        events.append({"name": name, "ph": phase, "ts": now - records[0][0], "pid": 1, "tid": 1,
+                       "args": {"argument": argument}})
+    with open(path, "w") as chrome_file:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, chrome_file)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", help="serial port of the host link, USART0")
+    source.add_argument("--input", help="dump saved with --save")
+    parser.add_argument("--baud", type=int, default=9600, help="host baud rate set on the board")
+    parser.add_argument("--wait", type=float, default=5, help="seconds to trace before the dump")
+    parser.add_argument("--save", help="also write the raw dump to this file")
+    parser.add_argument("--stall", type=int, default=0, help="mark gaps longer than this many microseconds")
+    parser.add_argument("--chrome", help="write the timeline in the Trace Event Format")
+    args = parser.parse_args()
+
+    if args.input:
+        with open(args.input, "rb") as dump_file:
+            dump = dump_file.read()
+    else:
+        dump = capture(args)
+        if args.save:
+            with open(args.save, "wb") as dump_file:
+                dump_file.write(dump)
+
+    records, dropped = parse(dump)
+    print("%d records, %d events dropped during the previous dump" % (len(records), dropped))
+    if not records:
+        return 1
+
+    print_timeline(records, args.stall)
+    if args.chrome:
+        write_chrome(args.chrome, records)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())